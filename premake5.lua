@@ -54,3 +54,15 @@ workspace("chore")
         links({ "glew", "SDL2", "lemon-toolkit" })
         linkoptions { "-framework OpenGL", "-framework Cocoa", "-framework IOKit", "-framework CoreVideo" }
         files({ "example/light-casters/*.cpp", "source/**.cpp" })
+
+    project( "pack" )
+        location( "build/tools" )
+        links({ "glew", "SDL2", "lemon-toolkit" })
+        linkoptions { "-framework OpenGL", "-framework Cocoa", "-framework IOKit", "-framework CoreVideo" }
+        files({ "tools/pack/*.cpp", "source/**.cpp" })
+
+    project( "bake" )
+        location( "build/tools" )
+        links({ "glew", "SDL2", "lemon-toolkit" })
+        linkoptions { "-framework OpenGL", "-framework Cocoa", "-framework IOKit", "-framework CoreVideo" }
+        files({ "tools/bake/*.cpp", "source/**.cpp" })
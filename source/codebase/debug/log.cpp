@@ -3,7 +3,22 @@
 
 #include <codebase/debug/log.hpp>
 #include <codebase/debug/stacktrace.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <cstdarg>
+#include <cstdio>
+
+#ifndef PLATFORM_WIN32
+#include <pthread.h>
+#endif
 
 NS_LEMON_BEGIN
 
@@ -19,18 +34,152 @@ static const char* stt[] =
     kANSIRed,
 };
 
+// a fixed-size record formatted by the logging thread
+struct LogRecord
+{
+    const static size_t kSize = 512;
+
+    uint64_t timestamp;
+    uint32_t tid;
+    uint16_t length;
+    LogLevel level;
+    char message[kSize - 15];
+};
+
+// the single-producer/single-consumer queue of one thread, the producer is the owner
+// thread and the consumer is the one draining under the mutex of log. records carry
+// the tid of their producer, since queues of exited threads are reused by new ones.
+struct LogQueue
+{
+    const static size_t kCapacity = 256;
+
+    LogQueue(unsigned tid) : tid(tid)
+    {
+        head.store(0);
+        tail.store(0);
+        owned.store(true);
+    }
+
+    // returns the record to be written, nullptr if its full
+    LogRecord* acquire()
+    {
+        auto position = head.load(std::memory_order_relaxed);
+        if( position - tail.load(std::memory_order_acquire) >= kCapacity )
+            return nullptr;
+        return &records[position % kCapacity];
+    }
+
+    void publish()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    unsigned tid;
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    std::atomic<bool> owned;
+    LogRecord records[kCapacity];
+};
+
+struct Log;
+static Log* s_log_instance = nullptr;
+
 struct Log
 {
+    Log()
+    {
+        s_log_instance = this;
+#ifndef PLATFORM_WIN32
+        // the mutexes are held across fork, so the child never inherits them locked
+        // by threads which do not exist there, and the background thread is restarted.
+        pthread_atfork(
+            []() { s_log_instance->lock_all(); },
+            []() { s_log_instance->unlock_all(); },
+            []() { s_log_instance->unlock_all(); s_log_instance->restart(); });
+#endif
+    }
+
+    ~Log()
+    {
+        stop();
+        drain();
+    }
+
+    // the background thread and the condition it waits on
+    struct Worker
+    {
+        std::condition_variable condition;
+        std::thread thread;
+    };
+
+    // stops and joins the background thread, records are written synchronously since then
+    void stop()
+    {
+        std::unique_ptr<Worker> worker;
+        {
+            std::unique_lock<std::mutex> L(_condition_mutex);
+            _synchronous.store(true);
+            _stop = true;
+            worker = std::move(_worker);
+        }
+
+        if( worker )
+        {
+            worker->condition.notify_one();
+            worker->thread.join();
+        }
+    }
+
     void write(LogLevel level, const char* format, va_list args)
     {
-        if( static_cast<uint8_t>(level) < static_cast<uint8_t>(filter) )
+        if( static_cast<uint8_t>(level) < static_cast<uint8_t>(filter.load()) )
             return;
 
-        char buf[512];
-        int len = vsnprintf(buf, sizeof(buf), format, args);
-        buf[len] = '\0';
+        auto queue = get_thread_queue();
+        if( _synchronous.load() )
+        {
+            // nobody would drain the queues anymore, writes it out with the queued ones
+            LogRecord record;
+            format_record(record, queue != nullptr ? queue->tid : 0, level, format, args);
+
+            std::unique_lock<std::mutex> L(_drain_mutex);
+            drain_locked();
+            print_record(record);
+            out->flush();
+            return;
+        }
 
-        (*out) << stt[static_cast<uint8_t>(level)] << buf << kANSIReset << std::endl;
+        auto record = queue != nullptr ? queue->acquire() : nullptr;
+        if( record == nullptr )
+        {
+            _dropped ++;
+            return;
+        }
+
+        format_record(*record, queue->tid, level, format, args);
+        queue->publish();
+    }
+
+    void format_record(LogRecord& record, unsigned tid, LogLevel level, const char* format, va_list args)
+    {
+        int len = vsnprintf(record.message, sizeof(record.message), format, args);
+        len = std::max(0, std::min(len, (int)sizeof(record.message) - 1));
+
+        record.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - _launch).count();
+        record.tid = tid;
+        record.length = (uint16_t)len;
+        record.level = level;
+    }
+
+    // writes a record to the output stream, with the mutex of draining held
+    void print_record(const LogRecord& record)
+    {
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "[%12.6f][%2u] ", record.timestamp / 1e9, record.tid);
+        (*out) << stt[static_cast<uint8_t>(record.level)] << prefix;
+        out->write(record.message, record.length);
+        (*out) << kANSIReset << '\n';
     }
 
     void write(LogLevel level, const char* format, ...)
@@ -41,8 +190,156 @@ struct Log
         va_end(args);
     }
 
-    LogLevel filter = LogLevel::INFORMATION;
+    // writes the queued records of all threads, returns the number of records
+    size_t drain()
+    {
+        std::unique_lock<std::mutex> L(_drain_mutex);
+        return drain_locked();
+    }
+
+    // same as drain, with the mutex of draining held already
+    size_t drain_locked()
+    {
+        std::vector<LogQueue*> queues;
+        {
+            std::unique_lock<std::mutex> RL(_registry_mutex);
+            for( auto& queue : _queues )
+                queues.push_back(queue.get());
+        }
+
+        size_t written = 0;
+        for( auto queue : queues )
+        {
+            auto tail = queue->tail.load(std::memory_order_relaxed);
+            auto head = queue->head.load(std::memory_order_acquire);
+            for( ; tail < head; tail++ )
+            {
+                print_record(queue->records[tail % LogQueue::kCapacity]);
+                written ++;
+            }
+
+            queue->tail.store(tail, std::memory_order_release);
+        }
+
+        if( written > 0 )
+            out->flush();
+        return written;
+    }
+
+    LogQueue* get_thread_queue()
+    {
+        struct Owner
+        {
+            ~Owner() { if( queue ) queue->owned.store(false); }
+            LogQueue* queue = nullptr;
+        };
+
+        static thread_local Owner owner;
+        if( owner.queue == nullptr )
+            owner.queue = register_thread();
+        return owner.queue;
+    }
+
+    LogQueue* register_thread()
+    {
+        std::call_once(_start, [this]()
+        {
+            _launch = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> L(_condition_mutex);
+            if( !_stop )
+                start();
+        });
+
+        std::unique_lock<std::mutex> L(_registry_mutex);
+        for( auto& queue : _queues )
+        {
+            bool owned = false;
+            if( queue->owned.compare_exchange_strong(owned, true) )
+            {
+                queue->tid = _next_tid ++;
+                return queue.get();
+            }
+        }
+
+        auto queue = new (std::nothrow) LogQueue(_next_tid);
+        if( queue != nullptr )
+        {
+            _next_tid ++;
+            _queues.emplace_back(queue);
+        }
+        return queue;
+    }
+
+    void lock_all()
+    {
+        _drain_mutex.lock();
+        _registry_mutex.lock();
+        _condition_mutex.lock();
+    }
+
+    void unlock_all()
+    {
+        _condition_mutex.unlock();
+        _registry_mutex.unlock();
+        _drain_mutex.unlock();
+    }
+
+    // starts the background thread, with the mutex of condition held. records are
+    // written synchronously if its not available.
+    void start()
+    {
+        _worker.reset(new (std::nothrow) Worker());
+        if( _worker )
+            _worker->thread = std::thread(&Log::run, this, _worker.get());
+        else
+            _synchronous.store(true);
+    }
+
+    // called in the child of fork, where the background thread does not exist
+    void restart()
+    {
+        std::unique_lock<std::mutex> L(_condition_mutex);
+        if( !_worker )
+            return;
+
+        // the handle refers to a thread of parent, which could be neither joined nor
+        // detached here, so the worker is leaked without destruction. so is the condition
+        // which might be waited by that thread, notifying it would block forever.
+        _worker.release();
+        start();
+    }
+
+    void run(Worker* worker)
+    {
+        for( ;; )
+        {
+            // producers never notify, the queues are polled periodically instead
+            if( drain() == 0 )
+            {
+                std::unique_lock<std::mutex> L(_condition_mutex);
+                if( _stop )
+                    break;
+                worker->condition.wait_for(L, std::chrono::milliseconds(2));
+            }
+        }
+    }
+
+    std::atomic<LogLevel> filter { LogLevel::INFORMATION };
     std::ostream* out = &std::cout;
+
+    std::chrono::steady_clock::time_point _launch = std::chrono::steady_clock::now();
+    std::atomic<uint64_t> _dropped { 0 };
+
+    std::mutex _registry_mutex;
+    std::vector<std::unique_ptr<LogQueue>> _queues;
+    unsigned _next_tid = 0;
+
+    std::once_flag _start;
+    std::unique_ptr<Worker> _worker;
+    std::atomic<bool> _synchronous { false };
+    std::mutex _drain_mutex;
+    std::mutex _condition_mutex;
+    bool _stop = false;
 };
 
 static Log s_log;
@@ -52,18 +349,41 @@ void set_output_stream(LogLevel filter, std::ostream* stream)
     if( stream == nullptr )
         return;
 
-    s_log.filter = filter;
+    // records queued before are written to the previous stream
+    std::unique_lock<std::mutex> L(s_log._drain_mutex);
+    s_log.drain_locked();
+    s_log.filter.store(filter);
     s_log.out = stream;
 }
 
+void flush_log()
+{
+    s_log.drain();
+}
+
+uint64_t get_dropped_logs()
+{
+    return s_log._dropped.load();
+}
+
 void ABORT(const char* file, int line, const char* format, ...)
 {
+    // its going to exit, stops the background thread so the fatal records are written
+    // synchronously, instead of being dropped if the queue is full. the mutex must be
+    // released before exit, since its taken again when log destructed.
+    s_log.stop();
+
     va_list args;
     va_start(args, format);
     s_log.write(LogLevel::ERROR, format, args);
     s_log.write(LogLevel::ERROR, "\n\tIn: %s:%d\n\nStacktrace:", file, line);
-    stacktrace(*s_log.out, 2);
     va_end(args);
+
+    {
+        std::unique_lock<std::mutex> L(s_log._drain_mutex);
+        stacktrace(*s_log.out, 2);
+        s_log.out->flush();
+    }
     exit(0);
 }
 
@@ -91,4 +411,4 @@ void LOGE(const char* format, ...)
     va_end(args);
 }
 
-NS_LEMON_END
\ No newline at end of file
+NS_LEMON_END
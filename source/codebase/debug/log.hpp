@@ -16,6 +16,12 @@ enum class LogLevel : uint8_t
     ERROR,
 };
 
+// records are formatted by the logging thread and queued without locking, then written
+// to the output stream by a background thread.
 void set_output_stream(LogLevel, std::ostream*);
+// blocks until all the queued records written to the output stream
+void flush_log();
+// returns the number of records dropped since the queue of thread was full
+uint64_t get_dropped_logs();
 
-NS_LEMON_END
\ No newline at end of file
+NS_LEMON_END
@@ -4,86 +4,116 @@
 #include <codebase/debug/stacktrace.hpp>
 
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 
 NS_LEMON_BEGIN
 
 // implementations for posix based operation systems
 #include <execinfo.h>
-#include <signal.h>
+#include <dlfcn.h>
 #include <stdlib.h>
-#include <unistd.h>
 #include <cxxabi.h>
 
-::std::ostream& stacktrace(::std::ostream& out, unsigned skip)
+// the first call of backtrace loads the unwinder, which allocates and locks internally
+static bool warmup()
 {
-    // storage array for stack trace address data
-    void* addrlist[kDbgMaxTracebackFrames+1];
+    void* frame;
+    backtrace(&frame, 1);
+    return true;
+}
 
-    // retrieve current stack addresses
-    int addrlen = backtrace(addrlist, sizeof(addrlist) / sizeof(void*));
-    if (addrlen == 0)
-        return out << "    <empty, possibly corrupt>\n";
+static bool s_warmup = warmup();
 
-    // resolve addresses into strings containing "filename(function+address)",
-    // this array must be free()-ed
-    char** symbollist = backtrace_symbols(addrlist, addrlen);
+__attribute__((noinline))
+unsigned capture_stack(void** frames, unsigned max, unsigned skip)
+{
+    void* addrlist[kDbgMaxTracebackFrames+1];
 
-    // allocate string which will be filled with the demangled function name
-    size_t funcnamesize = 256;
-    char* funcname = (char*)malloc(funcnamesize);
+    // skips this function as well
+    auto total = std::min(max + skip + 1, (unsigned)(sizeof(addrlist) / sizeof(void*)));
+    int addrlen = backtrace(addrlist, (int)total);
 
-    // iterate over the returned symbol lines. skip the first, it is the
-    // address of this function.
-    char buffer[4096];
-    for (int i = skip; i < addrlen; i++)
-    {
-        char *begin_name = 0, *begin_offset = 0, *end_offset = 0;
+    unsigned size = 0;
+    for( int i = skip + 1; i < addrlen && size < max; i++ )
+        frames[size++] = addrlist[i];
+    return size;
+}
 
-        // find parentheses and +address offset surrounding the mangled name:
-        // ./module(function+0x15c) [0x8048a6d]
-        for (char *p = symbollist[i]; *p; ++p)
+uint32_t hash_stack(void* const* frames, unsigned size)
+{
+    // FNV-1a over the addresses
+    uint32_t hash = 2166136261u;
+    for( unsigned i = 0; i < size; i++ )
+    {
+        auto address = reinterpret_cast<uintptr_t>(frames[i]);
+        for( unsigned b = 0; b < sizeof(uintptr_t); b++ )
         {
-            if( *p == '(' ) begin_name = p;
-            else if( *p == '+' ) begin_offset = p;
-            else if( *p == ')' && begin_offset )
-            {
-                end_offset = p;
-                break;
-            }
+            hash ^= (uint32_t)((address >> (b * 8)) & 0xFF);
+            hash *= 16777619u;
         }
+    }
+    return hash;
+}
 
-        if (begin_name && begin_offset && end_offset
-            && begin_name < begin_offset)
-        {
-            *begin_name++ = '\0';
-            *begin_offset++ = '\0';
-            *end_offset = '\0';
-
-            // mangled name is now in [begin_name, begin_offset) and caller
-            // offset in [begin_offset, end_offset). now apply
-            // __cxa_demangle():
-            int status;
-            funcname = abi::__cxa_demangle(begin_name, funcname, &funcnamesize, &status);
-
-            sprintf(buffer, "    - %s: (%s)+%s %s\n",
-                symbollist[i],
-                status == 0 ? funcname : begin_name,
-                begin_offset,
-                end_offset);
-
-            out << buffer;
-        }
-        else
-        {
-            // couldn't parse the line? print the whole line.
-            sprintf(buffer, "    - %s\n", symbollist[i]);
-            out << buffer;
-        }
+static std::string resolve(void* address)
+{
+    char buffer[512];
+
+    Dl_info info;
+    if( dladdr(address, &info) == 0 )
+    {
+        snprintf(buffer, sizeof(buffer), "<unknown> [%p]", address);
+        return buffer;
     }
 
+    auto module = info.dli_fname ? info.dli_fname : "<unknown>";
+    if( info.dli_sname == nullptr )
+    {
+        auto offset = (uintptr_t)address - (uintptr_t)info.dli_fbase;
+        snprintf(buffer, sizeof(buffer), "%s(+0x%zx) [%p]", module, (size_t)offset, address);
+        return buffer;
+    }
+
+    int status;
+    auto funcname = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    auto offset = (uintptr_t)address - (uintptr_t)info.dli_saddr;
+    snprintf(buffer, sizeof(buffer), "%s: (%s)+0x%zx [%p]",
+        module, status == 0 ? funcname : info.dli_sname, (size_t)offset, address);
     free(funcname);
-    free(symbollist);
+    return buffer;
+}
+
+std::string symbolize(void* address)
+{
+    static std::mutex s_mutex;
+    static std::unordered_map<void*, std::string> s_symbols;
+
+    std::unique_lock<std::mutex> L(s_mutex);
+    auto found = s_symbols.find(address);
+    if( found != s_symbols.end() )
+        return found->second;
+
+    auto symbol = resolve(address);
+    s_symbols.insert(std::make_pair(address, symbol));
+    return symbol;
+}
+
+std::ostream& write_stack(std::ostream& out, void* const* frames, unsigned size)
+{
+    if( size == 0 )
+        return out << "    <empty, possibly corrupt>\n";
+
+    for( unsigned i = 0; i < size; i++ )
+        out << "    - " << symbolize(frames[i]) << "\n";
     return out;
 }
 
-NS_LEMON_END
\ No newline at end of file
+std::ostream& stacktrace(std::ostream& out, unsigned skip)
+{
+    void* frames[kDbgMaxTracebackFrames];
+    auto size = capture_stack(frames, kDbgMaxTracebackFrames, skip);
+    return write_stack(out, frames, size);
+}
+
+NS_LEMON_END
@@ -1,11 +1,25 @@
 // @date 2016/09/05
 // @author Mao Jingkai(oammix@gmail.com)
 
+#pragma once
+
 #include <forwards.hpp>
 #include <iosfwd>
+#include <string>
 
 NS_LEMON_BEGIN
 
+// captures the return addresses of calling thread without symbolizing, which is cheap
+// enough for allocation tracking and sampling. returns the number of frames captured.
+unsigned capture_stack(void** frames, unsigned max, unsigned skip = 1);
+// returns the hash of captured frames, which identifies the same call stacks
+uint32_t hash_stack(void* const* frames, unsigned size);
+// resolves an address into "module(function+offset)", results are cached
+std::string symbolize(void* address);
+// writes the captured frames symbolized
+std::ostream& write_stack(std::ostream&, void* const* frames, unsigned size);
+
+// captures and writes the call stack of calling thread
 std::ostream& stacktrace(std::ostream&, unsigned skip = 1);
 
-NS_LEMON_END
\ No newline at end of file
+NS_LEMON_END
@@ -0,0 +1,156 @@
+// @date 2016/11/11
+// @author Mao Jingkai(oammix@gmail.com)
+
+#include <codebase/frame_allocator.hpp>
+#include <codebase/memory_tracker.hpp>
+
+#include <atomic>
+#include <cstdlib>
+
+NS_LEMON_BEGIN
+
+const size_t FrameAllocator::kChunkSize;
+
+namespace
+{
+    std::atomic<uint64_t> s_frame { 0 };
+
+    struct FrameBuffer
+    {
+        struct Chunk
+        {
+            uint8_t* memory;
+            size_t capacity;
+        };
+
+        ~FrameBuffer()
+        {
+            release();
+        }
+
+        void* allocate(size_t size, size_t alignment)
+        {
+            if( !chunks.empty() )
+            {
+                auto& chunk = chunks.back();
+                auto start = (position + alignment - 1) & ~(alignment - 1);
+                if( start + size <= chunk.capacity )
+                {
+                    position = start + size;
+                    used += size;
+                    return chunk.memory + start;
+                }
+            }
+
+            if( size > std::numeric_limits<size_t>::max() - alignment )
+                return nullptr;
+
+            // grows with a new chunk, which is merged into one when reset
+            auto capacity = std::max(size + alignment, FrameAllocator::kChunkSize);
+            auto memory = static_cast<uint8_t*>(::malloc(capacity));
+            if( memory == nullptr )
+                return nullptr;
+
+            track_alloc(MemoryTag::FRAME, capacity);
+            chunks.push_back({ memory, capacity });
+
+            auto start = ((size_t)(-(intptr_t)memory)) & (alignment - 1);
+            position = start + size;
+            used += size;
+            return memory + start;
+        }
+
+        void reset()
+        {
+            if( chunks.size() > 1 )
+            {
+                size_t capacity = 0;
+                for( auto& chunk : chunks )
+                    capacity += chunk.capacity;
+
+                release();
+                if( auto memory = static_cast<uint8_t*>(::malloc(capacity)) )
+                {
+                    track_alloc(MemoryTag::FRAME, capacity);
+                    chunks.push_back({ memory, capacity });
+                }
+            }
+
+            position = 0;
+            used = 0;
+        }
+
+        void release()
+        {
+            for( auto& chunk : chunks )
+            {
+                track_free(MemoryTag::FRAME, chunk.capacity);
+                ::free(chunk.memory);
+            }
+            chunks.clear();
+        }
+
+        size_t capacity() const
+        {
+            size_t capacity = 0;
+            for( auto& chunk : chunks )
+                capacity += chunk.capacity;
+            return capacity;
+        }
+
+        std::vector<Chunk> chunks;
+        size_t position = 0;
+        size_t used = 0;
+    };
+
+    struct ThreadFrameBuffers
+    {
+        // returns the buffer of current frame, the stale buffers are reset
+        FrameBuffer& current()
+        {
+            auto now = s_frame.load(std::memory_order_acquire);
+            if( now != frame )
+            {
+                // the buffer of the frame before previous one is not referenced anymore
+                buffers[now % 2].reset();
+                if( now > frame + 1 )
+                    buffers[(now + 1) % 2].reset();
+                frame = now;
+            }
+
+            return buffers[frame % 2];
+        }
+
+        uint64_t frame = 0;
+        FrameBuffer buffers[2];
+    };
+
+    thread_local ThreadFrameBuffers s_buffers;
+}
+
+void* FrameAllocator::allocate(size_t size, size_t alignment)
+{
+    return s_buffers.current().allocate(size, alignment);
+}
+
+void FrameAllocator::advance()
+{
+    s_frame.fetch_add(1, std::memory_order_release);
+}
+
+uint64_t FrameAllocator::get_frame()
+{
+    return s_frame.load();
+}
+
+size_t FrameAllocator::get_used()
+{
+    return s_buffers.current().used;
+}
+
+size_t FrameAllocator::get_capacity()
+{
+    return s_buffers.current().capacity();
+}
+
+NS_LEMON_END
@@ -0,0 +1,70 @@
+// @date 2016/11/11
+// @author Mao Jingkai(oammix@gmail.com)
+
+#pragma once
+
+#include <forwards.hpp>
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <vector>
+
+NS_LEMON_BEGIN
+
+// a per-thread linear allocator of transient memory, allocations are bumps of the buffer
+// of calling thread and never freed individually. each thread has two buffers used in
+// turn by frames, and a buffer is reset when its thread allocates in the frame after the
+// next, so memory allocated in a frame stays valid until the end of next frame, which
+// covers the draw of frame on render thread. buffers grow as needed, and are merged into
+// one chunk when reset, so steady-state frames perform no heap allocations.
+struct FrameAllocator
+{
+    const static size_t kChunkSize = 64 * 1024;
+
+    // allocates memory from the buffer of current frame on calling thread, returns
+    // nullptr if its failed
+    static void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    // advances to the next frame, which should be called when the frame ends
+    static void advance();
+    // returns the index of current frame
+    static uint64_t get_frame();
+    // returns the bytes allocated by calling thread in current frame
+    static size_t get_used();
+    // returns the capacity of the buffer of current frame on calling thread
+    static size_t get_capacity();
+};
+
+// the STL-compatible adaptor of frame allocator, which throws std::bad_alloc if its
+// failed as containers require
+template<typename T> struct FrameAllocatorT
+{
+    using value_type = T;
+
+    FrameAllocatorT() = default;
+    template<typename U> FrameAllocatorT(const FrameAllocatorT<U>&) {}
+
+    T* allocate(size_t n);
+    void deallocate(T*, size_t) {}
+
+    template<typename U> struct rebind { using other = FrameAllocatorT<U>; };
+    template<typename U> bool operator == (const FrameAllocatorT<U>&) const { return true; }
+    template<typename U> bool operator != (const FrameAllocatorT<U>&) const { return false; }
+};
+
+// a vector lives in frame, it must be released before the end of next frame
+template<typename T> using frame_vector = std::vector<T, FrameAllocatorT<T>>;
+
+//
+template<typename T> INLINE T* FrameAllocatorT<T>::allocate(size_t n)
+{
+    if( n > std::numeric_limits<size_t>::max() / sizeof(T) )
+        throw std::bad_alloc();
+
+    auto memory = FrameAllocator::allocate(sizeof(T)*n, alignof(T));
+    if( memory == nullptr )
+        throw std::bad_alloc();
+    return static_cast<T*>(memory);
+}
+
+NS_LEMON_END
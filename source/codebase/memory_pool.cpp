@@ -6,8 +6,9 @@
 
 NS_LEMON_BEGIN
 
-MemoryPool::MemoryPool(size_t block_size, size_t chunk_size)
+MemoryPool::MemoryPool(size_t block_size, size_t chunk_size, MemoryTag tag)
 {
+    _tag = tag;
     _first_free_block = invalid;
     _available = 0;
     _block_size = block_size < sizeof(size_t) ? sizeof(size_t) : block_size;
@@ -75,7 +76,10 @@ void MemoryPool::free_all()
 {
     // returns allocated chunk to system
     for( auto chunk : _chunks )
+    {
         ::free(chunk);
+        track_free(_tag, _chunk_entries_size*_block_size);
+    }
 
     _chunks.clear();
     _available = 0;
@@ -85,11 +89,12 @@ void MemoryPool::free_all()
 size_t MemoryPool::grow()
 {
     auto chunk = static_cast<uint8_t*>(::malloc(_chunk_entries_size*_block_size));
-    memset(chunk, 0xCC, _chunk_entries_size*_block_size);
-
     if( chunk == nullptr )
         return invalid;
 
+    memset(chunk, 0xCC, _chunk_entries_size*_block_size);
+    track_alloc(_tag, _chunk_entries_size*_block_size);
+
     auto iterator = chunk;
     auto offset = _chunk_entries_size * _chunks.size();
     for( size_t i = 1; i < _chunk_entries_size; i++, iterator += _block_size )
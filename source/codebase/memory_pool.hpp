@@ -4,6 +4,7 @@
 #pragma once
 
 #include <forwards.hpp>
+#include <codebase/memory_tracker.hpp>
 
 #include <vector>
 #include <type_traits>
@@ -18,7 +19,7 @@ NS_LEMON_BEGIN
 // 2. improving cache efficiency by keeping memory contiguous;
 struct MemoryPool
 {
-    MemoryPool(size_t block_size, size_t chunk_size);
+    MemoryPool(size_t block_size, size_t chunk_size, MemoryTag tag = MemoryTag::POOL);
     virtual ~MemoryPool();
 
     // accquire a unused block of memory
@@ -44,13 +45,14 @@ protected:
     size_t _first_free_block;
     size_t _block_size;
     size_t _chunk_entries_size;
+    MemoryTag _tag;
 };
 
 template<typename T, size_t Growth> struct MemoryPoolT : public MemoryPool
 {
     using aligned_storage_t = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
 
-    MemoryPoolT() : MemoryPool(sizeof(aligned_storage_t), Growth)
+    MemoryPoolT(MemoryTag tag = MemoryTag::POOL) : MemoryPool(sizeof(aligned_storage_t), Growth, tag)
     {}
 };
 
@@ -0,0 +1,116 @@
+// @date 2016/11/10
+// @author Mao Jingkai(oammix@gmail.com)
+
+#include <codebase/memory_tracker.hpp>
+
+#include <atomic>
+#include <new>
+
+NS_LEMON_BEGIN
+
+namespace
+{
+    struct MemoryCounters
+    {
+        std::atomic<size_t> live { 0 };
+        std::atomic<size_t> peak { 0 };
+        std::atomic<size_t> budget { 0 };
+        std::atomic<uint64_t> allocations { 0 };
+        std::atomic<uint64_t> frees { 0 };
+        std::atomic<uint64_t> allocated { 0 };
+        std::atomic<bool> warned { false };
+    };
+
+    MemoryCounters s_counters[kMemoryTagCount];
+
+    const char* s_tag_names[kMemoryTagCount] =
+    {
+        "general", "pool", "ecs", "render", "image", "primitive", "frame"
+    };
+}
+
+void track_alloc(MemoryTag tag, size_t size)
+{
+    auto& counters = s_counters[(size_t)tag];
+    auto live = counters.live.fetch_add(size, std::memory_order_relaxed) + size;
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.allocated.fetch_add(size, std::memory_order_relaxed);
+
+    auto peak = counters.peak.load(std::memory_order_relaxed);
+    while( live > peak && !counters.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed) ) {}
+
+    auto budget = counters.budget.load(std::memory_order_relaxed);
+    if( budget > 0 && live > budget && !counters.warned.exchange(true) )
+        LOGW("memory of %s exceeds budget, %zu/%zu byte(s).", s_tag_names[(size_t)tag], live, budget);
+}
+
+void track_free(MemoryTag tag, size_t size)
+{
+    auto& counters = s_counters[(size_t)tag];
+    counters.live.fetch_sub(size, std::memory_order_relaxed);
+    counters.frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+void set_memory_budget(MemoryTag tag, size_t budget)
+{
+    auto& counters = s_counters[(size_t)tag];
+    counters.budget.store(budget);
+    counters.warned.store(false);
+}
+
+bool is_over_memory_budget(MemoryTag tag)
+{
+    auto& counters = s_counters[(size_t)tag];
+    auto budget = counters.budget.load();
+    return budget > 0 && counters.live.load() > budget;
+}
+
+MemoryStats get_memory_stats(MemoryTag tag)
+{
+    auto& counters = s_counters[(size_t)tag];
+
+    MemoryStats stats;
+    stats.live = counters.live.load();
+    stats.peak = counters.peak.load();
+    stats.budget = counters.budget.load();
+    stats.allocations = counters.allocations.load();
+    stats.frees = counters.frees.load();
+    stats.allocated = counters.allocated.load();
+    return stats;
+}
+
+const char* get_memory_tag_name(MemoryTag tag)
+{
+    return s_tag_names[(size_t)tag];
+}
+
+void TaggedDeleter::operator() (uint8_t* memory) const
+{
+    if( memory != nullptr )
+    {
+        track_free(tag, size);
+        delete[] memory;
+    }
+}
+
+TaggedBytes allocate_tagged(MemoryTag tag, size_t size)
+{
+    auto memory = new (std::nothrow) uint8_t[size];
+    if( memory == nullptr )
+        return TaggedBytes(nullptr, TaggedDeleter(tag, 0));
+
+    track_alloc(tag, size);
+    return TaggedBytes(memory, TaggedDeleter(tag, size));
+}
+
+std::shared_ptr<uint8_t> allocate_tagged_shared(MemoryTag tag, size_t size)
+{
+    auto bytes = allocate_tagged(tag, size);
+    if( !bytes )
+        return nullptr;
+
+    auto deleter = bytes.get_deleter();
+    return std::shared_ptr<uint8_t>(bytes.release(), deleter);
+}
+
+NS_LEMON_END
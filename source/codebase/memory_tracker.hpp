@@ -0,0 +1,67 @@
+// @date 2016/11/10
+// @author Mao Jingkai(oammix@gmail.com)
+
+#pragma once
+
+#include <forwards.hpp>
+
+#include <memory>
+
+NS_LEMON_BEGIN
+
+// categories of memory which are tracked and budgeted separately
+enum class MemoryTag : uint8_t
+{
+    GENERAL = 0,
+    POOL,       // chunks of memory pools
+    ECS,        // components of entities
+    RENDER,     // command buffers and uniform arenas of render frames
+    IMAGE,      // pixels of images
+    PRIMITIVE,  // vertices and indices of primitives
+    FRAME,      // buffers of frame allocator
+};
+
+const static size_t kMemoryTagCount = 7;
+
+// statistics of a tag, the allocation rate could be derived by sampling the cumulative
+// counters periodically
+struct MemoryStats
+{
+    size_t live = 0;
+    size_t peak = 0;
+    size_t budget = 0;
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t allocated = 0;
+};
+
+// records allocations and deallocations of memory not allocated by the helpers below,
+// all the counters are atomic and safe to be updated from any thread
+void track_alloc(MemoryTag, size_t);
+void track_free(MemoryTag, size_t);
+
+// sets the budget of tag, a warning is emitted once when the live bytes exceed it.
+// zero means unlimited
+void set_memory_budget(MemoryTag, size_t);
+bool is_over_memory_budget(MemoryTag);
+
+MemoryStats get_memory_stats(MemoryTag);
+const char* get_memory_tag_name(MemoryTag);
+
+// tracked byte arrays, which are untracked when released
+struct TaggedDeleter
+{
+    TaggedDeleter(MemoryTag tag = MemoryTag::GENERAL, size_t size = 0) : tag(tag), size(size) {}
+    void operator() (uint8_t* memory) const;
+
+    MemoryTag tag;
+    size_t size;
+};
+
+using TaggedBytes = std::unique_ptr<uint8_t[], TaggedDeleter>;
+
+// allocates a tracked byte array, returns nullptr if failed
+TaggedBytes allocate_tagged(MemoryTag, size_t);
+std::shared_ptr<uint8_t> allocate_tagged_shared(MemoryTag, size_t);
+
+NS_LEMON_END
@@ -5,6 +5,7 @@
 
 #include <forwards.hpp>
 #include <atomic>
+#include <thread>
 
 NS_LEMON_BEGIN
 
@@ -28,4 +29,68 @@ protected:
     std::atomic_flag _lock = ATOMIC_FLAG_INIT;
 };
 
+// a reader-writer spin lock for short critical sections. readers share the lock with
+// each other, a writer is exclusive and blocks new readers once its waiting.
+struct SharedSpinMutex
+{
+    SharedSpinMutex() = default;
+    SharedSpinMutex(const SharedSpinMutex&) = delete;
+    SharedSpinMutex& operator = (const SharedSpinMutex&) = delete;
+
+    void lock()
+    {
+        for( ;; )
+        {
+            auto state = _state.load(std::memory_order_relaxed);
+            if( (state & kWriter) == 0 &&
+                _state.compare_exchange_weak(state, state | kWriter, std::memory_order_acquire) )
+                break;
+            std::this_thread::yield();
+        }
+
+        while( (_state.load(std::memory_order_acquire) & ~kWriter) != 0 )
+            std::this_thread::yield();
+    }
+
+    void unlock()
+    {
+        _state.fetch_and(~kWriter, std::memory_order_release);
+    }
+
+    void lock_shared()
+    {
+        for( ;; )
+        {
+            auto state = _state.load(std::memory_order_relaxed);
+            if( (state & kWriter) == 0 &&
+                _state.compare_exchange_weak(state, state + 1, std::memory_order_acquire) )
+                return;
+            std::this_thread::yield();
+        }
+    }
+
+    void unlock_shared()
+    {
+        _state.fetch_sub(1, std::memory_order_release);
+    }
+
+protected:
+    const static uint32_t kWriter = 0x80000000;
+    // the writer bit and the number of readers
+    std::atomic<uint32_t> _state { 0 };
+};
+
+// holds a shared mutex in shared mode for the scope
+template<typename T> struct SharedLockGuard
+{
+    explicit SharedLockGuard(T& mutex) : _mutex(mutex) { _mutex.lock_shared(); }
+    ~SharedLockGuard() { _mutex.unlock_shared(); }
+
+    SharedLockGuard(const SharedLockGuard&) = delete;
+    SharedLockGuard& operator = (const SharedLockGuard&) = delete;
+
+protected:
+    T& _mutex;
+};
+
 NS_LEMON_END
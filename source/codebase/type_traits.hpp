@@ -6,6 +6,7 @@
 #include <forwards.hpp>
 
 #include <type_traits>
+#include <atomic>
 
 NS_LEMON_BEGIN
 
@@ -49,23 +50,25 @@ protected:
 
 template<typename B> TypeInfo::index_t TypeInfo::counter<B>::value = 0;
 
+// incremental id of arbitrary type, ids might be requested from several threads
+// at the same time, so the counter is atomic
 struct TypeInfoGeneric
 {
     using index_t = size_t;
 
     template<typename Base, typename Type> static index_t id()
     {
-        static index_t sid = counter<Base>::value ++;
+        static index_t sid = counter<Base>::value.fetch_add(1);
         return sid;
     }
 
 protected:
     template<typename Base> struct counter
     {
-        static index_t value;
+        static std::atomic<index_t> value;
     };
 };
 
-template<typename B> TypeInfo::index_t TypeInfoGeneric::counter<B>::value = 0;
+template<typename B> std::atomic<TypeInfoGeneric::index_t> TypeInfoGeneric::counter<B>::value(0);
 
 NS_LEMON_END
\ No newline at end of file
@@ -99,7 +99,7 @@ namespace details
 
     protected:
         std::mutex _mutex;
-        MemoryPoolT<T, Growth> _allocator;
+        MemoryPoolT<T, Growth> _allocator { MemoryTag::ECS };
     };
 
 }
@@ -149,8 +149,8 @@ struct EntityComponentSystem : public Subsystem
         view_traits(EntityComponentSystem&);
 
         void visit(const std::function<void(Entity&, Args& ...)>&);
-        void collect(std::vector<Entity*>&);
-        template<typename ... ToArgs> void collect(std::vector<std::tuple<ToArgs*...>>&);
+        template<typename A> void collect(std::vector<Entity*, A>&);
+        template<typename A, typename ... ToArgs> void collect(std::vector<std::tuple<ToArgs*...>, A>&);
         size_t count() const;
     };
 
@@ -388,15 +388,15 @@ void EntityComponentSystem::view_traits<Args...>::visit(const std::function<void
         cb(*entity, *entity->template get_component<Args>()...);
 }
 
-template<typename ... Args>
-void EntityComponentSystem::view_traits<Args...>::collect(std::vector<Entity*>& ct)
+template<typename ... Args> template<typename A>
+void EntityComponentSystem::view_traits<Args...>::collect(std::vector<Entity*, A>& ct)
 {
     for( auto entity : *this )
         ct.push_back(entity);
 }
 
-template<typename ... Args> template<typename ... ToArgs>
-void EntityComponentSystem::view_traits<Args...>::collect(std::vector<std::tuple<ToArgs*...>>& ct)
+template<typename ... Args> template<typename A, typename ... ToArgs>
+void EntityComponentSystem::view_traits<Args...>::collect(std::vector<std::tuple<ToArgs*...>, A>& ct)
 {
     static_assert(AllTrue<std::is_convertible<Args*, ToArgs*>::value...>::value, "");
     for( auto entity : *this )
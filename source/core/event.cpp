@@ -0,0 +1,178 @@
+// @date 2016/09/29
+// @author Mao Jingkai(oammix@gmail.com)
+
+#include <core/event.hpp>
+
+#include <algorithm>
+#include <atomic>
+
+NS_LEMON_CORE_BEGIN
+
+static std::atomic<uint32_t> s_event_system_uid(0);
+
+EventSystem::EventSystem() : _uid(++s_event_system_uid)
+{}
+
+EventSystem::ThreadQueues& EventSystem::get_thread_queues()
+{
+    // a single-slot cache per thread keyed with the unique id of event system,
+    // so only the first queued event of a thread needs to take the lock
+    static thread_local uint32_t s_cached_uid = 0;
+    static thread_local ThreadQueues* s_cached_queues = nullptr;
+
+    if( s_cached_uid == _uid )
+        return *s_cached_queues;
+
+    std::unique_lock<std::mutex> L(_thread_mutex);
+
+    const auto id = std::this_thread::get_id();
+    auto found = _thread_indices.find(id);
+    if( found == _thread_indices.end() )
+    {
+        _threads.emplace_back(new ThreadQueues());
+        found = _thread_indices.insert(std::make_pair(id, _threads.back().get())).first;
+    }
+
+    s_cached_uid = _uid;
+    s_cached_queues = found->second;
+    return *s_cached_queues;
+}
+
+Handle EventSystem::add_delegate(std::vector<Mailbox>& table, bool batch, index_t index, void* object, stub_t stub)
+{
+    if( table.size() <= index )
+        table.resize(index+1);
+
+    auto& mailbox = table[index];
+    auto found = mailbox.subscribed.find(object);
+    if( found != mailbox.subscribed.end() )
+        return found->second;
+
+    auto handle = _handles.create();
+    if( !handle.is_valid() )
+        return handle;
+
+    if( _slots.size() <= handle.get_index() )
+        _slots.resize(handle.get_index()+1);
+
+    Slot slot;
+    slot.batch = batch;
+    slot.type = index;
+    slot.position = mailbox.delegates.size();
+    _slots[handle.get_index()] = slot;
+
+    Delegate delegate;
+    delegate.object = object;
+    delegate.stub = stub;
+    delegate.handle = handle;
+    mailbox.delegates.push_back(delegate);
+    mailbox.subscribed.insert(std::make_pair(object, handle));
+    return handle;
+}
+
+void EventSystem::remove_delegate(std::vector<Mailbox>& table, index_t index, void* object)
+{
+    if( table.size() <= index )
+        return;
+
+    auto& subscribed = table[index].subscribed;
+    auto found = subscribed.find(object);
+    if( found != subscribed.end() )
+        unsubscribe(found->second);
+}
+
+bool EventSystem::unsubscribe(Handle handle)
+{
+    if( !_handles.free(handle) )
+        return false;
+
+    const auto& slot = _slots[handle.get_index()];
+    auto& mailbox = slot.batch ? _batch_table[slot.type] : _table[slot.type];
+    mailbox.subscribed.erase(mailbox.delegates[slot.position].object);
+    mailbox.delegates[slot.position].object = nullptr;
+    mailbox.tombstones ++;
+
+    // compacts once half of the delegates are dead, which keeps unsubscribe
+    // amortized constant. its deferred to the end of delivering if any.
+    if( mailbox.delivering == 0 && mailbox.tombstones * 2 > mailbox.delegates.size() )
+        compact(mailbox);
+
+    return true;
+}
+
+void EventSystem::deliver(std::vector<Mailbox>& table, index_t index, const void* data, size_t size)
+{
+    // receivers are free to subscribe or unsubscribe while delivering, so the mailbox
+    // is re-fetched from table every time. receivers subscribed during this call will
+    // not be notified until next time.
+    const auto count = table[index].delegates.size();
+    table[index].delivering ++;
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        const auto delegate = table[index].delegates[i];
+        if( delegate.object != nullptr )
+            delegate.stub(delegate.object, data, size);
+    }
+
+    auto& mailbox = table[index];
+    if( --mailbox.delivering == 0 && mailbox.tombstones > 0 )
+        compact(mailbox);
+}
+
+void EventSystem::compact(Mailbox& mailbox)
+{
+    size_t position = 0;
+    for( size_t i = 0; i < mailbox.delegates.size(); i++ )
+    {
+        const auto delegate = mailbox.delegates[i];
+        if( delegate.object == nullptr )
+            continue;
+
+        _slots[delegate.handle.get_index()].position = position;
+        mailbox.delegates[position++] = delegate;
+    }
+
+    mailbox.delegates.resize(position);
+    mailbox.tombstones = 0;
+}
+
+void EventSystem::dispatch()
+{
+    // the thread list might grows while dispatching, take a short lock per access
+    // instead of holding it, receivers are free to queue events.
+    auto fetch_thread = [=](size_t index) -> ThreadQueues*
+    {
+        std::unique_lock<std::mutex> L(_thread_mutex);
+        return index < _threads.size() ? _threads[index].get() : nullptr;
+    };
+
+    size_t types = 0;
+    for( size_t i = 0; auto thread = fetch_thread(i); i++ )
+    {
+        std::unique_lock<SpinMutex> L(thread->mutex);
+        types = std::max(types, thread->queues.size());
+    }
+
+    // queues without receivers are drained as well
+    if( _batch_table.size() < types )
+        _batch_table.resize(types);
+
+    for( size_t index = 0; index < types; index++ )
+    {
+        for( size_t i = 0; auto thread = fetch_thread(i); i++ )
+        {
+            QueueBase* queue = nullptr;
+            {
+                std::unique_lock<SpinMutex> L(thread->mutex);
+                if( index < thread->queues.size() )
+                    queue = thread->queues[index].get();
+            }
+
+            if( queue != nullptr )
+                queue->flush(*this, index);
+        }
+    }
+}
+
+NS_LEMON_CORE_END
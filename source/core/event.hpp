@@ -5,67 +5,270 @@
 
 #include <forwards.hpp>
 #include <core/subsystem.hpp>
+#include <codebase/spin.hpp>
+#include <codebase/handle_set.hpp>
 
 #include <vector>
-#include <functional>
 #include <unordered_map>
+#include <mutex>
+#include <thread>
 
 NS_LEMON_CORE_BEGIN
 
+// a contiguous range of queued events with the same type, its only valid
+// during the receive call of batch receivers.
+template<typename E> struct EventSpan
+{
+    EventSpan(const E* data, size_t size) : _data(data), _size(size) {}
+
+    const E* begin() const { return _data; }
+    const E* end() const { return _data + _size; }
+    const E& operator[] (size_t index) const { return _data[index]; }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+protected:
+    const E* _data;
+    size_t _size;
+};
+
+//
+// Besides the immediate emit/receive, events could be queued from any thread during
+// the frame. queued events are appended to typed buffers owned by the producing thread,
+// so producers never contend with each other. they are delivered in bulk at defined sync
+// points (dispatch), batch receivers get a span of events with one type per call instead
+// of one call per event.
+//
+
 struct Event {};
 struct EventSystem : public core::Subsystem
 {
-    template<typename E, typename R> void subscribe(R* receiver)
+    EventSystem();
+
+    // subscribe a receiver, which would be notified with receive(const E&). returns a
+    // handle that could be used to unsubscribe in constant time. subscribing the same
+    // receiver twice returns the handle of the existing subscription.
+    template<typename E, typename R> Handle subscribe(R* receiver);
+    template<typename E, typename R> Handle subscribe(R& receiver);
+
+    template<typename E, typename R> void unsubscribe(R* receiver);
+    template<typename E, typename R> void unsubscribe(R& receiver);
+
+    // emit an event to receivers immediately, in the order of subscription
+    template<typename E, typename ... Args> void emit(Args && ... args);
+
+    // subscribe a batch receiver, which would be notified with receive(EventSpan<E>)
+    template<typename E, typename R> Handle subscribe_batch(R* receiver);
+    template<typename E, typename R> Handle subscribe_batch(R& receiver);
+
+    template<typename E, typename R> void unsubscribe_batch(R* receiver);
+    template<typename E, typename R> void unsubscribe_batch(R& receiver);
+
+    // unsubscribe with the handle returned from subscribe/subscribe_batch
+    bool unsubscribe(Handle);
+
+    // queue an event for the next dispatch, its safe to be called from any thread
+    template<typename E, typename ... Args> void queue(Args && ... args);
+
+    // deliver all the queued events to batch receivers, grouped by type. this is a
+    // sync point and should be called from main thread only. events queued while
+    // dispatching will be delivered at next dispatch.
+    void dispatch();
+
+protected:
+    using index_t = TypeInfoGeneric::index_t;
+
+    // instead of a std::function, a delegate is the receiver pointer plus a stub
+    // function instantiated for (E, R) which forwards to R::receive. its trivially
+    // copyable and requires no heap allocation.
+    using stub_t = void(*)(void*, const void*, size_t);
+    struct Delegate
     {
-        subscribe<E, R>(*receiver);
-    }
+        void* object;
+        stub_t stub;
+        Handle handle;
+    };
 
-    template<typename E, typename R> void subscribe(R& receiver)
+    // receivers of one event type, stored contiguously in the order of subscription.
+    // unsubscribed delegates are left as tombstones and compacted lazily, so the
+    // positions are stable while delivering. the subscribed receivers are hashed
+    // aside, so duplicated subscriptions are detected in constant time.
+    struct Mailbox
     {
-        const auto index = TypeInfoGeneric::id<Event, E>();
-        if( _table.size() <= index )
-            _table.resize(index+1);
+        std::vector<Delegate> delegates;
+        std::unordered_map<void*, Handle> subscribed;
+        size_t tombstones = 0;
+        size_t delivering = 0;
+    };
 
-        const auto id = (size_t)(&receiver);
-        _table[index].insert(std::make_pair(id, [&](const void* event)
-        {
-            receiver.receive(*static_cast<const E*>(event));
-        }));
-    }
+    // location of a subscription, indexed by handle
+    struct Slot
+    {
+        bool batch;
+        index_t type;
+        size_t position;
+    };
 
-    template<typename E, typename R> void unsubscribe(R* receiver)
+    template<typename E, typename R> static void invoke(void*, const void*, size_t);
+    template<typename E, typename R> static void invoke_batch(void*, const void*, size_t);
+
+    Handle add_delegate(std::vector<Mailbox>&, bool, index_t, void*, stub_t);
+    void remove_delegate(std::vector<Mailbox>&, index_t, void*);
+    void deliver(std::vector<Mailbox>&, index_t, const void*, size_t);
+    void compact(Mailbox&);
+
+    DynamicHandleSet _handles;
+    std::vector<Slot> _slots;
+    std::vector<Mailbox> _table;
+    std::vector<Mailbox> _batch_table;
+
+protected:
+    struct QueueBase
     {
-        unsubscribe<E, R>(*receiver);
-    }
+        virtual ~QueueBase() {}
+        // deliver the events queued before this call to batch receivers
+        virtual void flush(EventSystem&, index_t) = 0;
+    };
 
-    template<typename E, typename R> void unsubscribe(R& receiver)
+    // events of type E queued by one thread. the producer appends to _pending, and the
+    // dispatcher swaps it out with a spin lock held for a few instructions only.
+    template<typename E> struct Queue : public QueueBase
     {
-        const auto index = TypeInfoGeneric::id<Event, E>();
-        if( _table.size() <= index )
-            return;
+        template<typename ... Args> void push(Args&& ... args)
+        {
+            std::unique_lock<SpinMutex> L(_mutex);
+            _pending.emplace_back(std::forward<Args>(args)...);
+        }
+
+        void flush(EventSystem& system, index_t index) override
+        {
+            {
+                std::unique_lock<SpinMutex> L(_mutex);
+                _pending.swap(_dispatching);
+            }
+
+            if( _dispatching.empty() )
+                return;
 
-        const auto id = (size_t)(&receiver);
-        auto found = _table[index].find(id);
-        if( found != _table[index].end() )
-            _table[index].erase(found);
-    }
+            system.deliver(system._batch_table, index, _dispatching.data(), _dispatching.size());
 
-    template<typename E, typename ... Args> void emit(Args && ... args)
+            // keeps the capacity, so steady-state frames would not allocate
+            _dispatching.clear();
+        }
+
+    protected:
+        SpinMutex _mutex;
+        std::vector<E> _pending;
+        std::vector<E> _dispatching;
+    };
+
+    // typed queues of a producer thread, indexed by event type
+    struct ThreadQueues
     {
-        E event(std::forward<Args>(args)...);
+        SpinMutex mutex;
+        std::vector<std::unique_ptr<QueueBase>> queues;
+    };
 
-        auto index = TypeInfoGeneric::id<Event, E>();
-        if( _table.size() <= index )
-            return;
+    ThreadQueues& get_thread_queues();
+    // returns the queue of calling thread, nullptr if its failed to allocate
+    template<typename E> Queue<E>* get_queue(index_t);
 
-        for( auto& pair : _table[index] )
-            pair.second(static_cast<const void*>(&event));
-    }
-    
-protected:
-    using closure = std::function<void(const void*)>;
-    using mailbox = std::unordered_map<TypeInfoGeneric::index_t, closure>;
-    std::vector<mailbox> _table;
+    const uint32_t _uid;
+    std::mutex _thread_mutex;
+    std::vector<std::unique_ptr<ThreadQueues>> _threads;
+    std::unordered_map<std::thread::id, ThreadQueues*> _thread_indices;
 };
 
-NS_LEMON_CORE_END
\ No newline at end of file
+//
+// IMPLEMENTATIONS of EVENT SYSTEM
+template<typename E, typename R> void EventSystem::invoke(void* object, const void* event, size_t)
+{
+    static_cast<R*>(object)->receive(*static_cast<const E*>(event));
+}
+
+template<typename E, typename R> void EventSystem::invoke_batch(void* object, const void* events, size_t size)
+{
+    static_cast<R*>(object)->receive(EventSpan<E>(static_cast<const E*>(events), size));
+}
+
+template<typename E, typename R> Handle EventSystem::subscribe(R* receiver)
+{
+    return subscribe<E, R>(*receiver);
+}
+
+template<typename E, typename R> Handle EventSystem::subscribe(R& receiver)
+{
+    const auto index = TypeInfoGeneric::id<Event, E>();
+    return add_delegate(_table, false, index, &receiver, &invoke<E, R>);
+}
+
+template<typename E, typename R> void EventSystem::unsubscribe(R* receiver)
+{
+    unsubscribe<E, R>(*receiver);
+}
+
+template<typename E, typename R> void EventSystem::unsubscribe(R& receiver)
+{
+    const auto index = TypeInfoGeneric::id<Event, E>();
+    remove_delegate(_table, index, &receiver);
+}
+
+template<typename E, typename ... Args> void EventSystem::emit(Args && ... args)
+{
+    E event(std::forward<Args>(args)...);
+
+    const auto index = TypeInfoGeneric::id<Event, E>();
+    if( _table.size() <= index )
+        return;
+
+    deliver(_table, index, &event, 1);
+}
+
+template<typename E, typename R> Handle EventSystem::subscribe_batch(R* receiver)
+{
+    return subscribe_batch<E, R>(*receiver);
+}
+
+template<typename E, typename R> Handle EventSystem::subscribe_batch(R& receiver)
+{
+    const auto index = TypeInfoGeneric::id<Event, E>();
+    return add_delegate(_batch_table, true, index, &receiver, &invoke_batch<E, R>);
+}
+
+template<typename E, typename R> void EventSystem::unsubscribe_batch(R* receiver)
+{
+    unsubscribe_batch<E, R>(*receiver);
+}
+
+template<typename E, typename R> void EventSystem::unsubscribe_batch(R& receiver)
+{
+    const auto index = TypeInfoGeneric::id<Event, E>();
+    remove_delegate(_batch_table, index, &receiver);
+}
+
+template<typename E, typename ... Args> void EventSystem::queue(Args && ... args)
+{
+    const auto index = TypeInfoGeneric::id<Event, E>();
+    if( auto queue = get_queue<E>(index) )
+        queue->push(std::forward<Args>(args)...);
+    else
+        LOGW("failed to allocate event queue, the event is dropped.");
+}
+
+template<typename E> EventSystem::Queue<E>* EventSystem::get_queue(index_t index)
+{
+    auto& thread = get_thread_queues();
+
+    // only the owner thread grows its queue table, the lock here guards against
+    // a concurrent dispatch iterating it.
+    std::unique_lock<SpinMutex> L(thread.mutex);
+    if( thread.queues.size() <= index )
+        thread.queues.resize(index+1);
+
+    if( !thread.queues[index] )
+        thread.queues[index].reset(new (std::nothrow) Queue<E>());
+
+    return static_cast<Queue<E>*>(thread.queues[index].get());
+}
+
+NS_LEMON_CORE_END
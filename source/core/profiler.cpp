@@ -0,0 +1,209 @@
+// @date 2016/11/07
+// @author Mao Jingkai(oammix@gmail.com)
+
+#include <core/profiler.hpp>
+#include <core/task.hpp>
+
+#include <cstring>
+#include <fstream>
+
+NS_LEMON_CORE_BEGIN
+
+// the rings are cached per thread, and validated with the session of profiler
+static std::atomic<uint32_t> s_sessions { 0 };
+static thread_local uint32_t s_thread_session = 0;
+static thread_local ProfileRing* s_thread_ring = nullptr;
+
+// threads not managed by TaskSystem are identified after the workers
+static const unsigned kAnonymousThreadBase = 1024;
+
+ProfileRing::ProfileRing(unsigned tid, size_t capacity)
+: _tid(tid), _zones(new ProfileZone[capacity]), _capacity(capacity)
+{
+    _head.store(0);
+}
+
+void ProfileRing::record(const char* name, uint64_t start, uint64_t stop, uint32_t depth)
+{
+    auto head = _head.load(std::memory_order_relaxed);
+    auto& zone = _zones[head % _capacity];
+    zone.start = start;
+    zone.duration = stop - start;
+    zone.depth = depth;
+
+    auto len = std::min(strlen(name), sizeof(zone.name) - 1);
+    memcpy(zone.name, name, len);
+    zone.name[len] = 0;
+
+    // publish the zone after its written
+    _head.store(head + 1, std::memory_order_release);
+}
+
+void ProfileRing::collect(std::vector<ProfileZone>& out) const
+{
+    auto head = _head.load(std::memory_order_acquire);
+    auto first = head > _capacity ? head - _capacity : 0;
+
+    auto offset = out.size();
+    for( auto i = first; i < head; i++ )
+        out.push_back(_zones[i % _capacity]);
+
+    // zones overwritten by the owner during copying are discarded
+    auto after = _head.load(std::memory_order_acquire);
+    if( after > _capacity && after - _capacity > first )
+    {
+        auto overwritten = std::min(after - _capacity - first, head - first);
+        out.erase(out.begin() + offset, out.begin() + offset + overwritten);
+    }
+}
+
+bool Profiler::initialize()
+{
+    _session = ++s_sessions;
+    _launch = clock::now();
+
+    if( auto task = get_subsystem<TaskSystem>() )
+    {
+        task->on_task_start = [=](unsigned index, const char*) { on_task_start(index); };
+        task->on_task_stop = [=](unsigned index, const char* name) { on_task_stop(index, name); };
+    }
+
+    return true;
+}
+
+void Profiler::dispose()
+{
+    if( auto task = get_subsystem<TaskSystem>() )
+    {
+        task->on_task_start = nullptr;
+        task->on_task_stop = nullptr;
+    }
+
+    if( !_output.empty() )
+    {
+        std::ofstream file(_output);
+        if( !file.is_open() || !save(file) )
+            LOGW("failed to write profiler trace to %s.", _output.c_str());
+    }
+
+    // invalidates the rings cached by threads
+    ++s_sessions;
+}
+
+ProfileRing* Profiler::get_thread_ring()
+{
+    if( !_enabled.load(std::memory_order_relaxed) )
+        return nullptr;
+
+    if( s_thread_session == _session )
+        return s_thread_ring;
+
+    s_thread_ring = register_thread();
+    s_thread_session = _session;
+    return s_thread_ring;
+}
+
+ProfileRing* Profiler::register_thread()
+{
+    unsigned tid = 0xFFFFFFFF;
+    if( auto task = get_subsystem<TaskSystem>() )
+        tid = task->get_thread_index();
+
+    std::unique_lock<std::mutex> L(_mutex);
+    if( tid == 0xFFFFFFFF )
+        tid = kAnonymousThreadBase + (_anonymous++);
+
+    auto ring = new (std::nothrow) ProfileRing(tid, _capacity);
+    if( ring != nullptr )
+        _rings.emplace_back(ring);
+    return ring;
+}
+
+void Profiler::on_task_start(unsigned)
+{
+    if( auto ring = get_thread_ring() )
+        ring->begin(get_timestamp());
+}
+
+void Profiler::on_task_stop(unsigned, const char* name)
+{
+    if( auto ring = get_thread_ring() )
+        ring->end(name, get_timestamp());
+}
+
+void Profiler::collect(std::vector<std::pair<unsigned, ProfileZone>>& out) const
+{
+    std::vector<ProfileZone> zones;
+
+    std::unique_lock<std::mutex> L(_mutex);
+    for( auto& ring : _rings )
+    {
+        zones.clear();
+        ring->collect(zones);
+        for( auto& zone : zones )
+            out.push_back(std::make_pair(ring->get_tid(), zone));
+    }
+}
+
+static void write_escaped(std::ostream& stream, const char* str)
+{
+    stream << '"';
+    for( ; *str != 0; str++ )
+    {
+        if( *str == '"' || *str == '\\' )
+            stream << '\\' << *str;
+        else if( (unsigned char)*str < 0x20 )
+            stream << ' ';
+        else
+            stream << *str;
+    }
+    stream << '"';
+}
+
+bool Profiler::save(std::ostream& stream) const
+{
+    std::vector<std::pair<unsigned, ProfileZone>> zones;
+    collect(zones);
+
+    std::vector<unsigned> threads;
+    {
+        std::unique_lock<std::mutex> L(_mutex);
+        for( auto& ring : _rings )
+            threads.push_back(ring->get_tid());
+    }
+
+    stream << "{\"traceEvents\":[";
+
+    bool first = true;
+    for( auto tid : threads )
+    {
+        if( !first ) stream << ",";
+        first = false;
+
+        stream << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << tid << ",\"args\":{\"name\":\"";
+        if( tid == 0 ) stream << "main";
+        else if( tid < kAnonymousThreadBase ) stream << "worker " << tid;
+        else stream << "thread " << (tid - kAnonymousThreadBase);
+        stream << "\"}}";
+    }
+
+    // timestamps of chrome trace are in microseconds
+    char buf[64];
+    for( auto& pair : zones )
+    {
+        if( !first ) stream << ",";
+        first = false;
+
+        stream << "\n{\"name\":";
+        write_escaped(stream, pair.second.name);
+        snprintf(buf, sizeof(buf), "%.3f", pair.second.start / 1000.0);
+        stream << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << pair.first << ",\"ts\":" << buf;
+        snprintf(buf, sizeof(buf), "%.3f", pair.second.duration / 1000.0);
+        stream << ",\"dur\":" << buf << "}";
+    }
+
+    stream << "\n]}\n";
+    return !stream.fail();
+}
+
+NS_LEMON_CORE_END
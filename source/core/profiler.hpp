@@ -0,0 +1,158 @@
+// @date 2016/11/07
+// @author Mao Jingkai(oammix@gmail.com)
+
+#pragma once
+
+#include <core/core.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+NS_LEMON_CORE_BEGIN
+
+// a completed zone with timestamps in nanoseconds since the profiler initialized
+struct ProfileZone
+{
+    uint64_t start;
+    uint64_t duration;
+    uint32_t depth;
+    char name[44];
+};
+
+// the ring buffer of zones recorded by one thread. zones are only written by the owner
+// thread, and the oldest ones are overwritten once its full. readers copy zones out
+// without locking, and discard the ones might be overwritten during copying.
+struct ProfileRing
+{
+    const static unsigned kMaxDepth = 32;
+
+    ProfileRing(unsigned tid, size_t capacity);
+
+    // begins a nested zone at timestamp
+    void begin(uint64_t timestamp);
+    // ends the innermost zone began on this thread
+    void end(const char* name, uint64_t timestamp);
+    // records a completed zone
+    void record(const char* name, uint64_t start, uint64_t stop, uint32_t depth);
+    // copies the zones recorded currently
+    void collect(std::vector<ProfileZone>&) const;
+
+    unsigned get_tid() const { return _tid; }
+    uint32_t get_depth() const { return _depth; }
+
+protected:
+    unsigned _tid;
+    std::unique_ptr<ProfileZone[]> _zones;
+    size_t _capacity;
+    std::atomic<uint64_t> _head;
+
+    // the nested zones not ended yet
+    uint64_t _stack[kMaxDepth];
+    uint32_t _depth = 0;
+};
+
+// a sampling-free profiler records scoped zones of tasks and PROFILE_SCOPE markers into
+// lock-free rings of each thread, and exports them as Chrome trace JSON which could be
+// viewed in chrome://tracing.
+struct Profiler : public Subsystem
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    Profiler(size_t capacity = 16384) : _capacity(capacity) {}
+
+    // hooks into the callbacks of TaskSystem if its available
+    bool initialize() override;
+    // unhooks from TaskSystem, and writes the trace if an output path is specified
+    void dispose() override;
+
+    // enable or disable recording zones, its enabled by default
+    void set_enabled(bool enabled) { _enabled.store(enabled); }
+    bool is_enabled() const { return _enabled.load(); }
+    // specifies the path which trace will be written to when disposed
+    void set_output(const std::string& path) { _output = path; }
+
+    // returns nanoseconds since the profiler initialized
+    uint64_t get_timestamp() const;
+    // returns the ring of calling thread, nullptr if recording is disabled
+    ProfileRing* get_thread_ring();
+
+    // copies the zones of all threads, returns with tid of each zone
+    void collect(std::vector<std::pair<unsigned, ProfileZone>>&) const;
+    // writes all the zones as Chrome trace JSON
+    bool save(std::ostream&) const;
+
+protected:
+    ProfileRing* register_thread();
+    void on_task_start(unsigned);
+    void on_task_stop(unsigned, const char*);
+
+    size_t _capacity;
+    std::atomic<bool> _enabled { true };
+    uint32_t _session = 0;
+    clock::time_point _launch;
+    std::string _output;
+
+    mutable std::mutex _mutex;
+    std::vector<std::unique_ptr<ProfileRing>> _rings;
+    unsigned _anonymous = 0;
+};
+
+// a zone lasts until the end of scope
+struct ProfileScope
+{
+    ProfileScope(const char* name);
+    ~ProfileScope();
+
+protected:
+    const char* _name;
+    Profiler* _profiler;
+    ProfileRing* _ring;
+};
+
+#define PROFILE_CONCAT_INTERNAL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INTERNAL(a, b)
+#define PROFILE_SCOPE(name) lemon::core::ProfileScope PROFILE_CONCAT(__profile_scope_, __LINE__)(name)
+
+//
+// IMPLEMENTATIONS of PROFILER
+INLINE void ProfileRing::begin(uint64_t timestamp)
+{
+    if( _depth < kMaxDepth )
+        _stack[_depth] = timestamp;
+    _depth ++;
+}
+
+INLINE void ProfileRing::end(const char* name, uint64_t timestamp)
+{
+    if( _depth == 0 )
+        return;
+
+    _depth --;
+    if( _depth < kMaxDepth )
+        record(name, _stack[_depth], timestamp, _depth);
+}
+
+INLINE uint64_t Profiler::get_timestamp() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - _launch).count();
+}
+
+INLINE ProfileScope::ProfileScope(const char* name) : _name(name), _ring(nullptr)
+{
+    _profiler = get_subsystem<Profiler>();
+    if( _profiler != nullptr && (_ring = _profiler->get_thread_ring()) != nullptr )
+        _ring->begin(_profiler->get_timestamp());
+}
+
+INLINE ProfileScope::~ProfileScope()
+{
+    if( _ring != nullptr )
+        _ring->end(_name, _profiler->get_timestamp());
+}
+
+NS_LEMON_CORE_END
@@ -6,6 +6,7 @@
 #include <forwards.hpp>
 #include <codebase/type_traits.hpp>
 
+#include <algorithm>
 #include <vector>
 #include <unordered_map>
 
@@ -83,7 +84,7 @@ template<typename S> void SubsystemContext::remove_subsystem()
     {
         found->second->dispose();
         delete found->second;
-        _orders.erase(index);
+        _orders.erase(std::find(_orders.begin(), _orders.end(), index));
         _subsystems.erase(found);
     }   
 }
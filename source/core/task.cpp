@@ -152,10 +152,11 @@ bool TaskSystem::execute_one(unsigned index, bool wait)
         if( task->closure != nullptr )
             task->closure();
 
-        finish(handle);
-
+        // stopped before finishing, since the task might be recycled once its finished
         if( on_task_stop )
             on_task_stop(index, task->name);
+
+        finish(handle);
     }
 
     return true;
@@ -62,6 +62,10 @@ struct TaskSystem : public Subsystem
     // returns main thread id
     std::thread::id get_main_thread() const { return _thread_main; }
 
+    // returns index of calling thread, 0 for the main thread and 0xFFFFFFFF for the
+    // threads not managed by this scheduler
+    unsigned get_thread_index() const;
+
 protected:
     struct Task
     {
@@ -103,7 +107,6 @@ protected:
 
     void finish(Handle);
     bool execute_one(unsigned, bool);
-    unsigned get_thread_index() const;
 
 protected:
     unsigned _core;
@@ -9,15 +9,20 @@
 #include <graphics/backend/backend.hpp>
 #include <resource/resource.hpp>
 #include <resource/archives.hpp>
+#include <resource/shader.hpp>
 #include <resource/filesystem.hpp>
 #include <core/event.hpp>
 #include <core/ecs.hpp>
 #include <core/task.hpp>
+#include <core/profiler.hpp>
+#include <codebase/frame_allocator.hpp>
 
 #include <scene/scene.hpp>
 
 #include <SDL2/SDL.h>
 
+#include <fstream>
+
 NS_LEMON_BEGIN
 
 bool Engine::initialize()
@@ -32,6 +37,7 @@ bool Engine::initialize()
     core::add_subsystem<core::EventSystem>();
     core::add_subsystem<core::EntityComponentSystem>();
     core::add_subsystem<core::TaskSystem>();
+    core::add_subsystem<core::Profiler>();
     core::add_subsystem<graphics::WindowDevice>();
     core::add_subsystem<res::ArchiveCollection>();
     core::add_subsystem<res::ResourceCache>();
@@ -47,6 +53,15 @@ bool Engine::initialize()
     auto height = arguments->fetch("/Graphics/WindowSize/1", 128).GetInt();
     auto multisamples = arguments->fetch("/Graphics/Multisamples", 1).GetInt();
 
+    // zones are recorded only if profiler enabled, and written as trace when exiting
+    auto profiler = core::get_subsystem<core::Profiler>();
+    profiler->set_enabled(arguments->fetch("/Engine/Profiler", false).GetBool());
+    if( auto output = arguments->fetch("/Engine/ProfilerOutput") )
+        profiler->set_output((arguments->get_path() / output->GetString()).to_string());
+
+    auto budget = arguments->fetch("/Graphics/UploadBudgetInMB", 4).GetInt();
+    core::get_subsystem<graphics::RenderFrontend>()->set_upload_budget(budget * 1024 * 1024);
+
     auto device = core::get_subsystem<graphics::WindowDevice>();
     if( !device->open(width, height, multisamples, graphics::WindowOption::RESIZABLE) )
         return false;
@@ -63,6 +78,19 @@ bool Engine::initialize()
                 return false;
     }
 
+    // files in search paths take precedence over packages
+    if( auto packages = arguments->fetch("/Resource/Packages") )
+    {
+        auto collection = core::get_subsystem<res::ArchiveCollection>();
+        for( auto& path : packages->GetArray() )
+            if( !collection->add_package(arguments->get_path() / path.GetString()) )
+                return false;
+    }
+
+    // reflected uniforms and program binaries are cached across launches
+    if( auto path = arguments->fetch("/Resource/ShaderCache") )
+        core::add_subsystem<res::ShaderCache>(arguments->get_path() / path->GetString());
+
     // initialize resource 
     auto cache = core::get_subsystem<res::ResourceCache>();
     auto memory_threshold = arguments->fetch("/Resource/CacheMemoryThresholdInMB", 64).GetInt();
@@ -82,6 +110,16 @@ bool Engine::initialize()
     _max_fps = arguments->fetch("/Engine/MaxFPS", 0).GetInt();
     _smoothing_step = arguments->fetch("/Engine/TimeSmoothingStep", 0).GetInt();
 
+    auto fixed_fps = arguments->fetch("/Engine/FixedUpdateFPS", 0).GetInt();
+    if( fixed_fps > 0 )
+        set_fixed_timestep(std::chrono::duration_cast<duration>(std::chrono::seconds(1)) / fixed_fps);
+    set_max_catch_up_steps(arguments->fetch("/Engine/MaxCatchUpSteps", 5).GetInt());
+    set_spin_threshold(std::chrono::milliseconds(arguments->fetch("/Engine/SpinThresholdInMS", 2).GetInt()));
+
+    _statistics.set_window(arguments->fetch("/Engine/StatisticsWindow", 600).GetInt());
+    if( auto output = arguments->fetch("/Engine/StatisticsOutput") )
+        _statistics_output = (arguments->get_path() / output->GetString()).to_string();
+
     if( _max_inactive_fps == 0 )
         _max_inactive_fps = std::max(_max_inactive_fps, _max_fps);
 
@@ -90,12 +128,21 @@ bool Engine::initialize()
 
 void Engine::dispose()
 {
+    if( !_statistics_output.empty() )
+    {
+        std::ofstream file(_statistics_output);
+        if( !file.is_open() || !_statistics.save(file) )
+            LOGW("failed to write frame statistics to %s.", _statistics_output.c_str());
+    }
+
     // shutdown SDL now
     SDL_Quit();
 }
 
 void Engine::run_one_frame()
 {
+    PROFILE_SCOPE("engine.frame");
+
     auto device = core::get_subsystem<graphics::WindowDevice>();
     auto input = core::get_subsystem<Input>();
 
@@ -116,24 +163,21 @@ void Engine::run_one_frame()
     if( !(device->get_window_flags() & SDL_WINDOW_INPUT_FOCUS) && max_fps > 0 )
         max_fps = std::min(_max_inactive_fps, max_fps);
 
+    auto sleep_start = clock::now();
     if( max_fps > 0 )
     {
         duration target_duration = std::chrono::milliseconds(1000) / max_fps;
-        duration eplased = clock::now() - _last_frame_timepoint;
-        for( ;; )
-        {
-            eplased = clock::now() - _last_frame_timepoint;
-            if( eplased > target_duration )
-                break;
-
-            if( target_duration - eplased > duration(1) )
-                std::this_thread::sleep_for((target_duration - eplased)-duration(1));
-        }
+        wait_until(_last_frame_timepoint + target_duration, _spin_threshold);
     }
 
+    _statistics.record(FramePhase::SLEEP, clock::now() - sleep_start);
+
     duration eplased = clock::now() - _last_frame_timepoint;
     _last_frame_timepoint = clock::now();
 
+    _statistics.record(FramePhase::FRAME, eplased);
+    _statistics.end_frame();
+
     // if fps lower than minimum, clamp eplased time
     if( _min_fps > 0 )
     {
@@ -169,16 +213,65 @@ void Engine::update(duration dt)
     auto renderer = core::get_subsystem<graphics::RenderFrontend>();
     auto event = core::get_subsystem<core::EventSystem>();
 
-    event->emit<EvtUpdate>(dt);
-    event->emit<EvtPostUpdate>(dt);
+    auto start = clock::now();
+    {
+        PROFILE_SCOPE("engine.update");
 
+        // changes of watched search paths are visible since this frame
+        core::get_subsystem<res::ArchiveCollection>()->update();
+
+        if( _fixed_timestep.is_enabled() )
+        {
+            // simulates in fixed steps, which might be none or several in one frame
+            auto step = _fixed_timestep.get_step();
+            auto steps = _fixed_timestep.advance(dt);
+            for( unsigned i = 0; i < steps; i++ )
+            {
+                event->emit<EvtUpdate>(step);
+                event->emit<EvtPostUpdate>(step);
+            }
+        }
+        else
+        {
+            event->emit<EvtUpdate>(dt);
+            event->emit<EvtPostUpdate>(dt);
+        }
+
+        // sync point of events queued during update
+        event->dispatch();
+    }
+
+    _statistics.record(FramePhase::UPDATE, clock::now() - start);
+
+    // extracts draw calls of this frame while the previous one might be still drawing,
+    // the only sync point with render thread is the flush in end_frame
+    start = clock::now();
     if( renderer->begin_frame() )
     {
-        event->emit<EvtRenderUpdate>(dt);
+        PROFILE_SCOPE("engine.render");
+
+        // finish asynchronous fetchings of resources on the render side
+        core::get_subsystem<res::ResourceCache>()->update_video_objects();
+
+        event->emit<EvtRenderUpdate>(dt, _fixed_timestep.get_alpha());
         event->emit<EvtRender>();
         event->emit<EvtPostRenderUpdate>(dt);
         renderer->end_frame();
+
+        // transient memory of the frame before previous one is recycled, since the
+        // previous frame has been drawn when flushed
+        FrameAllocator::advance();
+
+        // the draw of previous frame has been completed when flushed, and rendering
+        // excludes the time waiting for it
+        auto wait = renderer->get_wait_duration();
+        _statistics.record(FramePhase::RENDER, clock::now() - start - wait);
+        _statistics.record(FramePhase::WAIT, wait);
+        _statistics.record(FramePhase::DRAW, renderer->get_draw_duration());
     }
+
+    // sync point of events queued during rendering
+    event->dispatch();
 }
 
 void Engine::process_message()
@@ -225,6 +318,21 @@ void Engine::set_pause_minimized(bool enable)
     _pause_minimized = enable;
 }
 
+void Engine::set_fixed_timestep(duration step)
+{
+    _fixed_timestep.set_step(step);
+}
+
+void Engine::set_max_catch_up_steps(unsigned steps)
+{
+    _fixed_timestep.set_max_steps(steps);
+}
+
+void Engine::set_spin_threshold(duration threshold)
+{
+    _spin_threshold = threshold;
+}
+
 Engine::duration Engine::get_time_since_launch() const
 {
     return clock::now() - _launch_timepoint;
@@ -232,8 +340,8 @@ Engine::duration Engine::get_time_since_launch() const
 
 unsigned Engine::get_fps() const
 {
-    auto t = _timestep / std::chrono::milliseconds(1);
-    return t == 0 ? 0 : 1000 / t;
+    auto t = std::chrono::duration<double>(_timestep).count();
+    return t <= 0.0 ? 0 : (unsigned)(1.0 / t + 0.5);
 }
 
 NS_LEMON_END
@@ -4,6 +4,8 @@
 #pragma once
 
 #include <core/core.hpp>
+#include <engine/statistics.hpp>
+#include <engine/timestep.hpp>
 
 #include <chrono>
 #include <vector>
@@ -37,12 +39,24 @@ struct Engine : public core::Subsystem
     void set_time_smoothing_step(unsigned);
     // set whether to pause update when minimized
     void set_pause_minimized(bool);
+    // set the fixed step of update, zero to update once per frame with variable timestep
+    void set_fixed_timestep(duration);
+    // set maximum fixed steps updated in one frame, the time exceeding it is dropped
+    void set_max_catch_up_steps(unsigned);
+    // set the remaining time the frame limiter yields instead of sleeping, for the coarse
+    // granularity of sleeping
+    void set_spin_threshold(duration);
+    // returns the fraction of fixed step remained for render interpolation, 1 if disabled
+    float get_interpolation_alpha() const { return _fixed_timestep.get_alpha(); }
     // returns if engine is exiting
     bool is_running() const { return _running; }
     // returns duration since lemon-toolkit launched
     duration get_time_since_launch() const;
     // returns frames per second
     unsigned get_fps() const;
+    // returns the durations of recent frames split by phases
+    const FrameStatistics& get_statistics() const { return _statistics; }
+    FrameStatistics& get_statistics() { return _statistics; }
 
 protected:
     // minimum/maximum frames per second
@@ -55,12 +69,19 @@ protected:
     unsigned _smoothing_step;
     // pause when minimized
     bool _pause_minimized;
+    // accumulator of fixed-step updates
+    FixedTimestep _fixed_timestep;
+    // threshold of frame limiter to yield instead of sleeping
+    duration _spin_threshold = std::chrono::milliseconds(2);
     // frame update timer
     timepoint _last_frame_timepoint;
     // timepoint when we launched
     timepoint _launch_timepoint;
     // exiting flag
     bool _running;
+    // durations of recent frames, which are written to the path when exiting if specified
+    FrameStatistics _statistics;
+    std::string _statistics_output;
 };
 
 // application-wide logic update event
@@ -80,8 +101,10 @@ struct EvtPostUpdate
 // render update event
 struct EvtRenderUpdate
 {
-    EvtRenderUpdate(Engine::duration timestep) : timestep(timestep) {}
+    EvtRenderUpdate(Engine::duration timestep, float alpha = 1.f) : timestep(timestep), alpha(alpha) {}
     Engine::duration timestep;
+    // the fraction between previous and current fixed updates for interpolation
+    float alpha;
 };
 
 // post-render update event
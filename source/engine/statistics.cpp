@@ -0,0 +1,114 @@
+// @date 2016/11/08
+// @author Mao Jingkai(oammix@gmail.com)
+
+#include <engine/statistics.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+NS_LEMON_BEGIN
+
+static const char* s_phase_names[kFramePhaseCount] =
+{
+    "frame", "update", "render", "draw", "wait", "sleep"
+};
+
+FrameStatistics::FrameStatistics(size_t window)
+{
+    set_window(window);
+}
+
+void FrameStatistics::record(FramePhase phase, duration value)
+{
+    _current[(size_t)phase] += std::chrono::duration<float, std::milli>(value).count();
+}
+
+void FrameStatistics::end_frame()
+{
+    auto index = _frames % _window;
+    for( size_t i = 0; i < kFramePhaseCount; i++ )
+    {
+        if( _samples[i].size() <= index )
+            _samples[i].push_back(_current[i]);
+        else
+            _samples[i][index] = _current[i];
+
+        _worst[i] = std::max(_worst[i], _current[i]);
+        _current[i] = 0.f;
+    }
+
+    _frames ++;
+}
+
+void FrameStatistics::reset()
+{
+    _frames = 0;
+    for( size_t i = 0; i < kFramePhaseCount; i++ )
+    {
+        _current[i] = 0.f;
+        _worst[i] = 0.f;
+        _samples[i].clear();
+    }
+}
+
+void FrameStatistics::set_window(size_t window)
+{
+    _window = std::max(window, (size_t)1);
+    for( auto& samples : _samples )
+        samples.reserve(_window);
+    reset();
+}
+
+FrameSummary FrameStatistics::get_summary(FramePhase phase) const
+{
+    FrameSummary summary;
+
+    auto samples = _samples[(size_t)phase];
+    if( samples.empty() )
+        return summary;
+
+    // nearest-rank percentiles
+    auto percentile = [&](float p)
+    {
+        auto rank = (size_t)std::ceil(p * samples.size());
+        auto nth = samples.begin() + (std::max(rank, (size_t)1) - 1);
+        std::nth_element(samples.begin(), nth, samples.end());
+        return *nth;
+    };
+
+    summary.samples = samples.size();
+    for( auto v : samples )
+        summary.average += v;
+    summary.average /= samples.size();
+    summary.worst = *std::max_element(samples.begin(), samples.end());
+    summary.p50 = percentile(0.50f);
+    summary.p95 = percentile(0.95f);
+    summary.p99 = percentile(0.99f);
+    return summary;
+}
+
+bool FrameStatistics::save(std::ostream& stream) const
+{
+    char line[128];
+    snprintf(line, sizeof(line), "frames: %llu, window: %zu (ms)\n",
+        (unsigned long long)_frames, _window);
+    stream << line;
+
+    snprintf(line, sizeof(line), "%-8s %9s %9s %9s %9s %9s %9s\n",
+        "phase", "average", "p50", "p95", "p99", "worst", "all-worst");
+    stream << line;
+
+    for( size_t i = 0; i < kFramePhaseCount; i++ )
+    {
+        auto summary = get_summary((FramePhase)i);
+        snprintf(line, sizeof(line), "%-8s %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+            s_phase_names[i], summary.average, summary.p50, summary.p95, summary.p99,
+            summary.worst, _worst[i]);
+        stream << line;
+    }
+
+    return !stream.fail();
+}
+
+NS_LEMON_END
@@ -0,0 +1,73 @@
+// @date 2016/11/08
+// @author Mao Jingkai(oammix@gmail.com)
+
+#pragma once
+
+#include <forwards.hpp>
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+NS_LEMON_BEGIN
+
+// phases of a frame which durations are recorded separately
+enum class FramePhase : uint8_t
+{
+    FRAME = 0,  // the whole frame, from the previous one to this one
+    UPDATE,     // EvtUpdate and EvtPostUpdate
+    RENDER,     // EvtRender and the submission of draw calls
+    DRAW,       // the backend draw on render thread
+    WAIT,       // waiting for the previous draw of render thread
+    SLEEP,      // frame limiter
+};
+
+const static size_t kFramePhaseCount = 6;
+
+// percentiles of the durations in window, in milliseconds
+struct FrameSummary
+{
+    size_t samples = 0;
+    float average = 0.f;
+    float p50 = 0.f;
+    float p95 = 0.f;
+    float p99 = 0.f;
+    float worst = 0.f;
+};
+
+// a rolling window of frame durations split by phases, which are sorted only when the
+// summaries queried. its not thread-safe, samples are recorded by the main thread.
+struct FrameStatistics
+{
+    using duration = std::chrono::high_resolution_clock::duration;
+
+    FrameStatistics(size_t window = 600);
+
+    // records the duration of phase for current frame
+    void record(FramePhase, duration);
+    // finishes current frame, the phases not recorded are treated as zero
+    void end_frame();
+    // discards all the samples
+    void reset();
+    // resizes the rolling window, samples are discarded
+    void set_window(size_t);
+
+    // returns the summary of samples in window
+    FrameSummary get_summary(FramePhase) const;
+    // returns the number of frames recorded since launched
+    uint64_t get_frames() const { return _frames; }
+    // returns the worst duration since launched, in milliseconds
+    float get_worst(FramePhase phase) const { return _worst[(size_t)phase]; }
+    // writes the summaries of phases as a readable table
+    bool save(std::ostream&) const;
+
+protected:
+    size_t _window;
+    uint64_t _frames = 0;
+    float _current[kFramePhaseCount];
+    float _worst[kFramePhaseCount];
+    // samples of each phase in milliseconds, indexed by frames
+    std::vector<float> _samples[kFramePhaseCount];
+};
+
+NS_LEMON_END
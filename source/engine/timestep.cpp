@@ -0,0 +1,29 @@
+// @date 2016/11/09
+// @author Mao Jingkai(oammix@gmail.com)
+
+#include <engine/timestep.hpp>
+
+#include <thread>
+
+NS_LEMON_BEGIN
+
+void wait_until(std::chrono::high_resolution_clock::time_point deadline,
+    std::chrono::high_resolution_clock::duration spin_threshold)
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    for( ;; )
+    {
+        auto now = clock::now();
+        if( now >= deadline )
+            break;
+
+        auto remaining = deadline - now;
+        if( remaining > spin_threshold )
+            std::this_thread::sleep_for(remaining - spin_threshold);
+        else
+            std::this_thread::yield();
+    }
+}
+
+NS_LEMON_END
@@ -0,0 +1,70 @@
+// @date 2016/11/09
+// @author Mao Jingkai(oammix@gmail.com)
+
+#pragma once
+
+#include <forwards.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+NS_LEMON_BEGIN
+
+// an accumulator of frame time which decouples the simulation from rendering. the elapsed
+// time of frames is consumed in fixed steps, and the remaining fraction of a step is used
+// to interpolate the rendering between the previous and current simulated states.
+struct FixedTimestep
+{
+    using duration = std::chrono::high_resolution_clock::duration;
+
+    // set the fixed step, zero disables the fixed-step mode
+    void set_step(duration step) { _step = step; _accumulator = duration::zero(); }
+    // set the maximum steps simulated in one frame, the time exceeding it is dropped
+    void set_max_steps(unsigned steps) { _max_steps = std::max(steps, (unsigned)1); }
+
+    // accumulates the elapsed time of frame, returns the number of steps to simulate
+    unsigned advance(duration);
+    // returns the fraction of step remained in accumulator, in the range [0, 1)
+    float get_alpha() const;
+
+    bool is_enabled() const { return _step > duration::zero(); }
+    duration get_step() const { return _step; }
+    unsigned get_max_steps() const { return _max_steps; }
+
+protected:
+    duration _step = duration::zero();
+    duration _accumulator = duration::zero();
+    unsigned _max_steps = 5;
+};
+
+// blocks until the deadline, sleeps with the coarse granularity of scheduler at first,
+// and yields the remaining time within threshold to wake up precisely without burning
+// a whole core.
+void wait_until(std::chrono::high_resolution_clock::time_point deadline,
+    std::chrono::high_resolution_clock::duration spin_threshold);
+
+//
+INLINE unsigned FixedTimestep::advance(duration elapsed)
+{
+    if( !is_enabled() )
+        return 0;
+
+    _accumulator += elapsed;
+    auto steps = (unsigned)std::min<int64_t>(_accumulator / _step, _max_steps);
+    _accumulator -= _step * steps;
+
+    // drops the time can not be caught up, instead of spiraling into more steps
+    if( _accumulator >= _step )
+        _accumulator = _accumulator % _step;
+
+    return steps;
+}
+
+INLINE float FixedTimestep::get_alpha() const
+{
+    if( !is_enabled() )
+        return 1.f;
+    return std::chrono::duration<float>(_accumulator) / std::chrono::duration<float>(_step);
+}
+
+NS_LEMON_END
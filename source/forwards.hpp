@@ -72,13 +72,15 @@ const static unsigned kMaxProgram = 32;
 
 const static unsigned kMaxTexturePerMaterial = 8;
 const static unsigned kMaxUniformsPerMaterial = 32;
+const static uint8_t kInvalidUniformSlot = 0xFF;
 
-const static unsigned kMaxUniforms = 1024;
 const static unsigned kMaxVertexBuffer = 256;
 const static unsigned kMaxIndexBuffer = 256;
 const static unsigned kMaxTexture = 64;
 const static unsigned kMaxRenderState = 32;
 
+const static unsigned kStagingBufferSize = 16 * 1024 * 1024;
+
 struct RenderFrame;
 struct RenderFrontend;
 struct WindowDevice;
@@ -4,11 +4,21 @@
 #include <graphics/backend/backend.hpp>
 #include <SDL2/SDL.h>
 
+#include <algorithm>
 #include <iostream>
 #include <thread>
 NS_LEMON_GRAPHICS_BEGIN
 
-void VertexBufferGL::create(const void* data, size_t size, const VertexLayout& layout, GLenum usage)
+static void copy_from_staging(GLenum target, GLuint staging, const void* offset, size_t start, size_t size)
+{
+#ifndef GL_ES_VERSION_2_0
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, target, (GLintptr)offset, start, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+#endif
+}
+
+void VertexBufferGL::create(const void* data, size_t size, const VertexLayout& layout, GLenum usage, GLuint staging)
 {
     ASSERT(_uid == 0, "duplicated create of vertex buffer");
     ASSERT(layout.get_stride() > 0, "failed to create vertex buffer with empty vertex layout.");
@@ -21,19 +31,24 @@ void VertexBufferGL::create(const void* data, size_t size, const VertexLayout& l
     _layout = layout;
 
     glBindBuffer(GL_ARRAY_BUFFER, _uid);
-    glBufferData(GL_ARRAY_BUFFER, size, data, _usage);
+    glBufferData(GL_ARRAY_BUFFER, size, staging != 0 ? nullptr : data, _usage);
+    if( staging != 0 )
+        copy_from_staging(GL_ARRAY_BUFFER, staging, data, 0, size);
     CHECK_GL_ERROR();
 }
 
-void VertexBufferGL::update(GLuint start, const void* data, size_t size)
+void VertexBufferGL::update(GLuint start, const void* data, size_t size, GLuint staging)
 {
     ASSERT(_uid != 0, "try to update invalid vertex buffer.");
     ASSERT(_usage == GL_DYNAMIC_DRAW, "try to update dynamic vertex buffer.");
-    ASSERT(data != nullptr && size != 0, "try to update vertex buffer with nullptr.");
+    ASSERT((data != nullptr || staging != 0) && size != 0, "try to update vertex buffer with nullptr.");
     ASSERT(start + (size / _layout.get_stride()) < _num, "update vertex buffer out-of-range.");
 
     glBindBuffer(GL_ARRAY_BUFFER, _uid);
-    glBufferSubData(GL_ARRAY_BUFFER, start*_layout.get_stride(), size, data);
+    if( staging != 0 )
+        copy_from_staging(GL_ARRAY_BUFFER, staging, data, start*_layout.get_stride(), size);
+    else
+        glBufferSubData(GL_ARRAY_BUFFER, start*_layout.get_stride(), size, data);
     CHECK_GL_ERROR()
 }
 
@@ -45,7 +60,7 @@ void VertexBufferGL::free()
     CHECK_GL_ERROR()
 }
 
-void IndexBufferGL::create(const void* data, size_t size, GLuint element_size, GLenum usage)
+void IndexBufferGL::create(const void* data, size_t size, GLuint element_size, GLenum usage, GLuint staging)
 {
     ASSERT(_uid == 0, "duplicated create of index buffer");
     ASSERT(element_size > 0, "failed to create vertex buffer with zero-size.");
@@ -59,19 +74,24 @@ void IndexBufferGL::create(const void* data, size_t size, GLuint element_size, G
     _element_size = element_size;
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _uid);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, data, _usage);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, staging != 0 ? nullptr : data, _usage);
+    if( staging != 0 )
+        copy_from_staging(GL_ELEMENT_ARRAY_BUFFER, staging, data, 0, size);
     CHECK_GL_ERROR();
 }
 
-void IndexBufferGL::update(GLuint start, const void* data, size_t size)
+void IndexBufferGL::update(GLuint start, const void* data, size_t size, GLuint staging)
 {
     ASSERT(_uid != 0, "try to update invalid index buffer.");
     ASSERT(_usage == GL_DYNAMIC_DRAW, "try to update dynamic index buffer.");
-    ASSERT(data != nullptr && size != 0, "try to update index buffer with nullptr.");
+    ASSERT((data != nullptr || staging != 0) && size != 0, "try to update index buffer with nullptr.");
     ASSERT(start + (size / _element_size) < _num, "update index buffer out-of-range.");
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _uid);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, start*_element_size, size, data);
+    if( staging != 0 )
+        copy_from_staging(GL_ELEMENT_ARRAY_BUFFER, staging, data, start*_element_size, size);
+    else
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, start*_element_size, size, data);
     CHECK_GL_ERROR()
 }
 
@@ -107,13 +127,80 @@ GLuint compile(GLenum type, const char* source)
     return shader;
 }
 
-void ProgramGL::create(const char* vsraw, const char* fsraw)
+static bool load_program_binary(GLuint program, ProgramBinary* binary)
+{
+#ifndef GL_ES_VERSION_2_0
+    std::unique_lock<std::mutex> L(binary->mutex);
+    if( binary->data.empty() )
+        return false;
+
+    glProgramBinary(program, binary->format, binary->data.data(), (GLsizei)binary->data.size());
+
+    // binaries might be rejected after the driver or hardware changed
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if( status == 0 )
+    {
+        LOGI("failed to load program binary, fallback to compile.");
+        binary->data.clear();
+        return false;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void retrieve_program_binary(GLuint program, ProgramBinary* binary)
+{
+#ifndef GL_ES_VERSION_2_0
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if( size <= 0 )
+        return;
+
+    std::unique_lock<std::mutex> L(binary->mutex);
+    GLenum format = 0;
+    binary->data.resize(size);
+    glGetProgramBinary(program, size, &size, &format, binary->data.data());
+    binary->data.resize(size);
+    binary->format = format;
+#endif
+}
+
+void ProgramGL::create(const char* vsraw, const char* fsraw, ProgramBinary* binary)
 {
     ASSERT(_uid == 0, "duplicated create of program.");
 
     _uid = glCreateProgram();
     ASSERT(_uid != 0, "failed to create program object.");
 
+    if( binary == nullptr || !load_program_binary(_uid, binary) )
+        link(vsraw, fsraw, binary);
+
+    _uniform_size = 0;
+    _texture_size = 0;
+
+    for( uint8_t i = 0; i < VertexAttribute::kVertexAttributeCount; i++ )
+    {
+        _attributes[i].first.clear();
+        _attributes[i].second = -1;
+        // try to bind attribute with default name first.
+        auto va = (VertexAttribute::Enum)i;
+        bind_attribute(va, VertexAttribute::name(va));
+    }
+
+    CHECK_GL_ERROR();
+}
+
+void ProgramGL::link(const char* vsraw, const char* fsraw, ProgramBinary* binary)
+{
+#ifndef GL_ES_VERSION_2_0
+    if( binary != nullptr )
+        glProgramParameteri(_uid, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+
     auto vs = compile(GL_VERTEX_SHADER, vsraw);
     ENSURE(vs != 0);
 
@@ -139,19 +226,8 @@ void ProgramGL::create(const char* vsraw, const char* fsraw)
         FATAL("failed to link program: %s\n", buf);
     }
 
-    _uniform_size = 0;
-    _texture_size = 0;
-
-    for( uint8_t i = 0; i < VertexAttribute::kVertexAttributeCount; i++ )
-    {
-        _attributes[i].first.clear();
-        _attributes[i].second = -1;
-        // try to bind attribute with default name first.
-        auto va = (VertexAttribute::Enum)i;
-        bind_attribute(va, VertexAttribute::name(va));
-    }
-
-    CHECK_GL_ERROR();
+    if( binary != nullptr )
+        retrieve_program_binary(_uid, binary);
 }
 
 void ProgramGL::free()
@@ -177,6 +253,7 @@ GLint ProgramGL::bind_uniform(const char* name)
         "too many uniforms(%d).", kMaxUniformsPerMaterial);
 
     auto location = glGetUniformLocation(_uid, name);
+    _units[_uniform_size] = -1;
     _uniforms[_uniform_size].first = hash;
     _uniforms[_uniform_size++].second = location;
     return location;
@@ -203,78 +280,86 @@ void ProgramGL::update_uniform(math::StringHash hash, const UniformVariable& val
     {
         if( _uniforms[i].first == hash )
         {
-            auto& uniform = _uniforms[i];
-            if( value.is<math::Vector<1, float>>() )
-            {
-                auto v = value.get<math::Vector<1, float>>();
-                glUniform1f(uniform.second, v[0]);
-            }
-            else if( value.is<math::Vector<2, float>>() )
-            {
-                auto v = value.get<math::Vector<2, float>>();
-                glUniform2f(uniform.second, v[0], v[1]);
-            }
-            else if( value.is<math::Vector<3, float>>() )
-            {
-                auto v = value.get<math::Vector<3, float>>();
-                glUniform3f(uniform.second, v[0], v[1], v[2]);
-            }
-            else if( value.is<math::Vector<4, float>>() )
-            {
-                auto v = value.get<math::Vector<4, float>>();
-                glUniform4f(uniform.second, v[0], v[1], v[2], v[3]);
-            }
-            else if( value.is<math::Matrix<2, 2, float>>() )
-            {
-                auto v = value.get<math::Matrix<2, 2, float>>();
-                glUniformMatrix2fv(uniform.second, 1, GL_TRUE, (float*)&v);
-            }
-            else if( value.is<math::Matrix<3, 3, float>>() )
-            {
-                auto v = value.get<math::Matrix<3, 3, float>>();
-                glUniformMatrix3fv(uniform.second, 1, GL_TRUE, (float*)&v);
-            }
-            else if( value.is<math::Matrix<4, 4, float>>() )
-            {
-                auto v = value.get<math::Matrix<4, 4, float>>();
-                glUniformMatrix4fv(uniform.second, 1, GL_TRUE, (float*)&v);
-            }
-            else if( value.is<Handle>() )
-            {
-                for( uint8_t i = 0; i < _texture_size; i++ )
-                {
-                    if( _textures[i].first == hash )
-                    {
-                        _textures[i].second = value.get<Handle>();
-                        return;
-                    }
-                }
-
-                ASSERT(_texture_size < kMaxTexturePerMaterial,
-                    "too many textures(%d).", kMaxTexturePerMaterial);
-
-                glUniform1i(uniform.second, _texture_size);
-                _textures[_texture_size].first = hash;
-                _textures[_texture_size++].second = value.get<Handle>();
-            }
-            else
-                FATAL("invalid uniform variable variant type %d.", value.which());
-
-            CHECK_GL_ERROR();
+            update_uniform(i, value);
             return;
         }
     }
 }
 
+void ProgramGL::update_uniform(uint8_t slot, const UniformVariable& value)
+{
+    if( slot >= _uniform_size )
+        return;
+
+    auto location = _uniforms[slot].second;
+    if( value.is<math::Vector<1, float>>() )
+    {
+        auto v = value.get<math::Vector<1, float>>();
+        glUniform1f(location, v[0]);
+    }
+    else if( value.is<math::Vector<2, float>>() )
+    {
+        auto v = value.get<math::Vector<2, float>>();
+        glUniform2f(location, v[0], v[1]);
+    }
+    else if( value.is<math::Vector<3, float>>() )
+    {
+        auto v = value.get<math::Vector<3, float>>();
+        glUniform3f(location, v[0], v[1], v[2]);
+    }
+    else if( value.is<math::Vector<4, float>>() )
+    {
+        auto v = value.get<math::Vector<4, float>>();
+        glUniform4f(location, v[0], v[1], v[2], v[3]);
+    }
+    else if( value.is<math::Matrix<2, 2, float>>() )
+    {
+        auto v = value.get<math::Matrix<2, 2, float>>();
+        glUniformMatrix2fv(location, 1, GL_TRUE, (float*)&v);
+    }
+    else if( value.is<math::Matrix<3, 3, float>>() )
+    {
+        auto v = value.get<math::Matrix<3, 3, float>>();
+        glUniformMatrix3fv(location, 1, GL_TRUE, (float*)&v);
+    }
+    else if( value.is<math::Matrix<4, 4, float>>() )
+    {
+        auto v = value.get<math::Matrix<4, 4, float>>();
+        glUniformMatrix4fv(location, 1, GL_TRUE, (float*)&v);
+    }
+    else if( value.is<Handle>() )
+    {
+        // texture units are assigned at the first update of samplers
+        auto& unit = _units[slot];
+        if( unit < 0 )
+        {
+            ASSERT(_texture_size < kMaxTexturePerMaterial,
+                "too many textures(%d).", kMaxTexturePerMaterial);
+
+            glUniform1i(location, _texture_size);
+            _textures[_texture_size].first = _uniforms[slot].first;
+            unit = _texture_size++;
+        }
+
+        _textures[unit].second = value.get<Handle>();
+    }
+    else
+        FATAL("invalid uniform variable variant type %d.", value.which());
+
+    CHECK_GL_ERROR();
+}
+
 void TextureGL::create(
     const void* data,
     GLenum format, GLenum pixel_format,
     uint16_t width, uint16_t height,
-    GLenum usage)
+    uint8_t levels,
+    GLenum usage,
+    GLuint staging)
 {
     ASSERT(_uid == 0, "duplicated creation of texture.");
-    ASSERT(width > 0 && height > 0 && data != nullptr,
-        "failed to create texture with empty data.");
+    ASSERT(width > 0 && height > 0, "failed to create texture with empty size.");
+    ASSERT(levels > 0, "failed to create texture without levels.");
 
     glGenTextures(1, &_uid);
     ASSERT(_uid != 0, "failed to create texture.");
@@ -286,28 +371,137 @@ void TextureGL::create(
     _usage = usage;
     _filter = GL_LINEAR;
     _address[0] = _address[1] = _address[2] = GL_REPEAT;
-    _mipmap = false;
+    // pre-baked mip chain makes glGenerateMipmap unnecessary
+    _mipmap = levels > 1;
     _dirty = true;
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, _uid);
 
+#ifndef GL_ES_VERSION_2_0
+    // sampling stops at the last pre-baked level, so partial chains are complete
+    if( levels > 1 )
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+#else
+    // partial chains are incomplete without GL_TEXTURE_MAX_LEVEL, sampled without mipmaps
+    auto size = std::max(width, height);
+    auto full = 1;
+    while( size >>= 1 )
+        full ++;
+
+    if( levels < full )
+        _mipmap = false;
+#endif
+
     update_parameters();
+    upload(data, levels, staging, true);
+}
 
-    glTexImage2D(
-        /*target*/ GL_TEXTURE_2D,
-        /*level*/ 0,
-        /*internalFormat*/ _format,
-        /*width*/ _width,
-        /*height*/ _height,
-        /*border*/ 0,
-        /*format*/ _format,
-        /*type*/ _pixel_format,
-        /*data*/ data);
+void TextureGL::update(const void* data, uint8_t levels, GLuint staging)
+{
+    ASSERT(_uid != 0, "try to update invalid texture.");
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _uid);
+    upload(data, levels, staging, false);
+
+    // mipmaps generated before the contents arrived are out of date
+    if( _mipmap && levels == 1 )
+        glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+void TextureGL::upload(const void* data, uint8_t levels, GLuint staging, bool allocate)
+{
+#ifndef GL_ES_VERSION_2_0
+    if( staging != 0 )
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+#endif
+
+    auto width = _width, height = _height;
+    auto level_data = static_cast<const uint8_t*>(data);
+    for( uint8_t level = 0; level < levels; level++ )
+    {
+        auto size = size_of_level(width, height);
+        if( is_compressed() && allocate )
+        {
+            glCompressedTexImage2D(
+                /*target*/ GL_TEXTURE_2D,
+                /*level*/ level,
+                /*internalFormat*/ _format,
+                /*width*/ width,
+                /*height*/ height,
+                /*border*/ 0,
+                /*imageSize*/ size,
+                /*data*/ level_data);
+        }
+        else if( is_compressed() )
+        {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, _format, size, level_data);
+        }
+        else if( allocate )
+        {
+            glTexImage2D(
+                /*target*/ GL_TEXTURE_2D,
+                /*level*/ level,
+                /*internalFormat*/ _format,
+                /*width*/ width,
+                /*height*/ height,
+                /*border*/ 0,
+                /*format*/ _format,
+                /*type*/ _pixel_format,
+                /*data*/ level_data);
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, _format, _pixel_format, level_data);
+        }
+
+        // offsets into staging buffer are advanced as well
+        if( level_data != nullptr || staging != 0 )
+            level_data += size;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+
+#ifndef GL_ES_VERSION_2_0
+    if( staging != 0 )
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#endif
 
     CHECK_GL_ERROR();
 }
 
+bool TextureGL::is_compressed() const
+{
+    return
+        _format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ||
+        _format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ||
+        _format == GL_ETC1_RGB8_OES;
+}
+
+size_t TextureGL::size_of_level(uint16_t width, uint16_t height) const
+{
+    if( is_compressed() )
+    {
+        size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+        return blocks * (_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 16 : 8);
+    }
+
+    if( _pixel_format != GL_UNSIGNED_BYTE )
+        return (size_t)width * height * 2;
+
+    switch(_format)
+    {
+        case GL_RGBA: return (size_t)width * height * 4;
+        case GL_RGB: return (size_t)width * height * 3;
+        case GL_LUMINANCE_ALPHA: return (size_t)width * height * 2;
+        default: return (size_t)width * height;
+    }
+}
+
 void TextureGL::update_mipmap(bool mipmap)
 {
     ASSERT(_uid != 0, "failed to generate mipmap with invalid texture.");
@@ -456,6 +650,78 @@ static const unsigned GL_BLEND_EQUATION_FUNC[] =
     GL_FUNC_REVERSE_SUBTRACT
 };
 
+bool StagingBufferGL::create(size_t capacity)
+{
+#ifndef GL_ES_VERSION_2_0
+    ASSERT(_uid == 0, "duplicated creation of staging buffer.");
+
+    // persistent mapping requires ARB_buffer_storage, uploads are made from client memory without it
+    if( !GLEW_ARB_buffer_storage )
+        return false;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &_uid);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _uid);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, nullptr, flags);
+    _memory = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity, flags));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if( _memory == nullptr )
+    {
+        LOGW("failed to map staging buffer persistently.");
+        glDeleteBuffers(1, &_uid);
+        _uid = 0;
+        return false;
+    }
+
+    _capacity = capacity;
+    _fenced = _retired = 0;
+    CHECK_GL_ERROR();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void StagingBufferGL::discard()
+{
+    _uid = 0;
+    _memory = nullptr;
+    _capacity = 0;
+    _fenced = _retired = 0;
+#ifndef GL_ES_VERSION_2_0
+    _fences.clear();
+#endif
+}
+
+void StagingBufferGL::fence(uint64_t position)
+{
+#ifndef GL_ES_VERSION_2_0
+    if( _uid == 0 || position <= _fenced )
+        return;
+
+    _fences.push_back(std::make_pair(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), position));
+    _fenced = position;
+#endif
+}
+
+uint64_t StagingBufferGL::poll()
+{
+#ifndef GL_ES_VERSION_2_0
+    while( !_fences.empty() )
+    {
+        auto status = glClientWaitSync(_fences.front().first, 0, 0);
+        if( status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED )
+            break;
+
+        glDeleteSync(_fences.front().first);
+        _retired = _fences.front().second;
+        _fences.pop_front();
+    }
+#endif
+    return _retired;
+}
+
 bool RenderBackend::initialize(SDL_Window* window)
 {
     if( window == nullptr )
@@ -468,7 +734,10 @@ bool RenderBackend::initialize(SDL_Window* window)
 
     // the context might be lost behind the scene as the application is minimized in Android
     if( _context && !SDL_GL_GetCurrentContext() )
+    {
         _context = 0;
+        _staging.discard();
+    }
 
     if( _context == 0 )
     {
@@ -503,6 +772,17 @@ bool RenderBackend::initialize(SDL_Window* window)
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
+#ifndef GL_ES_VERSION_2_0
+    // drivers might expose the extension without any binary format
+    GLint formats = 0;
+    if( GLEW_ARB_get_program_binary )
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    _program_binary_support = formats > 0;
+#endif
+
+    if( _staging._uid == 0 && !_staging.create(kStagingBufferSize) )
+        LOGI("staging buffer is not supported, uploads are made synchronously.");
+
     // get default render framebuffer
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, &_system_frame_object);
 
@@ -520,6 +800,7 @@ void RenderBackend::dispose()
     if( _window != nullptr && _context != 0 )
         SDL_GL_DeleteContext(_context);
 
+    _staging.discard();
     _context = 0;
     _window = nullptr;
 }
@@ -544,17 +825,37 @@ void RenderBackend::end_frame()
     SDL_GL_MakeCurrent(_window, nullptr);
 }
 
+uint8_t* RenderBackend::get_staging_memory() const
+{
+    return _staging._memory;
+}
+
+size_t RenderBackend::get_staging_capacity() const
+{
+    return _staging._capacity;
+}
+
+void RenderBackend::fence_staging(uint64_t position)
+{
+    _staging.fence(position);
+}
+
+uint64_t RenderBackend::poll_staging()
+{
+    return _staging.poll();
+}
+
 void RenderBackend::create_vertex_buffer(
-    Handle handle, const void* data, size_t size, const VertexLayout& layout, BufferUsage usage)
+    Handle handle, const void* data, size_t size, const VertexLayout& layout, BufferUsage usage, bool staged)
 {
     _vbs[handle.get_index()].create(data, size, layout,
-        usage == BufferUsage::DYNAMIC ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+        usage == BufferUsage::DYNAMIC ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW, staged ? _staging._uid : 0);
 }
 
 void RenderBackend::update_vertex_buffer(
-    Handle handle, uint32_t start, const void* data, size_t size)
+    Handle handle, uint32_t start, const void* data, size_t size, bool staged)
 {
-    _vbs[handle.get_index()].update(start, data, size);
+    _vbs[handle.get_index()].update(start, data, size, staged ? _staging._uid : 0);
 }
 
 void RenderBackend::free_vertex_buffer(Handle handle)
@@ -569,16 +870,16 @@ GLuint INDEX_ELEMENT_SIZE[] =
 };
 
 void RenderBackend::create_index_buffer(
-    Handle handle, const void* data, size_t size, IndexElementFormat format, BufferUsage usage)
+    Handle handle, const void* data, size_t size, IndexElementFormat format, BufferUsage usage, bool staged)
 {
     _ibs[handle.get_index()].create(data, size, INDEX_ELEMENT_SIZE[value(format)],
-        usage == BufferUsage::DYNAMIC ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+        usage == BufferUsage::DYNAMIC ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW, staged ? _staging._uid : 0);
 }
 
 void RenderBackend::update_index_buffer(
-    Handle handle, uint32_t start, const void* data, size_t size)
+    Handle handle, uint32_t start, const void* data, size_t size, bool staged)
 {
-    _ibs[handle.get_index()].update(start, data, size);
+    _ibs[handle.get_index()].update(start, data, size, staged ? _staging._uid : 0);
 }
 
 void RenderBackend::free_index_buffer(Handle handle)
@@ -592,7 +893,10 @@ static GLenum GL_TEXTURE_FORMAT[] =
     GL_RGB,
     GL_RGBA,
     GL_LUMINANCE,
-    GL_LUMINANCE_ALPHA
+    GL_LUMINANCE_ALPHA,
+    GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+    GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+    GL_ETC1_RGB8_OES
 };
 
 static GLenum GL_TEXTURE_PIXEL_FORMAT[] =
@@ -607,14 +911,23 @@ void RenderBackend::create_texture(
     Handle handle, const void* data,
     TextureFormat format, TexturePixelFormat pixel_format,
     uint16_t width, uint16_t height,
-    BufferUsage usage)
+    uint8_t levels,
+    BufferUsage usage,
+    bool staged)
 {
     _textures[handle.get_index()].create(data,
         GL_TEXTURE_FORMAT[value(format)],
         GL_TEXTURE_PIXEL_FORMAT[value(pixel_format)],
         width,
         height,
-        usage == BufferUsage::DYNAMIC ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+        levels,
+        usage == BufferUsage::DYNAMIC ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW,
+        staged ? _staging._uid : 0);
+}
+
+void RenderBackend::update_texture(Handle handle, const void* data, uint8_t levels, bool staged)
+{
+    _textures[handle.get_index()].update(data, levels, staged ? _staging._uid : 0);
 }
 
 void RenderBackend::update_texture_mipmap(Handle handle, bool mipmap)
@@ -652,9 +965,9 @@ void RenderBackend::free_texture(Handle handle)
     _textures[handle.get_index()].free();
 }
 
-void RenderBackend::create_program(Handle handle, const char* vs, const char* fs)
+void RenderBackend::create_program(Handle handle, const char* vs, const char* fs, ProgramBinary* binary)
 {
-    _materials[handle.get_index()].create(vs, fs);
+    _materials[handle.get_index()].create(vs, fs, _program_binary_support ? binary : nullptr);
 }
 
 void RenderBackend::free_program(Handle handle)
@@ -673,6 +986,12 @@ void RenderBackend::update_program_uniform(Handle handle, math::StringHash name,
     _materials[handle.get_index()].update_uniform(name, value);
 }
 
+void RenderBackend::update_program_uniform(Handle handle, uint8_t slot, const UniformVariable& value)
+{
+    set_program(handle);
+    _materials[handle.get_index()].update_uniform(slot, value);
+}
+
 void RenderBackend::create_program_attribute(Handle handle, VertexAttribute::Enum va, const char* name)
 {
     _materials[handle.get_index()].bind_attribute(va, name);
@@ -25,7 +25,19 @@
 #include <GL/glew.h>
 #endif
 
+// compressed formats are exposed by extensions, which might be absent from headers
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_ETC1_RGB8_OES
+#define GL_ETC1_RGB8_OES 0x8D64
+#endif
+
 #include <thread>
+#include <deque>
 
 NS_LEMON_GRAPHICS_BEGIN
 
@@ -33,10 +45,11 @@ extern void check_device_error(const char* file, unsigned line);
 #define CHECK_GL_ERROR() \
     check_device_error(__FILE__, __LINE__);
 
+// the data of uploads is an offset into staging buffer if its specified, and copied on device
 struct VertexBufferGL
 {
-    void create(const void* data, size_t size, const VertexLayout&, GLenum usage);
-    void update(GLuint start, const void* data, size_t size);
+    void create(const void* data, size_t size, const VertexLayout&, GLenum usage, GLuint staging = 0);
+    void update(GLuint start, const void* data, size_t size, GLuint staging = 0);
     void free();
 
     GLuint _uid = 0;
@@ -47,8 +60,8 @@ struct VertexBufferGL
 
 struct IndexBufferGL
 {
-    void create(const void* data, size_t size, GLuint element_size, GLenum usage);
-    void update(GLuint start, const void* data, size_t size);
+    void create(const void* data, size_t size, GLuint element_size, GLenum usage, GLuint staging = 0);
+    void update(GLuint start, const void* data, size_t size, GLuint staging = 0);
     void free();
 
     GLuint _uid = 0;
@@ -62,17 +75,23 @@ struct ProgramGL
     using pair_t = std::pair<math::StringHash, GLint>;
     using tex_pair_t = std::pair<math::StringHash, Handle>;
 
-    void create(const char* vs, const char* ps);
+    // loads the binary if its available, or retrieves it into binary after linking
+    void create(const char* vs, const char* ps, ProgramBinary* binary = nullptr);
+    void link(const char* vs, const char* ps, ProgramBinary* binary);
     void free();
 
     GLint bind_attribute(VertexAttribute::Enum va, const char* name);
+    // uniforms are indexed by slots in the order of binding
     GLint bind_uniform(const char* name);
     void update_uniform(math::StringHash, const UniformVariable&);
+    void update_uniform(uint8_t slot, const UniformVariable&);
 
     GLuint _uid = 0;
 
     uint8_t _uniform_size = 0;
     pair_t _uniforms[kMaxUniformsPerMaterial];
+    // texture unit of sampler uniforms, -1 if not assigned yet
+    int8_t _units[kMaxUniformsPerMaterial];
 
     uint8_t _texture_size = 0;
     tex_pair_t _textures[kMaxTexturePerMaterial];
@@ -82,13 +101,24 @@ struct ProgramGL
 
 struct TextureGL
 {
-    void create(const void*, GLenum, GLenum, uint16_t, uint16_t, GLenum);
+    // levels of mip chain are stored contiguously in data, starting from the largest one.
+    // the storage is allocated only if data is nullptr, and filled by update later.
+    void create(const void*, GLenum, GLenum, uint16_t, uint16_t, uint8_t, GLenum, GLuint staging = 0);
+    void update(const void*, uint8_t, GLuint staging = 0);
     void update_mipmap(bool mipmap);
     void update_address_mode(int8_t, GLenum);
     void update_filter_mode(GLenum);
     void update_parameters();
     void free();
 
+    bool is_compressed() const;
+    size_t size_of_level(uint16_t, uint16_t) const;
+
+protected:
+    void upload(const void*, uint8_t, GLuint staging, bool allocate);
+
+public:
+
     bool _mipmap = false, _dirty = false;
     uint16_t _width, _height;
     GLenum _usage = GL_STATIC_DRAW;
@@ -100,6 +130,29 @@ struct TextureGL
     GLuint _uid = 0;
 };
 
+// the buffer object of staging memory, which is mapped persistently so the frontend could
+// write uploads into it directly. a fence is inserted after the uploads of every frame, and
+// the memory is recycled once the device consumed them.
+struct StagingBufferGL
+{
+    bool create(size_t capacity);
+    // forgets the buffer object, which is released along with the context
+    void discard();
+    // inserts a fence after the uploads before position
+    void fence(uint64_t position);
+    // returns the position before which the uploads are consumed by device
+    uint64_t poll();
+
+    GLuint _uid = 0;
+    uint8_t* _memory = nullptr;
+    size_t _capacity = 0;
+    uint64_t _fenced = 0;
+    uint64_t _retired = 0;
+#ifndef GL_ES_VERSION_2_0
+    std::deque<std::pair<GLsync, uint64_t>> _fences;
+#endif
+};
+
 // graphics device subsystem. manages the window device, renedering state and gpu resources
 struct RenderBackend
 {
@@ -117,22 +170,33 @@ struct RenderBackend
     // clear any or all of rendertarget, depth buffer and stencil buffer
     void clear(ClearOption, const math::Color& color = {0.f, 0.f, 0.f, 0.f}, float depth = 1.f, unsigned stencil = 0);
 
+    // returns the persistently mapped staging memory, nullptr if its not supported
+    uint8_t* get_staging_memory() const;
+    size_t get_staging_capacity() const;
+    // inserts a fence after the staged uploads before position
+    void fence_staging(uint64_t);
+    // returns the position before which the staged uploads are consumed by device
+    uint64_t poll_staging();
+
+    // the data of creations and updates is an offset into staging memory if its staged.
     // Creates static vertex buffer.
-    void create_vertex_buffer(Handle, const void*, size_t, const VertexLayout&, BufferUsage);
+    void create_vertex_buffer(Handle, const void*, size_t, const VertexLayout&, BufferUsage, bool staged = false);
     // Update dynamic(BufferUsage::DYNAMIC) vertex buffer.
-    void update_vertex_buffer(Handle, uint32_t, const void*, size_t);
+    void update_vertex_buffer(Handle, uint32_t, const void*, size_t, bool staged = false);
     // Destroy vertex buffer.
     void free_vertex_buffer(Handle);
 
     // Creates an index buffer. 
-    void create_index_buffer(Handle, const void*, size_t, IndexElementFormat, BufferUsage);
+    void create_index_buffer(Handle, const void*, size_t, IndexElementFormat, BufferUsage, bool staged = false);
     // Update dynamic(BufferUsage::DYNAMIC) index buffer.
-    void update_index_buffer(Handle, uint32_t, const void*, size_t);
+    void update_index_buffer(Handle, uint32_t, const void*, size_t, bool staged = false);
     // Destroy index buffer.
     void free_index_buffer(Handle);
 
-    // Create texture.
-    void create_texture(Handle, const void*, TextureFormat, TexturePixelFormat, uint16_t, uint16_t, BufferUsage);
+    // Create texture, only the storage is allocated if data is nullptr.
+    void create_texture(Handle, const void*, TextureFormat, TexturePixelFormat, uint16_t, uint16_t, uint8_t, BufferUsage, bool staged = false);
+    // Update all the levels of texture.
+    void update_texture(Handle, const void*, uint8_t, bool staged = false);
     // Update texture mipmap.
     void update_texture_mipmap(Handle, bool);
     // Update texture address mode.
@@ -143,13 +207,14 @@ struct RenderBackend
     void free_texture(Handle);
 
     // Compile and link shaders.
-    void create_program(Handle, const char*, const char*);
+    void create_program(Handle, const char*, const char*, ProgramBinary*);
     // Destroy program.
     void free_program(Handle);
 
     // Create uniform %name associated with program.
     void create_program_uniform(Handle, const char*);
     void update_program_uniform(Handle, math::StringHash, const UniformVariable&);
+    void update_program_uniform(Handle, uint8_t, const UniformVariable&);
     // Create attribute %name associated with program.
     void create_program_attribute(Handle, VertexAttribute::Enum, const char*);
 
@@ -215,6 +280,12 @@ protected:
     VertexBufferGL _vbs[kMaxVertexBuffer];
     TextureGL _textures[kMaxTexture];
 
+    // retrieving and loading program binaries
+    bool _program_binary_support = false;
+
+    // persistently mapped memory of uploads
+    StagingBufferGL _staging;
+
     // vao cache
     bool _vao_support = true;
     vao_table_t _vao_cache;
@@ -5,8 +5,15 @@
 
 #include <forwards.hpp>
 #include <graphics/drawcall.hpp>
+#include <graphics/state.hpp>
+#include <graphics/backend/uniform.hpp>
+#include <codebase/memory_tracker.hpp>
+#include <codebase/frame_allocator.hpp>
 #include <cstdlib>
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 NS_LEMON_GRAPHICS_BEGIN
 
@@ -32,7 +39,7 @@ struct RenderFrame
         _packets.reset( new (std::nothrow) FrameTask*[packet_size] );
 
         _buffer_tail.store(0);
-        _buffer.reset( new (std::nothrow) uint8_t[buffer_size] );
+        _buffer = allocate_tagged(MemoryTag::RENDER, buffer_size);
     }
 
     template<typename T> T* create_task()
@@ -59,11 +66,23 @@ struct RenderFrame
         }
     }
 
+    // keeps external memory referenced by tasks alive until this frame is drawn
+    void retain(std::shared_ptr<const void> memory)
+    {
+        std::unique_lock<std::mutex> lock(_retain_mutex);
+        _retained.push_back(std::move(memory));
+    }
+
     void clear()
     {
         _packet_tail.store(0);
         _buffer_tail.store(0);
-        _drawcalls.clear();
+        // the drawcalls live in frame allocator, its storage is released instead of kept
+        frame_vector<RenderDrawCall>().swap(_drawcalls);
+        _retained.clear();
+
+        for( auto& handle : _state_handles )
+            handle.invalidate();
     }
 
     size_t _packet_size;
@@ -73,16 +92,55 @@ struct RenderFrame
     std::unique_ptr<FrameTask*[]> _packets;
 
     std::atomic<size_t> _buffer_tail;
-    std::unique_ptr<uint8_t[]> _buffer;
+    TaggedBytes _buffer;
+
+    // the end position of staging memory written by this frame
+    uint64_t _staging_position = 0;
 
-    void submit(const RenderDrawCall& drawcall)
+    // submits a drawcall with the render state it refers, the state is snapshotted at
+    // the first submission in this frame
+    void submit(const RenderDrawCall& drawcall, const RenderState* state)
     {
         std::unique_lock<std::mutex> lock(_drawcall_mutex);
         _drawcalls.push_back(drawcall);
+
+        if( state != nullptr && _state_handles[drawcall.state.get_index()] != drawcall.state )
+        {
+            _state_handles[drawcall.state.get_index()] = drawcall.state;
+            _states[drawcall.state.get_index()] = *state;
+        }
+    }
+
+    // updates the snapshot of state if its submitted in this frame already, so the
+    // drawcalls submitted before are drawn with the latest state too
+    void update_state(Handle handle, const RenderState& state)
+    {
+        std::unique_lock<std::mutex> lock(_drawcall_mutex);
+        if( handle.is_valid() && _state_handles[handle.get_index()] == handle )
+            _states[handle.get_index()] = state;
+    }
+
+    // returns the snapshot of state, nullptr if its not submitted in this frame
+    const RenderState* get_state(Handle handle) const
+    {
+        if( !handle.is_valid() || _state_handles[handle.get_index()] != handle )
+            return nullptr;
+        return &_states[handle.get_index()];
     }
 
     std::mutex _drawcall_mutex;
-    std::vector<RenderDrawCall> _drawcalls;
+    frame_vector<RenderDrawCall> _drawcalls;
+
+    // render states are snapshotted since the ones of frontend might be modified by
+    // the next frame while this frame is drawing
+    Handle _state_handles[kMaxRenderState];
+    RenderState _states[kMaxRenderState];
+
+    std::mutex _retain_mutex;
+    std::vector<std::shared_ptr<const void>> _retained;
+
+    // uniform blocks referenced by drawcalls of this frame
+    UniformArena _uniforms;
 };
 
 
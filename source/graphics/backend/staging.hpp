@@ -0,0 +1,70 @@
+// @date 2016/11/05
+// @author Mao Jingkai(oammix@gmail.com)
+
+#pragma once
+
+#include <forwards.hpp>
+#include <atomic>
+
+NS_LEMON_GRAPHICS_BEGIN
+
+// the ring allocator of staging memory, which is mapped persistently from a buffer object.
+// positions are increased monotonically and wrap around the capacity, the memory before
+// the released position is consumed by device and could be written again. allocations
+// are made from the frontend, and released by the backend as the fences signaled.
+struct StagingRing
+{
+    const static size_t kAlignment = 16;
+
+    // reset with the mapped memory, or nullptr if staging is not available
+    void reset(uint8_t* memory, size_t capacity)
+    {
+        _memory = memory;
+        _capacity = capacity & ~(kAlignment - 1);
+        _head = 0;
+        _tail.store(0);
+    }
+
+    // allocates a contiguous region, returns false if there is not enough free space.
+    // regions never straddle the end of memory, the remaining bytes are skipped instead.
+    bool allocate(size_t size, size_t& offset)
+    {
+        if( _memory == nullptr || size == 0 || size > _capacity )
+            return false;
+
+        auto start = (_head + kAlignment - 1) & ~(uint64_t)(kAlignment - 1);
+        auto wrapped = start % _capacity;
+        if( wrapped + size > _capacity )
+            start += _capacity - wrapped;
+
+        if( start + size - _tail.load() > _capacity )
+            return false;
+
+        _head = start + size;
+        offset = (size_t)(start % _capacity);
+        return true;
+    }
+
+    // releases the memory before position, positions released already are ignored
+    void release(uint64_t position)
+    {
+        if( position > _tail.load() )
+            _tail.store(position);
+    }
+
+    bool is_valid() const { return _memory != nullptr; }
+    uint8_t* get_memory() const { return _memory; }
+    size_t get_capacity() const { return _capacity; }
+    // returns the end position of allocated regions
+    uint64_t get_position() const { return _head; }
+    // returns the number of bytes not released yet
+    size_t get_used() const { return (size_t)(_head - _tail.load()); }
+
+protected:
+    uint8_t* _memory = nullptr;
+    size_t _capacity = 0;
+    uint64_t _head = 0;
+    std::atomic<uint64_t> _tail { 0 };
+};
+
+NS_LEMON_GRAPHICS_END
@@ -14,10 +14,11 @@ struct CreateVertexBuffer : public FrameTask
     size_t size;
     VertexLayout layout;
     BufferUsage usage;
+    bool staged;
 
     void dispatch(RenderBackend& backend) override
     {
-        backend.create_vertex_buffer(handle, data, size, layout, usage);
+        backend.create_vertex_buffer(handle, data, size, layout, usage, staged);
     }
 };
 
@@ -27,10 +28,11 @@ struct UpdateVertexBuffer : public FrameTask
     uint16_t start;
     void* data;
     size_t size;
+    bool staged;
 
     void dispatch(RenderBackend& backend) override
     {
-        backend.update_vertex_buffer(handle, start, data, size);
+        backend.update_vertex_buffer(handle, start, data, size, staged);
     }
 };
 
@@ -51,10 +53,11 @@ struct CreateIndexBuffer : public FrameTask
     size_t size;
     IndexElementFormat format;
     BufferUsage usage;
+    bool staged;
 
     void dispatch(RenderBackend& backend) override
     {
-        backend.create_index_buffer(handle, data, size, format, usage);
+        backend.create_index_buffer(handle, data, size, format, usage, staged);
     }
 };
 
@@ -64,10 +67,11 @@ struct UpdateIndexBuffer : public FrameTask
     uint16_t start;
     void* data;
     size_t size;
+    bool staged;
 
     virtual void dispatch(RenderBackend& backend) override
     {
-        backend.update_index_buffer(handle, start, data, size);
+        backend.update_index_buffer(handle, start, data, size, staged);
     }
 };
 
@@ -86,10 +90,11 @@ struct CreateProgram : public FrameTask
     Handle handle;
     char* vs;
     char* fs;
+    ProgramBinary* binary;
 
     void dispatch(RenderBackend& backend) override
     {
-        backend.create_program(handle, vs, fs);
+        backend.create_program(handle, vs, fs, binary);
     }
 };
 
@@ -134,12 +139,27 @@ struct CreateTexture : public FrameTask
     TexturePixelFormat pixel_format;
     uint16_t width;
     uint16_t height;
+    uint8_t levels;
     BufferUsage usage;
+    bool staged;
 
     void dispatch(RenderBackend& backend) override
     {
         backend.create_texture(
-            handle, data, format, pixel_format, width, height, usage);
+            handle, data, format, pixel_format, width, height, levels, usage, staged);
+    }
+};
+
+struct UpdateTexture : public FrameTask
+{
+    Handle handle;
+    void* data;
+    uint8_t levels;
+    bool staged;
+
+    void dispatch(RenderBackend& backend) override
+    {
+        backend.update_texture(handle, data, levels, staged);
     }
 };
 
@@ -0,0 +1,13 @@
+// @date 2016/11/06
+// @author Mao Jingkai(oammix@gmail.com)
+
+#include <graphics/backend/uniform.hpp>
+
+NS_LEMON_GRAPHICS_BEGIN
+
+const size_t UniformArena::kChunkSize;
+const size_t UniformArena::kMaxChunks;
+const size_t UniformArena::kBlocksPerChunk;
+const size_t UniformArena::kMaxBlockChunks;
+
+NS_LEMON_GRAPHICS_END
@@ -0,0 +1,163 @@
+// @date 2016/11/06
+// @author Mao Jingkai(oammix@gmail.com)
+
+#pragma once
+
+#include <forwards.hpp>
+#include <graphics/graphics.hpp>
+#include <codebase/handle.hpp>
+#include <math/string_hash.hpp>
+#include <codebase/memory_tracker.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+NS_LEMON_GRAPHICS_BEGIN
+
+// an uniform variable stored in blocks, identified by name or by its slot in program
+struct UniformEntry
+{
+    math::StringHash name;
+    uint8_t slot;
+    UniformVariable value;
+};
+
+// the header of a block of uniforms, followed by num entries
+struct UniformBlock
+{
+    uint32_t num;
+    uint32_t used;
+
+    UniformEntry* entries() { return reinterpret_cast<UniformEntry*>(this+1); }
+};
+
+static_assert(sizeof(UniformBlock) % alignof(UniformEntry) == 0, "entries of block are misaligned.");
+
+// a linear arena of uniform blocks for one frame. blocks are allocated with atomic bumps
+// from chunks of raw memory, which are added as needed and kept for later frames. the
+// whole arena is reset at the end of frame, handles of blocks are versioned by a
+// generation of frames, so the ones from previous frames are not alive anymore.
+struct UniformArena
+{
+    const static size_t kChunkSize = 64 * 1024;
+    const static size_t kMaxChunks = 256;
+    const static size_t kBlocksPerChunk = kChunkSize / sizeof(uint32_t);
+    const static size_t kMaxBlockChunks = (Handle::invalid + kBlocksPerChunk - 1) / kBlocksPerChunk;
+
+    UniformArena();
+    ~UniformArena();
+
+    // resets the arena with a new generation of handles
+    void reset(Handle::index_t generation);
+    // allocates a block of num uniforms, returns an invalid handle if the arena is exhausted
+    Handle allocate(uint32_t num);
+    // returns the block of handle, nullptr if its not alive
+    UniformBlock* fetch(Handle) const;
+    // returns the number of bytes allocated by blocks
+    size_t get_used() const { return _position.load(); }
+
+protected:
+    uint8_t* get_chunk(std::atomic<uint8_t*>*, size_t);
+
+    Handle::index_t _generation = 0;
+    std::atomic<size_t> _position;
+    std::atomic<uint8_t*> _chunks[kMaxChunks];
+
+    // offsets of blocks, indexed by handles
+    std::atomic<uint32_t> _blocks;
+    std::atomic<uint8_t*> _block_chunks[kMaxBlockChunks];
+
+    std::mutex _mutex;
+};
+
+INLINE UniformArena::UniformArena()
+{
+    _position.store(0);
+    _blocks.store(0);
+    for( auto& chunk : _chunks ) chunk.store(nullptr);
+    for( auto& chunk : _block_chunks ) chunk.store(nullptr);
+}
+
+INLINE UniformArena::~UniformArena()
+{
+    auto release = [](std::atomic<uint8_t*>& chunk)
+    {
+        if( auto memory = chunk.load() )
+        {
+            track_free(MemoryTag::RENDER, kChunkSize);
+            delete[] memory;
+        }
+    };
+
+    for( auto& chunk : _chunks ) release(chunk);
+    for( auto& chunk : _block_chunks ) release(chunk);
+}
+
+INLINE void UniformArena::reset(Handle::index_t generation)
+{
+    _generation = generation;
+    _position.store(0);
+    _blocks.store(0);
+}
+
+INLINE uint8_t* UniformArena::get_chunk(std::atomic<uint8_t*>* chunks, size_t index)
+{
+    if( auto chunk = chunks[index].load() )
+        return chunk;
+
+    std::unique_lock<std::mutex> L(_mutex);
+    if( chunks[index].load() == nullptr )
+    {
+        auto chunk = new (std::nothrow) uint8_t[kChunkSize];
+        if( chunk != nullptr )
+            track_alloc(MemoryTag::RENDER, kChunkSize);
+        chunks[index].store(chunk);
+    }
+    return chunks[index].load();
+}
+
+INLINE Handle UniformArena::allocate(uint32_t num)
+{
+    auto size = sizeof(UniformBlock) + sizeof(UniformEntry) * num;
+    size = (size + alignof(UniformEntry) - 1) & ~(alignof(UniformEntry) - 1);
+    ASSERT(size <= kChunkSize, "too many uniforms(%d) in a block.", num);
+
+    // blocks never straddle chunks, the remaining bytes of chunk are skipped instead
+    size_t start;
+    do
+    {
+        start = _position.fetch_add(size);
+    } while( (start % kChunkSize) + size > kChunkSize );
+
+    auto index = _blocks.fetch_add(1);
+    if( start / kChunkSize >= kMaxChunks || index >= Handle::invalid )
+    {
+        LOGW("uniform arena exhausted.");
+        return Handle();
+    }
+
+    auto chunk = get_chunk(_chunks, start / kChunkSize);
+    auto table = get_chunk(_block_chunks, index / kBlocksPerChunk);
+    if( chunk == nullptr || table == nullptr )
+        return Handle();
+
+    auto block = reinterpret_cast<UniformBlock*>(chunk + start % kChunkSize);
+    block->num = num;
+    block->used = 0;
+
+    reinterpret_cast<uint32_t*>(table)[index % kBlocksPerChunk] = (uint32_t)start;
+    return Handle((Handle::index_t)index, _generation);
+}
+
+INLINE UniformBlock* UniformArena::fetch(Handle handle) const
+{
+    if( !handle.is_valid() || handle.get_version() != _generation || handle.get_index() >= _blocks.load() )
+        return nullptr;
+
+    auto table = _block_chunks[handle.get_index() / kBlocksPerChunk].load();
+    auto start = reinterpret_cast<uint32_t*>(table)[handle.get_index() % kBlocksPerChunk];
+    return reinterpret_cast<UniformBlock*>(_chunks[start / kChunkSize].load() + start % kChunkSize);
+}
+
+NS_LEMON_GRAPHICS_END
@@ -20,8 +20,12 @@ struct RenderDrawCall
     Handle buffer_index;
     // offsets to identifies the uniforms buffer used by this draw call
     Handle uniforms;
-    // its common to have some shared uniforms such like view and projection matrix
+    // its common to have some shared uniforms such like the ones of material
     Handle shared_uniforms;
+    // uniforms of the view such like view and projection matrix, which are applied once
+    // per program for consecutive draw calls of the same view. they should not be
+    // overridden by the other uniforms.
+    Handle view_uniforms;
     // specifies the offset and count of indices or vertices to be drawed
     uint16_t first, num;
 };
@@ -2,6 +2,7 @@
 // @author Mao Jingkai(oammix@gmail.com)
 
 #include <core/task.hpp>
+#include <core/profiler.hpp>
 
 #include <graphics/frontend.hpp>
 #include <graphics/backend/backend.hpp>
@@ -17,6 +18,7 @@ bool RenderFrontend::initialize()
 
     _draw = nullptr;
     _submit = _frames[0];
+    _submit->_uniforms.reset(_generation);
     _backend.reset(new RenderBackend());
     return true;
 }
@@ -50,8 +52,12 @@ Handle RenderFrontend::create_vertex_buffer(
         cvb->layout = layout;
         cvb->usage = usage;
         cvb->size = size;
-        cvb->data = _submit->allocate(size);
-        memcpy(cvb->data, data, size);
+        cvb->staged = stage(data, size, cvb->data);
+        if( !cvb->staged )
+        {
+            cvb->data = _submit->allocate(size);
+            memcpy(cvb->data, data, size);
+        }
         return handle;
     }
 
@@ -67,8 +73,12 @@ void RenderFrontend::update_vertex_buffer(
         uvb->handle = handle;
         uvb->start = start;
         uvb->size = size;
-        uvb->data = _submit->allocate(size);
-        memcpy(uvb->data, data, size);
+        uvb->staged = stage(data, size, uvb->data);
+        if( !uvb->staged )
+        {
+            uvb->data = _submit->allocate(size);
+            memcpy(uvb->data, data, size);
+        }
     }
 }
 
@@ -91,8 +101,12 @@ Handle RenderFrontend::create_index_buffer(
         cib->format = format;
         cib->usage = usage;
         cib->size = size;
-        cib->data = _submit->allocate(size);
-        memcpy(cib->data, data, size);
+        cib->staged = stage(data, size, cib->data);
+        if( !cib->staged )
+        {
+            cib->data = _submit->allocate(size);
+            memcpy(cib->data, data, size);
+        }
         return handle;
     }
 
@@ -108,8 +122,12 @@ void RenderFrontend::update_index_buffer(
         uvb->handle = handle;
         uvb->start = start;
         uvb->size = size;
-        uvb->data = _submit->allocate(size);
-        memcpy(uvb->data, data, size);
+        uvb->staged = stage(data, size, uvb->data);
+        if( !uvb->staged )
+        {
+            uvb->data = _submit->allocate(size);
+            memcpy(uvb->data, data, size);
+        }
     }
 }
 
@@ -138,6 +156,7 @@ void RenderFrontend::update_render_state(Handle handle, const RenderState& in)
     if( auto state = _states.fetch(handle) )
     {
         *state = in;
+        _submit->update_state(handle, in);
     }
 }
 
@@ -147,19 +166,28 @@ void RenderFrontend::free_render_state(Handle handle)
 }
 
 Handle RenderFrontend::create_program(const char* vs, const char* fs)
+{
+    return create_program(vs, fs, nullptr);
+}
+
+Handle RenderFrontend::create_program(const char* vs, const char* fs, std::shared_ptr<ProgramBinary> binary)
 {
     if( auto handle = _material_handles.create() )
     {
         auto cp = _submit->create_task<CreateProgram>();
         cp->handle = handle;
+        cp->binary = binary.get();
 
         auto vs_len = strlen(vs);
         cp->vs = (char*)_submit->allocate(vs_len+1);
-        strncpy(cp->vs, vs, vs_len);
+        memcpy(cp->vs, vs, vs_len+1);
 
         auto fs_len = strlen(fs);
         cp->fs = (char*)_submit->allocate(fs_len+1);
-        strncpy(cp->fs, fs, fs_len);
+        memcpy(cp->fs, fs, fs_len+1);
+
+        if( binary != nullptr )
+            _submit->retain(std::move(binary));
         return handle;
     }
 
@@ -218,11 +246,77 @@ Handle RenderFrontend::create_texture(
         cib->pixel_format = pixel_format;
         cib->width = width;
         cib->height = height;
+        cib->levels = 1;
         cib->usage = usage;
 
         auto size = size_of_texture(format, pixel_format, width, height);
-        cib->data = _submit->allocate(size);
-        memcpy(cib->data, data, size);
+        cib->staged = stage(data, size, cib->data);
+        if( !cib->staged )
+        {
+            cib->data = _submit->allocate(size);
+            memcpy(cib->data, data, size);
+        }
+        return handle;
+    }
+
+    return Handle();
+}
+
+Handle RenderFrontend::create_texture(
+    std::shared_ptr<const void> data,
+    TextureFormat format, TexturePixelFormat pixel_format,
+    uint16_t width, uint16_t height,
+    BufferUsage usage)
+{
+    return create_texture(std::move(data), format, pixel_format, width, height, 1, usage);
+}
+
+Handle RenderFrontend::create_texture(
+    std::shared_ptr<const void> data,
+    TextureFormat format, TexturePixelFormat pixel_format,
+    uint16_t width, uint16_t height, uint8_t levels,
+    BufferUsage usage)
+{
+    if( auto handle = _texture_handles.create() )
+    {
+        auto cib = _submit->create_task<CreateTexture>();
+        cib->handle = handle;
+        cib->format = format;
+        cib->pixel_format = pixel_format;
+        cib->width = width;
+        cib->height = height;
+        cib->levels = levels;
+        cib->usage = usage;
+
+        // the storage is allocated now, and the contents are streamed in following frames
+        // if exceeding the budget. pending uploads are kept in order. the ones that never
+        // fit into staging memory are read from client memory directly.
+        auto size = size_of_texture(format, pixel_format, width, height, levels);
+        size_t position;
+        {
+            std::unique_lock<std::mutex> L(_staging_mutex);
+            if( _staging.is_valid() && size <= _staging.get_capacity() )
+            {
+                cib->staged = _pending_uploads.empty() && allocate_staging(size, position);
+                if( !cib->staged )
+                {
+                    cib->data = nullptr;
+                    _pending_uploads.push_back({ handle, std::move(data), size, levels });
+                    return handle;
+                }
+            }
+        }
+
+        if( cib->staged )
+        {
+            memcpy(_staging.get_memory() + position, data.get(), size);
+            cib->data = (uint8_t*)0 + position;
+        }
+        else
+        {
+            cib->data = const_cast<void*>(data.get());
+            _submit->retain(std::move(data));
+        }
         return handle;
     }
 
@@ -273,56 +367,106 @@ void RenderFrontend::free_texture(Handle handle)
 
 Handle RenderFrontend::allocate_uniform_buffer(size_t num)
 {
-    if( auto handle = _ub_views.create() )
-    {
-        auto object = _ub_views.fetch(handle);
-        object->first = _uniform_buffer._position.fetch_add(num);
-        object->num = num;
-        object->used = 0;
-
-        ASSERT(_uniform_buffer._position.load() < kMaxUniforms,
-            "too many uniform (%d) update requests.", kMaxUniforms);
-        return handle;
-    }
-
-    return Handle();
+    return _submit->_uniforms.allocate(num);
 }
 
 bool RenderFrontend::is_uniform_buffer_alive(Handle handle) const
 {
-    return _ub_views.is_alive(handle);
+    return _submit->_uniforms.fetch(handle) != nullptr;
 }
 
 void RenderFrontend::update_uniform_buffer(
     Handle handle, math::StringHash hash, const UniformVariable& value)
 {
-    if( auto object = _ub_views.fetch(handle) )
+    if( auto block = _submit->_uniforms.fetch(handle) )
     {
-        for( uint32_t i = object->first; i < object->first+object->used; i++ )
+        auto entries = block->entries();
+        for( uint32_t i = 0; i < block->used; i++ )
         {
-            if( _uniform_buffer._names[i] == hash )
+            if( entries[i].slot == kInvalidUniformSlot && entries[i].name == hash )
             {
-                _uniform_buffer._values[i] = value;
+                entries[i].value = value;
                 return;
             }
         }
 
-        ASSERT(object->used < object->num, "update uniforms out-of-range.");
-        
-        auto index = object->first + object->used++;
-        _uniform_buffer._names[index] = hash;
-        _uniform_buffer._values[index] = value;
+        ASSERT(block->used < block->num, "update uniforms out-of-range.");
+
+        ::new (&entries[block->used++]) UniformEntry { hash, kInvalidUniformSlot, value };
     }
 }
 
+void RenderFrontend::update_uniform_buffer(
+    Handle handle, uint8_t slot, const UniformVariable& value)
+{
+    if( auto block = _submit->_uniforms.fetch(handle) )
+    {
+        auto entries = block->entries();
+        for( uint32_t i = 0; i < block->used; i++ )
+        {
+            if( entries[i].slot == slot )
+            {
+                entries[i].value = value;
+                return;
+            }
+        }
+
+        ASSERT(block->used < block->num, "update uniforms out-of-range.");
+
+        ::new (&entries[block->used++]) UniformEntry { math::StringHash(), slot, value };
+    }
+}
+
+void RenderFrontend::set_upload_budget(size_t bytes)
+{
+    std::unique_lock<std::mutex> L(_staging_mutex);
+    _upload_budget = bytes;
+}
+
+bool RenderFrontend::allocate_staging(size_t size, size_t& position)
+{
+    // the first upload of frame is always accepted, so large ones could make progress
+    if( _uploaded > 0 && _uploaded + size > _upload_budget )
+        return false;
+
+    if( !_staging.allocate(size, position) )
+        return false;
+
+    _uploaded += size;
+    return true;
+}
+
+bool RenderFrontend::stage(const void* data, size_t size, void*& offset)
+{
+    size_t position;
+
+    {
+        std::unique_lock<std::mutex> L(_staging_mutex);
+        if( !allocate_staging(size, position) )
+            return false;
+    }
+
+    memcpy(_staging.get_memory() + position, data, size);
+    offset = (uint8_t*)0 + position;
+    return true;
+}
+
 bool RenderFrontend::restore_video_context(SDL_Window* window)
 {
-    return _backend->initialize(window);
+    if( !_backend->initialize(window) )
+        return false;
+
+    std::unique_lock<std::mutex> L(_staging_mutex);
+    _staging.reset(_backend->get_staging_memory(), _backend->get_staging_capacity());
+    return true;
 }
 
 void RenderFrontend::dispose_video_context()
 {
     _backend->dispose();
+
+    std::unique_lock<std::mutex> L(_staging_mutex);
+    _staging.reset(nullptr, 0);
 }
 
 bool RenderFrontend::begin_frame()
@@ -330,8 +474,56 @@ bool RenderFrontend::begin_frame()
     if( _backend->is_device_lost() )
         return false;
 
-    _ub_views.clear();
-    _uniform_buffer._position.store(0);
+    {
+        std::unique_lock<std::mutex> L(_staging_mutex);
+        _uploaded = 0;
+    }
+
+    // streams the pending contents of textures within the budget. the staging memory
+    // might be lost or shrunk since they were queued, those are read from client memory.
+    for( ;; )
+    {
+        PendingUpload upload;
+        size_t position;
+        bool staged = false;
+
+        {
+            std::unique_lock<std::mutex> L(_staging_mutex);
+            if( _pending_uploads.empty() )
+                break;
+
+            auto& front = _pending_uploads.front();
+            if( _texture_handles.is_alive(front.handle) &&
+                _staging.is_valid() && front.size <= _staging.get_capacity() )
+            {
+                if( !allocate_staging(front.size, position) )
+                    break;
+                staged = true;
+            }
+
+            upload = std::move(front);
+            _pending_uploads.pop_front();
+        }
+
+        if( !_texture_handles.is_alive(upload.handle) )
+            continue;
+
+        auto ut = _submit->create_task<UpdateTexture>();
+        ut->handle = upload.handle;
+        ut->levels = upload.levels;
+        ut->staged = staged;
+        if( staged )
+        {
+            memcpy(_staging.get_memory() + position, upload.data.get(), upload.size);
+            ut->data = (uint8_t*)0 + position;
+        }
+        else
+        {
+            ut->data = const_cast<void*>(upload.data.get());
+            _submit->retain(std::move(upload.data));
+        }
+    }
+
     return true;
 }
 
@@ -347,18 +539,34 @@ void RenderFrontend::clear(
 
 void RenderFrontend::submit(const RenderDrawCall& drawcall)
 {
-    _submit->submit(drawcall);
+    _submit->submit(drawcall, _states.fetch(drawcall.state));
 }
 
 void RenderFrontend::flush()
 {
     auto task = core::get_subsystem<core::TaskSystem>();
-    task->wait(_paint);
+    {
+        PROFILE_SCOPE("graphics.wait");
+        auto start = std::chrono::high_resolution_clock::now();
+        task->wait(_paint);
+        _wait_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    }
 
     ENSURE(_draw == nullptr);
+    {
+        std::unique_lock<std::mutex> L(_staging_mutex);
+        _submit->_staging_position = _staging.get_position();
+    }
+
     _draw = _submit;
     _submit = _submit == _frames[0] ? _frames[1] : _frames[0];
 
+    // uniform buffers of the drawn frame are recycled as a whole
+    if( ++_generation == Handle::invalid )
+        _generation = 0;
+    _submit->_uniforms.reset(_generation);
+
     _paint = task->create("graphics.draw", &RenderFrontend::draw, this);
     task->run(_paint);
 }
@@ -370,13 +578,26 @@ void RenderFrontend::end_frame()
 
 void RenderFrontend::draw()
 {
+    auto start = std::chrono::high_resolution_clock::now();
     if( _backend->begin_frame() )
     {
-        for( size_t i = 0; i < _draw->_packet_tail; i++ )
+        // the view uniforms applied to programs
+        Handle views[kMaxProgram];
+
+        // staging memory consumed by device could be written again
+        _staging.release(_backend->poll_staging());
+
         {
-            _draw->_packets[i]->dispatch(*_backend);
+            PROFILE_SCOPE("graphics.dispatch");
+            for( size_t i = 0; i < _draw->_packet_tail; i++ )
+            {
+                _draw->_packets[i]->dispatch(*_backend);
+            }
         }
 
+        _backend->fence_staging(_draw->_staging_position);
+
+        PROFILE_SCOPE("graphics.drawcalls");
         for( auto dc : _draw->_drawcalls )
         {
             if( dc.num <= 0 )
@@ -386,7 +607,7 @@ void RenderFrontend::draw()
             _backend->set_vertex_buffer(dc.buffer_vertex);
             _backend->set_index_buffer(dc.buffer_index);
 
-            if( auto state = _states.fetch(dc.state) )
+            if( auto state = _draw->get_state(dc.state) )
             {
                 _backend->set_scissor_test(
                     state->scissor.enable,
@@ -430,25 +651,32 @@ void RenderFrontend::draw()
                     state->stencil_write.mask);
             }
 
-            if( auto shared_uniforms = _ub_views.fetch(dc.shared_uniforms) )
+            auto& view = views[dc.program.get_index()];
+            if( view != dc.view_uniforms )
             {
-                uint32_t end = shared_uniforms->first + shared_uniforms->used;
-                for( uint32_t i = shared_uniforms->first; i < end; i++ )
+                if( auto block = _draw->_uniforms.fetch(dc.view_uniforms) )
                 {
-                    _backend->update_program_uniform(dc.program,
-                        _uniform_buffer._names[i],
-                        _uniform_buffer._values[i]);
+                    auto entries = block->entries();
+                    for( uint32_t i = 0; i < block->used; i++ )
+                        _backend->update_program_uniform(dc.program, entries[i].name, entries[i].value);
                 }
+
+                view = dc.view_uniforms;
             }
 
-            if( auto uniforms = _ub_views.fetch(dc.uniforms) )
+            for( auto handle : { dc.shared_uniforms, dc.uniforms } )
             {
-                uint32_t end = uniforms->first + uniforms->used;
-                for( uint32_t i = uniforms->first; i < end; i++ )
+                if( auto block = _draw->_uniforms.fetch(handle) )
                 {
-                    _backend->update_program_uniform(dc.program,
-                        _uniform_buffer._names[i],
-                        _uniform_buffer._values[i]);
+                    auto entries = block->entries();
+                    for( uint32_t i = 0; i < block->used; i++ )
+                    {
+                        // uniforms with slots resolved are applied by indexing
+                        if( entries[i].slot != kInvalidUniformSlot )
+                            _backend->update_program_uniform(dc.program, entries[i].slot, entries[i].value);
+                        else
+                            _backend->update_program_uniform(dc.program, entries[i].name, entries[i].value);
+                    }
                 }
             }
 
@@ -456,9 +684,16 @@ void RenderFrontend::draw()
         }
     }
 
-    _backend->end_frame();
+    {
+        PROFILE_SCOPE("graphics.present");
+        _backend->end_frame();
+    }
+
     _draw->clear();
     _draw = nullptr;
+
+    _draw_duration.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::high_resolution_clock::now() - start).count());
 }
 
 NS_LEMON_GRAPHICS_END
@@ -10,6 +10,8 @@
 #include <graphics/drawcall.hpp>
 #include <graphics/state.hpp>
 
+#include <graphics/backend/staging.hpp>
+
 #include <codebase/handle_object_set.hpp>
 
 #include <math/color.hpp>
@@ -17,6 +19,9 @@
 
 #include <string>
 #include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
 
 NS_LEMON_GRAPHICS_BEGIN
 
@@ -57,6 +62,15 @@ NS_LEMON_GRAPHICS_BEGIN
 // individual bits. Depending on where those bits are stored in the key,
 // we can apply different sorting criteria for the same array of draw calls.
 // 
+// The frame is pipelined in two stages. The main thread runs the simulation
+// and extracts the draw calls of frame N+1 into the submit buffer, while
+// a worker of task scheduler is consuming frame N from the draw buffer.
+// Everything the backend reads (tasks, uniforms, render states and the
+// memory referenced) is snapshotted into the frame when submitted, so the
+// next simulation never waits for the previous draw until flush. Updates of
+// render state are applied to its snapshot in the submit buffer, so all the
+// draw calls of a frame are drawn with its latest state.
+// 
 // Finally, stateful draw call and render state manipulation is error-prone,
 // and a bad abstraction. Ideally, submitting a draw call with whatever
 // state we want should not affect any of the other draw calls, even in
@@ -150,6 +164,47 @@ struct RenderFrontend : public core::Subsystem
         uint16_t width, uint16_t height,
         BufferUsage usage);
 
+    /**
+     * @brief      Creates a texture without copying the data, the memory is referenced
+     * by current frame until its drawn.
+     *
+     * @param[in]  data          The shared data of texture, should not be modified before drawn.
+     * @param[in]  format        The format.
+     * @param[in]  pixel_format  The pixel format.
+     * @param[in]  width         The width.
+     * @param[in]  height        The height.
+     * @param[in]  usage         The buffer usage.
+     *
+     * @return     Returns unique handle of texture.
+     */
+    Handle create_texture(
+        std::shared_ptr<const void> data,
+        TextureFormat format, TexturePixelFormat pixel_format,
+        uint16_t width, uint16_t height,
+        BufferUsage usage);
+
+    /**
+     * @brief      Creates a texture with a pre-baked mip chain without copying the data,
+     * the levels are uploaded directly instead of being generated on device. if staging
+     * memory is available, the data is copied into it and released immediately, and the
+     * contents exceeding the upload budget are streamed in following frames.
+     *
+     * @param[in]  data          The shared levels of texture, stored contiguously from the largest one.
+     * @param[in]  format        The format.
+     * @param[in]  pixel_format  The pixel format.
+     * @param[in]  width         The width of the largest level.
+     * @param[in]  height        The height of the largest level.
+     * @param[in]  levels        The number of levels.
+     * @param[in]  usage         The buffer usage.
+     *
+     * @return     Returns unique handle of texture.
+     */
+    Handle create_texture(
+        std::shared_ptr<const void> data,
+        TextureFormat format, TexturePixelFormat pixel_format,
+        uint16_t width, uint16_t height, uint8_t levels,
+        BufferUsage usage);
+
     /**
      * @brief      Generate/destroy mipmap of texture.
      *
@@ -194,6 +249,19 @@ struct RenderFrontend : public core::Subsystem
      */
     Handle create_program(const char* vs, const char* ps);
 
+    /**
+     * @brief      Creates program with a binary cache, which is loaded instead of compiling
+     * and linking shaders if available. otherwise the linked program is retrieved into it
+     * when the frame is drawn, if the driver supports.
+     *
+     * @param[in]  VS      Vertex shader.
+     * @param[in]  PS      Fragment shader.
+     * @param[in]  binary  The shared binary of program.
+     *
+     * @return     Returns unique handle of program.
+     */
+    Handle create_program(const char* vs, const char* ps, std::shared_ptr<ProgramBinary> binary);
+
     /**
      * @brief      Creates an uniform belongs to program.
      *
@@ -244,7 +312,8 @@ struct RenderFrontend : public core::Subsystem
     void free_render_state(Handle handle);
 
     /**
-     * @brief      Allocate an managed uniform buffer, it will be recycled at the end of frame.
+     * @brief      Allocate an managed uniform buffer from the uniform arena of current frame,
+     * it will be recycled at the end of frame. its safe to be called from any thread.
      *
      * @param[in]  num   The size of uniform buffer.
      *
@@ -271,6 +340,27 @@ struct RenderFrontend : public core::Subsystem
     void update_uniform_buffer(
         Handle handle, math::StringHash name, const UniformVariable& value);
 
+    /**
+     * @brief      Update uniform variable by its slot, which is the index of uniform in the
+     * order of creation with create_program_uniform. the uniform buffer should be used with
+     * the same program, and applied by indexing without lookups.
+     *
+     * @param[in]  handle  The handle of uniform buffer.
+     * @param[in]  slot    The slot of uniform constants.
+     * @param[in]  value   The value of uniform constants.
+     */
+    void update_uniform_buffer(
+        Handle handle, uint8_t slot, const UniformVariable& value);
+
+    /**
+     * @brief      Set the budget of uploads through staging memory per frame. the contents
+     * of textures exceeding the budget are uploaded in following frames, and the uploads of
+     * buffers fall back to be copied from client memory.
+     *
+     * @param[in]  bytes  The budget in bytes.
+     */
+    void set_upload_budget(size_t bytes);
+
     /**
      * @brief      Begins a frame.
      *
@@ -297,7 +387,9 @@ struct RenderFrontend : public core::Subsystem
     void submit(const RenderDrawCall& drawcall);
 
     /**
-     * @brief      Force to sync render thread and wait for performing all drawcalls.
+     * @brief      Waits for the draw of previous frame, swaps the command buffers and
+     * starts drawing current frame asynchronously. the simulation of next frame runs
+     * while this frame is drawing.
      */
     void flush();
 
@@ -306,25 +398,33 @@ struct RenderFrontend : public core::Subsystem
      */
     void end_frame();
 
+    /**
+     * @brief      Returns the duration of the latest completed draw on render thread.
+     */
+    std::chrono::nanoseconds get_draw_duration() const;
+
+    /**
+     * @brief      Returns the duration waited for render thread in the latest flush.
+     */
+    std::chrono::nanoseconds get_wait_duration() const;
+
 protected:
     friend struct WindowDevice;
     bool restore_video_context(SDL_Window*);
     void dispose_video_context();
     void draw();
+    // copies data into staging memory within the budget, returns the offset of it
+    bool stage(const void*, size_t, void*&);
+    // reserves staging memory within the budget, _staging_mutex must be held
+    bool allocate_staging(size_t, size_t&);
 
 protected:
-    struct UniformBuffer
+    struct PendingUpload
     {
-        std::atomic<uint32_t> _position;
-        math::StringHash _names[kMaxUniforms];
-        UniformVariable _values[kMaxUniforms];
-    };
-
-    struct UniformBufferView
-    {
-        uint32_t first;
-        uint32_t num;
-        uint32_t used;
+        Handle handle;
+        std::shared_ptr<const void> data;
+        size_t size;
+        uint8_t levels;
     };
 
 protected:
@@ -339,9 +439,32 @@ protected:
     HandleSet<kMaxVertexBuffer> _vb_handles;
     HandleSet<kMaxTexture> _texture_handles;
 
-    UniformBuffer _uniform_buffer;
-    HandleObjectSet<UniformBufferView, kMaxUniforms> _ub_views;
+    // uploads are written into persistently mapped memory directly, and copied on device.
+    // the ring, budget and pending uploads are guarded by _staging_mutex, since resources
+    // could be created from any thread.
+    std::mutex _staging_mutex;
+    StagingRing _staging;
+    size_t _upload_budget = 4 * 1024 * 1024;
+    size_t _uploaded = 0;
+    std::deque<PendingUpload> _pending_uploads;
+
+    // durations of the latest draw and wait in nanoseconds
+    std::atomic<uint64_t> _draw_duration { 0 };
+    uint64_t _wait_duration = 0;
+
+    // generation of uniform arenas, which versions the handles of uniform buffers
+    Handle::index_t _generation = 0;
     HandleObjectSet<RenderState, kMaxRenderState> _states;
 };
 
+INLINE std::chrono::nanoseconds RenderFrontend::get_draw_duration() const
+{
+    return std::chrono::nanoseconds(_draw_duration.load());
+}
+
+INLINE std::chrono::nanoseconds RenderFrontend::get_wait_duration() const
+{
+    return std::chrono::nanoseconds(_wait_duration);
+}
+
 NS_LEMON_GRAPHICS_END
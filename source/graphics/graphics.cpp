@@ -2,6 +2,7 @@
 // @author Mao Jingkai(oammix@gmail.com)
 
 #include <graphics/graphics.hpp>
+#include <algorithm>
 
 NS_LEMON_GRAPHICS_BEGIN
 
@@ -109,14 +110,42 @@ size_t size_of_texture(
     TextureFormat format, TexturePixelFormat pixel_format,
     uint16_t width, uint16_t height)
 {
-    if( pixel_format == TexturePixelFormat::UBYTE )
+    if( is_compressed_texture(format) )
     {
-        return width * height * FORMAT_COMPONENT_SIZE[value(format)];
+        // compressed in blocks of 4x4 texels
+        size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+        return blocks * (format == TextureFormat::COMPRESSED_RGBA_DXT5 ? 16 : 8);
+    }
+    else if( pixel_format == TexturePixelFormat::UBYTE )
+    {
+        return (size_t)width * height * FORMAT_COMPONENT_SIZE[value(format)];
     }
     else
     {
-        return width * height * 2;
+        return (size_t)width * height * 2;
+    }
+}
+
+size_t size_of_texture(
+    TextureFormat format, TexturePixelFormat pixel_format,
+    uint16_t width, uint16_t height, uint8_t levels)
+{
+    size_t size = 0;
+    for( uint8_t i = 0; i < levels; i++ )
+    {
+        size += size_of_texture(format, pixel_format, width, height);
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
     }
+    return size;
+}
+
+bool is_compressed_texture(TextureFormat format)
+{
+    return
+        format == TextureFormat::COMPRESSED_RGB_DXT1 ||
+        format == TextureFormat::COMPRESSED_RGBA_DXT5 ||
+        format == TextureFormat::COMPRESSED_RGB_ETC1;
 }
 
 NS_LEMON_GRAPHICS_END
@@ -12,6 +12,9 @@
 #include <codebase/enumeration.hpp>
 #include <codebase/variant.hpp>
 
+#include <mutex>
+#include <vector>
+
 NS_LEMON_GRAPHICS_BEGIN
 
 // specifies what kind of primitives to render.
@@ -175,7 +178,11 @@ enum class TextureFormat : uint8_t
     RGB,
     RGBA,
     LUMINANCE,
-    LUMINANCE_ALPHA
+    LUMINANCE_ALPHA,
+    // block-compressed formats, the pixel format is ignored
+    COMPRESSED_RGB_DXT1,
+    COMPRESSED_RGBA_DXT5,
+    COMPRESSED_RGB_ETC1
 };
 
 // Specifies the data type of the texel data.
@@ -193,6 +200,20 @@ enum class TexturePixelFormat : uint8_t
 
 // Calculate the size of texture.
 size_t size_of_texture(TextureFormat, TexturePixelFormat, uint16_t, uint16_t);
+// Calculate the size of a mip chain, which starts from the level with specified size.
+size_t size_of_texture(TextureFormat, TexturePixelFormat, uint16_t, uint16_t, uint8_t);
+// Returns true if the texture format is block-compressed.
+bool is_compressed_texture(TextureFormat);
+
+// A linked program in the driver specific format. its loaded instead of compiling
+// sources if available, otherwise its retrieved from the driver after linking. the
+// backend fills it on render thread, so accesses should be guarded by mutex.
+struct ProgramBinary
+{
+    std::mutex mutex;
+    uint32_t format = 0;
+    std::vector<uint8_t> data;
+};
 
 // INCLUDED IMPLEMENTATIONS of VERTEX LAYOUT
 template<>
@@ -4,6 +4,7 @@
 #include <core/ecs.hpp>
 #include <core/event.hpp>
 #include <core/task.hpp>
+#include <core/profiler.hpp>
 
 #include <math/vector.hpp>
 #include <math/matrix.hpp>
@@ -21,6 +22,7 @@
 #include <resource/archives.hpp>
 #include <resource/resource.hpp>
 #include <resource/image.hpp>
+#include <resource/pixel.hpp>
 #include <resource/shader.hpp>
 #include <resource/primitive.hpp>
 #include <resource/material.hpp>
@@ -30,6 +32,8 @@
 #include <scene/camera.hpp>
 
 #include <engine/input.hpp>
+#include <engine/statistics.hpp>
+#include <engine/timestep.hpp>
 #include <engine/engine.hpp>
 #include <engine/application.hpp>
 
@@ -2,61 +2,418 @@
 // @author Mao Jingkai(oammix@gmail.com)
 
 #include <resource/archives.hpp>
+#include <math/string_hash.hpp>
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 NS_LEMON_RESOURCE_BEGIN
 
+#ifdef __linux__
+static const uint32_t s_watch_events = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+#endif
+
+// paths might be out of the tree are verified with filesystem instead of the index,
+// including the ones with parent references which are not always compressed
+static bool is_indexable(const fs::Path& path)
+{
+    return !path.is_absolute() && !path.is_empty() && path.to_string().find("..") == std::string::npos;
+}
+
 FilesystemArchive::FilesystemArchive(ArchiveCollection& collection,
-    const fs::Path& path)
-: Archive(collection), _prefix(path)
+    const fs::Path& path, bool watch)
+: Archive(collection), _prefix(path), _watch(watch)
 {}
 
+FilesystemArchive::~FilesystemArchive()
+{
+#ifdef __linux__
+    if( _watcher >= 0 )
+        close(_watcher);
+#endif
+}
+
 bool FilesystemArchive::initialize()
 {
     if( !_prefix.is_absolute() )
         _prefix = fs::get_current_directory() / _prefix;
+
+    refresh();
     return true;
 }
 
+void FilesystemArchive::refresh()
+{
+    std::unique_lock<std::mutex> L(_mutex);
+    _index.clear();
+    _watches.clear();
+
+#ifdef __linux__
+    if( _watcher >= 0 )
+        close(_watcher);
+
+    _watcher = _watch ? inotify_init1(IN_NONBLOCK | IN_CLOEXEC) : -1;
+    if( _watch && _watcher < 0 )
+        LOGW("failed to watch \"%s\", changes would be visible after refreshed.", _prefix.c_str());
+#endif
+
+    index_directory(std::string());
+}
+
+size_t FilesystemArchive::get_indexed() const
+{
+    std::unique_lock<std::mutex> L(_mutex);
+    return _index.size();
+}
+
+void FilesystemArchive::index_directory(const std::string& relative)
+{
+    const auto& prefix = _prefix.to_string();
+    const auto directory = relative.empty() ? _prefix : _prefix / relative;
+    auto strip = [&](const fs::Path& path)
+    {
+        return path.to_string().substr(prefix.size() + (prefix.size() == 1 ? 0 : 1));
+    };
+
+#ifdef __linux__
+    // directories are watched before scanning, so the files created meanwhile are not missed
+    if( _watcher >= 0 )
+    {
+        auto watch = inotify_add_watch(_watcher, directory.c_str(), s_watch_events);
+        if( watch >= 0 )
+            _watches[watch] = relative;
+
+        for( auto& path : fs::scan(directory, fs::ScanMode::DIRECTORIES | fs::ScanMode::RECURSIVE | fs::ScanMode::HIDDEN) )
+        {
+            watch = inotify_add_watch(_watcher, path.c_str(), s_watch_events);
+            if( watch >= 0 )
+                _watches[watch] = strip(path);
+        }
+    }
+#endif
+
+    for( auto& path : fs::scan(directory, fs::ScanMode::FILES | fs::ScanMode::RECURSIVE | fs::ScanMode::HIDDEN) )
+        _index.insert(strip(path));
+}
+
+void FilesystemArchive::remove_directory(const std::string& relative)
+{
+    auto prefix = relative + fs::Path::sperator;
+    auto is_child = [&](const std::string& name)
+    {
+        return name.compare(0, prefix.size(), prefix) == 0;
+    };
+
+    for( auto iter = _index.begin(); iter != _index.end(); )
+    {
+        if( is_child(*iter) )
+            iter = _index.erase(iter);
+        else
+            ++iter;
+    }
+
+#ifdef __linux__
+    // watches of removed directories are dropped by kernel, but the moved ones are not
+    for( auto iter = _watches.begin(); iter != _watches.end(); )
+    {
+        if( iter->second == relative || is_child(iter->second) )
+        {
+            inotify_rm_watch(_watcher, iter->first);
+            iter = _watches.erase(iter);
+        }
+        else
+            ++iter;
+    }
+#endif
+}
+
+void FilesystemArchive::apply_changes()
+{
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[4096];
+    bool overflow = false;
+
+    ssize_t size;
+    while( (size = read(_watcher, buffer, sizeof(buffer))) > 0 )
+    {
+        for( auto cursor = buffer; cursor < buffer + size; )
+        {
+            auto event = reinterpret_cast<const struct inotify_event*>(cursor);
+            cursor += sizeof(struct inotify_event) + event->len;
+
+            if( event->mask & IN_Q_OVERFLOW )
+            {
+                overflow = true;
+                continue;
+            }
+
+            auto found = _watches.find(event->wd);
+            if( found == _watches.end() )
+                continue;
+
+            if( event->mask & IN_IGNORED )
+            {
+                _watches.erase(found);
+                continue;
+            }
+
+            if( event->len == 0 )
+                continue;
+
+            auto name = found->second.empty() ?
+                std::string(event->name) : found->second + fs::Path::sperator + event->name;
+
+            if( event->mask & (IN_CREATE | IN_MOVED_TO) )
+            {
+                if( event->mask & IN_ISDIR )
+                    index_directory(name);
+                else
+                    _index.insert(std::move(name));
+            }
+            else if( event->mask & (IN_DELETE | IN_MOVED_FROM) )
+            {
+                if( event->mask & IN_ISDIR )
+                    remove_directory(name);
+                else
+                    _index.erase(name);
+            }
+        }
+    }
+
+    // events are lost, rescans the whole tree
+    if( overflow )
+    {
+        _index.clear();
+        for( auto& pair : _watches )
+            inotify_rm_watch(_watcher, pair.first);
+        _watches.clear();
+        index_directory(std::string());
+    }
+#endif
+}
+
 bool FilesystemArchive::is_exist(const fs::Path& path)
 {
-    return fs::is_regular_file(_prefix / path);
+    if( !is_indexable(path) )
+        return fs::is_regular_file(_prefix / path);
+
+    std::unique_lock<std::mutex> L(_mutex);
+    return _index.find(path.to_string()) != _index.end();
 }
 
+// stale entries of files removed since indexed fail to open, and are skipped by collection
 std::fstream FilesystemArchive::open(const fs::Path& path, fs::FileMode mode)
 {
     return fs::open(_prefix / path, mode);
 }
 
+fs::MappedFile FilesystemArchive::map(const fs::Path& path)
+{
+    return fs::map_file(_prefix / path);
+}
+
+void FilesystemArchive::update()
+{
+    if( !is_watching() )
+        return;
+
+    std::unique_lock<std::mutex> L(_mutex);
+    apply_changes();
+}
+
+static const char s_package_magic[4] = { 'L', 'P', 'A', 'K' };
+
+static bool write_padding(std::fstream& stream, uint32_t alignment)
+{
+    static const char zeros[PackageArchive::kAlignment] = { 0 };
+
+    auto position = (uint64_t)stream.tellp();
+    auto padding = (alignment - position % alignment) % alignment;
+    stream.write(zeros, padding);
+    return stream.good();
+}
+
+bool PackageArchive::build(const fs::Path& directory, const fs::Path& output)
+{
+    if( !fs::is_directory(directory) )
+    {
+        LOGW("failed to build package, \"%s\" is not a valid directory.", directory.c_str());
+        return false;
+    }
+
+    // collects files with their path relative to directory
+    struct PackageFile
+    {
+        PackageEntry entry;
+        fs::Path path;
+        fs::Path name;
+    };
+
+    std::vector<PackageFile> files;
+    for( auto& path : fs::scan(directory, fs::ScanMode::FILES | fs::ScanMode::RECURSIVE) )
+    {
+        if( path == output )
+            continue;
+
+        PackageFile file;
+        memset(&file.entry, 0, sizeof(file.entry));
+        file.path = path;
+        file.name = path.get_relative(directory);
+        if( file.name.is_empty() )
+        {
+            LOGW("failed to build package, \"%s\" is not under \"%s\".", path.c_str(), directory.c_str());
+            return false;
+        }
+
+        file.entry.hash = math::StringHash(file.name.c_str());
+        files.push_back(std::move(file));
+    }
+
+    // files with the same hash are told apart by their names
+    std::sort(files.begin(), files.end(), [](const PackageFile& lhs, const PackageFile& rhs)
+    {
+        if( lhs.entry.hash != rhs.entry.hash )
+            return lhs.entry.hash < rhs.entry.hash;
+        return lhs.name.to_string() < rhs.name.to_string();
+    });
+
+    auto stream = fs::open(output, fs::FileMode::WRITE | fs::FileMode::BINARY | fs::FileMode::TRUNCATE);
+    if( !stream.is_open() )
+        return false;
+
+    PackageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, s_package_magic, sizeof(header.magic));
+    header.version = kVersion;
+    header.entries = files.size();
+    stream.write((const char*)&header, sizeof(header));
+
+    std::vector<char> buffer;
+    uint64_t names = 0;
+    for( auto& file : files )
+    {
+        auto mapped = fs::map_file(file.path);
+        if( !mapped || !write_padding(stream, kAlignment) )
+        {
+            LOGW("failed to pack file \"%s\".", file.path.c_str());
+            return false;
+        }
+
+        file.entry.offset = (uint64_t)stream.tellp();
+        file.entry.size = mapped.size();
+        file.entry.name = names;
+        file.entry.name_size = file.name.to_string().size();
+        names += file.entry.name_size;
+        stream.write((const char*)mapped.data(), mapped.size());
+    }
+
+    write_padding(stream, kAlignment);
+    header.toc = (uint64_t)stream.tellp();
+    for( auto& file : files )
+        stream.write((const char*)&file.entry, sizeof(PackageEntry));
+
+    header.names = (uint64_t)stream.tellp();
+    for( auto& file : files )
+        stream.write(file.name.c_str(), file.entry.name_size);
+
+    stream.seekp(0);
+    stream.write((const char*)&header, sizeof(header));
+
+    if( !stream.good() )
+    {
+        LOGW("failed to write package \"%s\".", output.c_str());
+        return false;
+    }
+
+    return true;
+}
+
 PackageArchive::PackageArchive(ArchiveCollection& collection,
     const fs::Path& path, unsigned offset)
 : Archive(collection), _filepath(path), _offset(offset)
 {}
 
-PackageArchive::~PackageArchive()
+bool PackageArchive::initialize()
 {
-    if( _stream.is_open() )
-        _stream.close();
+    auto file = fs::map_file(_filepath);
+    if( !file )
+    {
+        LOGW("failed to open package \"%s\"", _filepath.c_str());
+        return false;
+    }
+
+    PackageHeader header;
+    if( file.size() < _offset || file.size() - _offset < sizeof(header) )
+    {
+        LOGW("failed to open package \"%s\", its corrupted.", _filepath.c_str());
+        return false;
+    }
+
+    _contents = file.slice(_offset, file.size() - _offset);
+    memcpy(&header, _contents.data(), sizeof(header));
+
+    if( memcmp(header.magic, s_package_magic, sizeof(header.magic)) != 0 || header.version != kVersion )
+    {
+        LOGW("failed to open package \"%s\", unknown format.", _filepath.c_str());
+        return false;
+    }
+
+    const uint64_t toc_size = (uint64_t)header.entries * sizeof(PackageEntry);
+    if( header.toc > _contents.size() || toc_size > _contents.size() - header.toc )
+    {
+        LOGW("failed to open package \"%s\", its corrupted.", _filepath.c_str());
+        return false;
+    }
+
+    if( header.names > _contents.size() || header.names < header.toc + toc_size )
+    {
+        LOGW("failed to open package \"%s\", its corrupted.", _filepath.c_str());
+        return false;
+    }
+
+    // the table is small, copies it out to avoid unaligned access with offset
+    _toc.resize(header.entries);
+    memcpy(_toc.data(), _contents.data() + header.toc, toc_size);
+
+    _names = _contents.span().subspan(header.names, _contents.size() - header.names);
+    for( auto& entry : _toc )
+    {
+        if( entry.name > _names.size() || entry.name_size > _names.size() - entry.name )
+        {
+            LOGW("failed to open package \"%s\", its corrupted.", _filepath.c_str());
+            _toc.clear();
+            return false;
+        }
+    }
+
+    return true;
 }
 
-bool PackageArchive::initialize()
+const PackageArchive::PackageEntry* PackageArchive::find(const fs::Path& path) const
 {
-    if( _stream.is_open() )
-        _stream.close();
+    const auto& name = path.to_string();
+    const uint32_t hash = math::StringHash(name.c_str());
+    auto found = std::lower_bound(_toc.begin(), _toc.end(), hash,
+        [](const PackageEntry& entry, uint32_t hash) { return entry.hash < hash; });
 
-    _stream = _collection.open(_filepath, fs::FileMode::READ);
-    if( !_stream.is_open() )
+    // the hash might collide with the ones of other paths
+    for( ; found != _toc.end() && found->hash == hash; found++ )
     {
-        LOGW("failed to open package \"%s\"", _filepath.c_str());
-        return false;
+        if( found->name_size == name.size() &&
+            memcmp(_names.data() + found->name, name.data(), name.size()) == 0 )
+            return &(*found);
     }
 
-    // _stream.seekg(_offset);
-    return false;
+    return nullptr;
 }
 
-bool PackageArchive::is_exist(const fs::Path&)
+bool PackageArchive::is_exist(const fs::Path& path)
 {
-    return false;
+    return find(path) != nullptr;
 }
 
 std::fstream PackageArchive::open(const fs::Path&, fs::FileMode)
@@ -64,6 +421,13 @@ std::fstream PackageArchive::open(const fs::Path&, fs::FileMode)
     return std::fstream();
 }
 
+fs::MappedFile PackageArchive::map(const fs::Path& path)
+{
+    if( auto entry = find(path) )
+        return _contents.slice(entry->offset, entry->size);
+    return fs::MappedFile();
+}
+
 bool ArchiveCollection::initialize()
 {
     return true;
@@ -76,22 +440,53 @@ void ArchiveCollection::dispose()
     _archives.clear();
 }
 
-bool ArchiveCollection::add_search_path(const fs::Path& path)
+bool ArchiveCollection::add_search_path(const fs::Path& path, bool watch)
 {
     if( fs::is_directory(path) )
-        return add_archive<FilesystemArchive>(path);
+        return add_archive<FilesystemArchive>(path, watch);
 
     LOGW("failed to add \"%s\" as search path, its not a valid directory.",
         path.c_str());
     return false;
 }
 
+bool ArchiveCollection::add_package(const fs::Path& path)
+{
+    return add_archive<PackageArchive>(path);
+}
+
 std::fstream ArchiveCollection::open(const fs::Path& path, fs::FileMode mode)
 {
     for( auto archive : _archives )
+    {
         if( archive->is_exist(path) )
-            return archive->open(path, mode);
+        {
+            auto stream = archive->open(path, mode);
+            if( stream.is_open() )
+                return stream;
+        }
+    }
     return std::fstream();
 }
 
+void ArchiveCollection::update()
+{
+    for( auto archive : _archives )
+        archive->update();
+}
+
+fs::MappedFile ArchiveCollection::map(const fs::Path& path)
+{
+    for( auto archive : _archives )
+    {
+        if( archive->is_exist(path) )
+        {
+            auto view = archive->map(path);
+            if( view )
+                return view;
+        }
+    }
+    return fs::MappedFile();
+}
+
 NS_LEMON_RESOURCE_END
\ No newline at end of file
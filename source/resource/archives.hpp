@@ -6,6 +6,12 @@
 #include <core/core.hpp>
 #include <resource/filesystem.hpp>
 
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
 NS_LEMON_RESOURCE_BEGIN
 
 struct Archive
@@ -16,37 +22,111 @@ struct Archive
     virtual bool initialize() { return true; }
     virtual bool is_exist(const fs::Path&) = 0;
     virtual std::fstream open(const fs::Path&, fs::FileMode) = 0;
+    // returns a read-only view of file contents in memory, or a closed view if the
+    // archive does not support mapping
+    virtual fs::MappedFile map(const fs::Path&) { return fs::MappedFile(); }
+    // applies the changes of underlying storage since last update
+    virtual void update() {}
 
 protected:
     ArchiveCollection& _collection;
 };
 
+// a directory tree of native filesystem. regular files of the tree are indexed by
+// their relative paths when mounted, so locating a file is a hash lookup instead of
+// a stat per search path. the index is authoritative, misses never touch the filesystem.
+// its kept up-to-date with inotify if watching is supported, the pending changes are
+// applied once per frame by update. otherwise, it should be refreshed manually.
 struct FilesystemArchive : public Archive
 {
-    FilesystemArchive(ArchiveCollection&, const fs::Path&);
+    FilesystemArchive(ArchiveCollection&, const fs::Path&, bool watch = true);
+    ~FilesystemArchive();
 
     bool initialize() override;
     bool is_exist(const fs::Path&) override;
     std::fstream open(const fs::Path&, fs::FileMode) override;
+    fs::MappedFile map(const fs::Path&) override;
+    // applies the pending changes of watched tree
+    void update() override;
+
+    // rebuilds the index from the filesystem
+    void refresh();
+    // returns true if the changes of tree are watched
+    bool is_watching() const { return _watcher >= 0; }
+    // returns the number of files indexed
+    size_t get_indexed() const;
 
 protected:
+    void index_directory(const std::string&);
+    void remove_directory(const std::string&);
+    void apply_changes();
+
     fs::Path _prefix;
+    bool _watch;
+
+    mutable std::mutex _mutex;
+    // normalized paths relative to prefix
+    std::unordered_set<std::string> _index;
+    // inotify descriptor, and the relative paths of watched directories. the descriptor
+    // is replaced under mutex when refreshed, but might be tested without it.
+    std::atomic<int> _watcher { -1 };
+    std::unordered_map<int, std::string> _watches;
 };
 
-// stores files of a directory tree sequentially for convenient access
+// stores files of a directory tree sequentially for convenient access. the package
+// is mapped into memory as a whole, files are looked up with the hash of path in a
+// table of contents, and handed out as views into the mapping without copying.
+//
+// layout of a package:
+// 1. PackageHeader;
+// 2. contents of files, each aligned to kAlignment bytes;
+// 3. table of contents, PackageEntry sorted by hash of relative path;
+// 4. table of names, relative paths of files which are compared on hash hits.
 struct PackageArchive : public Archive
 {
+    const static uint32_t kVersion = 2;
+    const static uint32_t kAlignment = 16;
+
+    // pack regular files of a directory tree into a package, returns true if successful
+    static bool build(const fs::Path& directory, const fs::Path& output);
+
+public:
     PackageArchive(ArchiveCollection&, const fs::Path&, unsigned offset = 0);
-    virtual ~PackageArchive();
 
     bool initialize() override;
     bool is_exist(const fs::Path&) override;
+    // packaged files could only be accessed with map
     std::fstream open(const fs::Path&, fs::FileMode) override;
+    fs::MappedFile map(const fs::Path&) override;
 
 protected:
-    fs::Path        _filepath;
-    unsigned        _offset;
-    std::fstream    _stream;
+    struct PackageHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t entries;
+        uint32_t reserved;
+        uint64_t toc;
+        uint64_t names;
+    };
+
+    struct PackageEntry
+    {
+        uint32_t hash;
+        uint32_t name_size;
+        uint64_t offset;
+        uint64_t size;
+        // offset of name in the table of names
+        uint64_t name;
+    };
+
+    const PackageEntry* find(const fs::Path&) const;
+
+    fs::Path                    _filepath;
+    unsigned                    _offset;
+    fs::MappedFile              _contents;
+    std::vector<PackageEntry>   _toc;
+    fs::ByteSpan                _names;
 };
 
 //subsystem for file and archive operations and access control
@@ -61,10 +141,16 @@ struct ArchiveCollection : core::Subsystem
 
     // add a archive to collection subsystem
     template<typename T, typename ... Args> boolean<T> add_archive(Args && ...);
-    // add a search path
-    bool add_search_path(const fs::Path&);
+    // add a search path, changes of its tree are watched to keep the index if specified
+    bool add_search_path(const fs::Path&, bool watch = true);
+    // add a package built with PackageArchive::build
+    bool add_package(const fs::Path&);
     // returns a opend fstream if we located file successful
     std::fstream open(const fs::Path&, fs::FileMode);
+    // returns a mapped view if we located file in an archive supports mapping
+    fs::MappedFile map(const fs::Path&);
+    // applies the changes of archives, called once per frame
+    void update();
 
 protected:
     std::vector<Archive*> _archives;
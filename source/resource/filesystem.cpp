@@ -7,7 +7,9 @@
 #include <windows.h>
 #else
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #endif
@@ -360,4 +362,151 @@ bool Directory::scan(const Path& path, ScanMode mode)
     return scan_directory(_nodes, path, mode);
 }
 
+MappedFile MappedFile::slice(size_t offset, size_t size) const
+{
+    MappedFile view;
+    if( _data == nullptr || offset > _size || size > _size - offset )
+        return view;
+
+    view._mapping = _mapping;
+    view._data = _data + offset;
+    view._size = size;
+    return view;
+}
+
+void MappedFile::close()
+{
+    _mapping.reset();
+    _data = nullptr;
+    _size = 0;
+}
+
+// the contents of empty files are pointed here, since zero-length mapping is not allowed
+static const uint8_t s_empty_contents[1] = { 0 };
+
+#ifdef PLATFORM_WIN32
+MappedFile map_file(const Path& path)
+{
+    MappedFile view;
+
+    auto file = CreateFileW(to_win32(path.c_str()).c_str(),
+        GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if( file == INVALID_HANDLE_VALUE )
+    {
+        LOGW("failed to map file \"%s\"", path.c_str());
+        return view;
+    }
+
+    LARGE_INTEGER size;
+    if( !GetFileSizeEx(file, &size) )
+    {
+        CloseHandle(file);
+        LOGW("failed to map file \"%s\"", path.c_str());
+        return view;
+    }
+
+    if( size.QuadPart == 0 )
+    {
+        CloseHandle(file);
+        view._data = s_empty_contents;
+        return view;
+    }
+
+    auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if( mapping == nullptr )
+    {
+        LOGW("failed to map file \"%s\"", path.c_str());
+        return view;
+    }
+
+    auto address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if( address == nullptr )
+    {
+        LOGW("failed to map file \"%s\"", path.c_str());
+        return view;
+    }
+
+    view._mapping.reset(address, [](const void* p) { UnmapViewOfFile(p); });
+    view._data = static_cast<const uint8_t*>(address);
+    view._size = (size_t)size.QuadPart;
+    return view;
+}
+#else
+MappedFile map_file(const Path& path)
+{
+    MappedFile view;
+
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if( fd < 0 )
+    {
+        LOGW("failed to map file \"%s\", %s", path.c_str(), strerror(errno));
+        return view;
+    }
+
+    struct stat st;
+    if( fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) )
+    {
+        ::close(fd);
+        LOGW("failed to map file \"%s\", its not a regular file", path.c_str());
+        return view;
+    }
+
+    const size_t size = st.st_size;
+    if( size == 0 )
+    {
+        ::close(fd);
+        view._data = s_empty_contents;
+        return view;
+    }
+
+    auto address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps a reference to file, its safe to close descriptor here
+    ::close(fd);
+    if( address == MAP_FAILED )
+    {
+        LOGW("failed to map file \"%s\", %s", path.c_str(), strerror(errno));
+        return view;
+    }
+
+    view._mapping.reset(address, [=](const void* p) { munmap(const_cast<void*>(p), size); });
+    view._data = static_cast<const uint8_t*>(address);
+    view._size = size;
+    return view;
+}
+#endif
+
+MemoryStreamBuffer::MemoryStreamBuffer(const uint8_t* data, size_t size)
+{
+    auto begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+    setg(begin, begin, begin + size);
+}
+
+MemoryStreamBuffer::pos_type MemoryStreamBuffer::seekoff(
+    off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+{
+    if( (mode & std::ios_base::in) == 0 )
+        return pos_type(off_type(-1));
+
+    char* position = nullptr;
+    if( direction == std::ios_base::beg )
+        position = eback() + offset;
+    else if( direction == std::ios_base::cur )
+        position = gptr() + offset;
+    else
+        position = egptr() + offset;
+
+    if( position < eback() || position > egptr() )
+        return pos_type(off_type(-1));
+
+    setg(eback(), position, egptr());
+    return pos_type(off_type(position - eback()));
+}
+
+MemoryStreamBuffer::pos_type MemoryStreamBuffer::seekpos(pos_type position, std::ios_base::openmode mode)
+{
+    return seekoff(off_type(position), std::ios_base::beg, mode);
+}
+
 NS_LEMON_FILESYSTEM_END
\ No newline at end of file
@@ -8,6 +8,7 @@
 
 #include <vector>
 #include <fstream>
+#include <memory>
 
 NS_LEMON_FILESYSTEM_BEGIN
 
@@ -74,6 +75,90 @@ protected:
 // construct and open a filesystem directory view
 Directory scan(const Path&, ScanMode mode = ScanMode::FILES);
 
+// a non-owning view of contiguous bytes, the memory should outlive the span.
+struct ByteSpan
+{
+    ByteSpan() = default;
+    ByteSpan(const uint8_t* data, size_t size) : _data(data), _size(size) {}
+
+    const uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    const uint8_t* begin() const { return _data; }
+    const uint8_t* end() const { return _data + _size; }
+
+    // returns the sub-range [offset, offset+size), an empty span if its out of range
+    ByteSpan subspan(size_t offset, size_t size) const;
+
+protected:
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+};
+
+// a read-only view of file contents mapped into memory. views share the
+// mapping, which would be released with the last reference.
+struct MappedFile
+{
+    MappedFile() = default;
+
+    // returns true if this view refers to a mapped file
+    bool is_open() const { return _data != nullptr; }
+    operator bool () const { return is_open(); }
+
+    const uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+    // returns the bytes of view, which are valid as long as this view is alive
+    ByteSpan span() const { return ByteSpan(_data, _size); }
+
+    // returns a view of sub-range [offset, offset+size) which shares the same mapping
+    MappedFile slice(size_t offset, size_t size) const;
+    // release the reference to mapping
+    void close();
+
+protected:
+    friend MappedFile map_file(const Path&);
+
+    std::shared_ptr<const void> _mapping;
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+};
+
+// map a regular file into memory for reading, returns a closed view if failed
+MappedFile map_file(const Path&);
+
+// a seekable input stream reads from a block of memory directly without copying,
+// the memory should outlive the stream.
+struct MemoryStreamBuffer : public std::streambuf
+{
+    MemoryStreamBuffer(const uint8_t*, size_t);
+
+protected:
+    pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) override;
+    pos_type seekpos(pos_type, std::ios_base::openmode) override;
+};
+
+struct MemoryStream : public std::istream
+{
+    MemoryStream(const uint8_t* data, size_t size)
+    : std::istream(nullptr), _buffer(data, size)
+    {
+        rdbuf(&_buffer);
+    }
+
+    MemoryStream(ByteSpan span) : MemoryStream(span.data(), span.size()) {}
+
+protected:
+    MemoryStreamBuffer _buffer;
+};
+
+INLINE ByteSpan ByteSpan::subspan(size_t offset, size_t size) const
+{
+    if( offset > _size || size > _size - offset )
+        return ByteSpan();
+    return ByteSpan(_data + offset, size);
+}
+
 NS_LEMON_FILESYSTEM_END
 ENABLE_BITMASK_OPERATORS(lemon::fs::FileMode);
 ENABLE_BITMASK_OPERATORS(lemon::fs::ScanMode);
\ No newline at end of file
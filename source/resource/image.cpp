@@ -2,7 +2,14 @@
 // @author Mao Jingkai(oammix@gmail.com)
 
 #include <resource/image.hpp>
+#include <resource/pixel.hpp>
 #include <graphics/frontend.hpp>
+#include <core/task.hpp>
+#include <codebase/memory_tracker.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -20,6 +27,183 @@ graphics::TextureFormat FORMAT[] =
     graphics::TextureFormat::RGBA,
 };
 
+graphics::TextureFormat COMPRESSED_FORMAT[] =
+{
+    graphics::TextureFormat::RGBA,
+    graphics::TextureFormat::COMPRESSED_RGB_DXT1,
+    graphics::TextureFormat::COMPRESSED_RGBA_DXT5,
+    graphics::TextureFormat::COMPRESSED_RGB_ETC1
+};
+
+// layout of baked texture, the header is followed by levels of mip chain, which are
+// stored contiguously from the largest one in the same layout of uploading.
+struct TextureFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint16_t width;
+    uint16_t height;
+    uint8_t components;
+    uint8_t element_format;
+    uint8_t compression;
+    uint8_t levels;
+    uint64_t size;
+    uint8_t reserved[8];
+};
+
+static const char kTextureMagic[4] = { 'L', 'T', 'E', 'X' };
+static const uint32_t kTextureVersion = 1;
+
+static bool is_baked_texture(const uint8_t* data, size_t size)
+{
+    return size >= sizeof(TextureFileHeader) && memcmp(data, kTextureMagic, sizeof(kTextureMagic)) == 0;
+}
+
+static graphics::TextureFormat get_texture_format(unsigned components, ImageCompression compression)
+{
+    return compression == ImageCompression::NONE ?
+        FORMAT[components] : COMPRESSED_FORMAT[static_cast<uint8_t>(compression)];
+}
+
+static size_t size_of_image(
+    unsigned width, unsigned height, unsigned components,
+    ImageElementFormat element, ImageCompression compression, unsigned levels)
+{
+    if( levels == 1 && compression == ImageCompression::NONE )
+        return (size_t)width * height * (element == ImageElementFormat::UBYTE ? components : 2);
+
+    return graphics::size_of_texture(
+        get_texture_format(components, compression),
+        static_cast<graphics::TexturePixelFormat>(element),
+        width, height, levels);
+}
+
+static unsigned get_max_levels(unsigned width, unsigned height)
+{
+    unsigned levels = 1;
+    for( auto size = std::max(width, height); size > 1; size >>= 1 )
+        levels ++;
+    return levels;
+}
+
+static void encode_pixel(const math::Color& color, unsigned components, uint8_t* dest)
+{
+    uint32_t ic = color.to_uint32();
+    switch(components)
+    {
+        case 4: // RGBA
+            dest[3] = (uint8_t)((ic & 0x000000FF) >> 0);
+        case 3: // RGB
+        {
+            dest[0] = (uint8_t)((ic & 0xFF000000) >> 24);
+            dest[1] = (uint8_t)((ic & 0x00FF0000) >> 16);
+            dest[2] = (uint8_t)((ic & 0x0000FF00) >> 8);
+            break;
+        }
+        case 2: // LUMINANCE_ALPHA
+        {
+            dest[0] = (uint8_t)math::clamp(255.f * color.grayscale(), 0.f, 255.f);
+            dest[1] = (uint8_t)((ic & 0x000000FF) >> 0);
+            break;
+        }
+        case 1: // ALPHA
+        {
+            dest[0] = (uint8_t)((ic & 0x000000FF) >> 0);
+            break;
+        }
+        default: FATAL("invalid components");
+    }
+}
+
+static math::Color decode_pixel(const uint8_t* src, unsigned components)
+{
+    math::Color ret = { 0.f, 0.f, 0.f, 1.f };
+    switch(components)
+    {
+        case 4: // RGBA
+            ret.a = (float)src[3] / 255.0f;
+        case 3: // RGB
+        {
+            ret.r = (float)src[0] / 255.0f;
+            ret.g = (float)src[1] / 255.0f;
+            ret.b = (float)src[2] / 255.0f;
+            break;
+        }
+        case 2: // LUMINANCE_ALPHA
+        {
+            ret.r = ret.g = ret.b = (float)src[0] / 255.0f;
+            ret.a = (float)src[1] / 255.f;
+            break;
+        }
+        case 1:
+        {
+            ret.a = (float)src[0] / 255.f;
+            break;
+        }
+        default: FATAL("invalid components");
+    }
+    return ret;
+}
+
+std::vector<Image::ptr> Image::read_batch(const std::vector<fs::Path>& paths, size_t budget)
+{
+    std::vector<Image::ptr> images(paths.size());
+
+    auto decode = [&](size_t index, fs::MappedFile file)
+    {
+        // files can't be mapped are read through stream
+        auto image = file ? Image::ptr(new (std::nothrow) Image()) : Resource::read<Image>(paths[index]);
+        if( image == nullptr )
+            return;
+
+        image->set_name(paths[index].c_str());
+        if( !file || image->read(file) )
+            images[index] = image;
+    };
+
+    auto tasks = core::get_subsystem<core::TaskSystem>();
+    if( tasks == nullptr )
+    {
+        for( size_t i = 0; i < paths.size(); i++ )
+            decode(i, Resource::map_file(paths[i]));
+        return images;
+    }
+
+    // the in-flight decodings in order of scheduling, with their estimated cost
+    std::deque<std::pair<Handle, size_t>> in_flight;
+    size_t in_flight_bytes = 0;
+
+    for( size_t i = 0; i < paths.size(); i++ )
+    {
+        auto file = Resource::map_file(paths[i]);
+
+        // estimates the decoded size with header only
+        size_t cost = 0;
+        int width, height, components;
+        if( file && stbi_info_from_memory(file.data(), file.size(), &width, &height, &components) )
+            cost = (size_t)width * height * components;
+
+        // helps the oldest decoding until we are under budget. a image larger than
+        // budget is still allowed when nothing else is in flight.
+        while( !in_flight.empty() && in_flight_bytes + cost > budget )
+        {
+            tasks->wait(in_flight.front().first);
+            in_flight_bytes -= in_flight.front().second;
+            in_flight.pop_front();
+        }
+
+        auto handle = tasks->create("Image::read_batch", decode, i, file);
+        tasks->run(handle);
+        in_flight.push_back(std::make_pair(handle, cost));
+        in_flight_bytes += cost;
+    }
+
+    for( auto& pair : in_flight )
+        tasks->wait(pair.first);
+
+    return images;
+}
+
 Image::~Image()
 {
     if( auto frontend = core::get_subsystem<graphics::RenderFrontend>() )
@@ -33,33 +217,152 @@ bool Image::read(std::istream& in)
     auto size = in.tellg() - start_pos;
     in.seekg(start_pos);
 
-    std::unique_ptr<uint8_t[]> tmp(new uint8_t[size]);
+    auto tmp = allocate_tagged_shared(MemoryTag::IMAGE, size);
+    if( !tmp )
+    {
+        LOGW("failed to allocate memory(%d bytes) for image.", (int)size);
+        return false;
+    }
+
     in.read((char*)tmp.get(), size);
 
+    if( is_baked_texture(tmp.get(), size) )
+        return load_texture(tmp, size);
+    return decode(tmp.get(), size);
+}
+
+bool Image::read(fs::ByteSpan span)
+{
+    if( !is_baked_texture(span.data(), span.size()) )
+        return decode(span.data(), span.size());
+
+    // the span is not owned, so levels of baked texture are copied once
+    auto tmp = allocate_tagged_shared(MemoryTag::IMAGE, span.size());
+    if( !tmp )
+    {
+        LOGW("failed to allocate memory(%d bytes) for image.", (int)span.size());
+        return false;
+    }
+
+    memcpy(tmp.get(), span.data(), span.size());
+    return load_texture(tmp, span.size());
+}
+
+bool Image::read(const fs::MappedFile& file)
+{
+    // levels of baked texture refer to the mapping directly, which is kept alive by data
+    if( is_baked_texture(file.data(), file.size()) )
+    {
+        auto view = file;
+        return load_texture(std::shared_ptr<const uint8_t>(file.data(), [view](const uint8_t*) {}), file.size());
+    }
+
+    // decodes from mapped memory directly
+    return decode(file.data(), file.size());
+}
+
+bool Image::load_texture(std::shared_ptr<const uint8_t> memory, size_t size)
+{
+    TextureFileHeader header;
+    memcpy(&header, memory.get(), sizeof(header));
+
+    if( header.version != kTextureVersion )
+    {
+        LOGW("unsupported version %u of baked texture %s.", header.version, _name.c_str());
+        return false;
+    }
+
+    auto element = static_cast<ImageElementFormat>(header.element_format);
+    auto compression = static_cast<ImageCompression>(header.compression);
+    if( header.width == 0 || header.height == 0 ||
+        header.components <= 0 || header.components > 4 ||
+        element > ImageElementFormat::USHORT_5551 ||
+        compression > ImageCompression::ETC1 ||
+        header.levels == 0 || header.levels > get_max_levels(header.width, header.height) )
+    {
+        LOGW("invalid header of baked texture %s.", _name.c_str());
+        return false;
+    }
+
+    auto expected = size_of_image(header.width, header.height, header.components, element, compression, header.levels);
+    if( header.size != expected || sizeof(header) + expected > size )
+    {
+        LOGW("truncated baked texture %s.", _name.c_str());
+        return false;
+    }
+
+    // shares the ownership of memory without copying
+    _data = std::shared_ptr<uint8_t>(memory, const_cast<uint8_t*>(memory.get() + sizeof(header)));
+    _readonly = true;
+    _width = header.width;
+    _height = header.height;
+    _components = header.components;
+    _levels = header.levels;
+    _element_format = element;
+    _compression = compression;
+    return true;
+}
+
+bool Image::decode(const uint8_t* data, size_t size)
+{
     unsigned width, height, components;
 
-    // make sure we have same texture coordinations with OpenGL
-    stbi_set_flip_vertically_on_load(true);
+    // make sure we have same texture coordinations with OpenGL. the flag of stb is a
+    // process global, which is set once instead of being written by every decoding thread.
+    static std::once_flag flip;
+    std::call_once(flip, []() { stbi_set_flip_vertically_on_load(true); });
     auto pixels = stbi_load_from_memory(
-        tmp.get(), size, (int*)&width, (int*)&height, (int*)&components, 0);
+        data, size, (int*)&width, (int*)&height, (int*)&components, 0);
     if( !pixels )
     {
         LOGW("failed to load image %s,\n\t%s", _name.c_str(), stbi_failure_reason());
         return false;
     }
-    tmp.reset();
 
-    if( !initialize(width, height, components) )
+    if( width <= 0 || height <= 0 || components <= 0 || components > 4 )
     {
+        LOGW("invalid image size/components of %s.", _name.c_str());
         stbi_image_free(pixels);
         return false;
     }
 
-    set_data(pixels);
-    stbi_image_free(pixels);
+    // adopts the decoded pixels as our own storage instead of copying
+    auto bytes = size_of_image(width, height, components, ImageElementFormat::UBYTE, ImageCompression::NONE, 1);
+    track_alloc(MemoryTag::IMAGE, bytes);
+    _data.reset(pixels, [=](uint8_t* p) { stbi_image_free(p); track_free(MemoryTag::IMAGE, bytes); });
+    _width = width;
+    _height = height;
+    _components = components;
+    _levels = 1;
+    _readonly = false;
+    _element_format = ImageElementFormat::UBYTE;
+    _compression = ImageCompression::NONE;
     return true;
 }
 
+void Image::detach(bool preserve)
+{
+    // the pixels might be referenced by a pending texture upload or a read-only
+    // mapping, copy on write. the mip levels are discarded since they are stale.
+    if( _data && (_readonly || !_data.unique()) )
+    {
+        auto size = size_of_image(_width, _height, _components, _element_format, _compression, 1);
+        auto data = allocate_tagged_shared(MemoryTag::IMAGE, size);
+        ENSURE(data != nullptr);
+        if( preserve )
+            memcpy(data.get(), _data.get(), size);
+        _data = data;
+    }
+
+    _readonly = false;
+    _levels = 1;
+}
+
+size_t Image::get_data_size() const
+{
+    return size_of_image(_width, _height, _components, _element_format, _compression, _levels);
+}
+
 bool Image::save(std::ostream& out)
 {
     if( !_data )
@@ -68,6 +371,12 @@ bool Image::save(std::ostream& out)
         return false;
     }
 
+    if( is_compressed() )
+    {
+        LOGW("can't save compressed image %s as png.", _name.c_str());
+        return false;
+    }
+
     int len;
     uint8_t* png = stbi_write_png_to_mem(_data.get(), 0, _width, _height, _components, &len);
     out.write((const char*)png, len);
@@ -82,15 +391,85 @@ bool Image::save(std::ostream& out)
     return true;
 }
 
+bool Image::save_texture(std::ostream& out)
+{
+    if( !_data || _width > 0xFFFF || _height > 0xFFFF )
+    {
+        LOGW("can't save image %s as texture with invalid size.", _name.c_str());
+        return false;
+    }
+
+    TextureFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kTextureMagic, sizeof(kTextureMagic));
+    header.version = kTextureVersion;
+    header.width = _width;
+    header.height = _height;
+    header.components = _components;
+    header.element_format = static_cast<uint8_t>(_element_format);
+    header.compression = static_cast<uint8_t>(_compression);
+    header.levels = _levels;
+    header.size = get_data_size();
+
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)_data.get(), header.size);
+
+    if( (out.rdstate() & std::ifstream::failbit ) != 0 )
+    {
+        LOGW("failed to write ot ostream when save texture %s", _name.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool Image::generate_mipmaps()
+{
+    if( !_data || is_compressed() || _element_format != ImageElementFormat::UBYTE )
+    {
+        LOGW("can't generate mipmaps of image %s.", _name.c_str());
+        return false;
+    }
+
+    auto levels = get_max_levels(_width, _height);
+    auto size = size_of_image(_width, _height, _components, _element_format, _compression, levels);
+    auto data = allocate_tagged_shared(MemoryTag::IMAGE, size);
+    if( !data )
+    {
+        LOGW("failed to allocate memory for mipmaps.");
+        return false;
+    }
+
+    memcpy(data.get(), _data.get(), _width*_height*_components);
+
+    auto src = data.get();
+    auto width = _width, height = _height;
+    for( unsigned i = 1; i < levels; i++ )
+    {
+        auto dst = src + width*height*_components;
+        downsample_pixels(src, width, height, _components, dst);
+
+        src = dst;
+        width = std::max(width / 2, 1U);
+        height = std::max(height / 2, 1U);
+    }
+
+    _data = data;
+    _readonly = false;
+    _levels = levels;
+    return true;
+}
+
 bool Image::update_video_object()
 {
-    auto format = FORMAT[_components];
+    auto format = get_texture_format(_components, _compression);
     auto element_format = static_cast<graphics::TexturePixelFormat>(_element_format);
 
     if( auto frontend = core::get_subsystem<graphics::RenderFrontend>() )
     {
+        // the upload references our pixels until the frame is drawn
         _video_uid = frontend->create_texture(
-            _data.get(), format, element_format, _width, _height, _usage);
+            std::shared_ptr<const void>(_data), format, element_format, _width, _height, _levels, _usage);
     }
 
     return _video_uid.is_valid();
@@ -98,17 +477,18 @@ bool Image::update_video_object()
 
 size_t Image::get_memory_usage() const
 {
-    return _width * _height * _components;
+    return get_data_size();
 }
 
 size_t Image::get_video_memory_usage() const
 {
-    return 0;
+    // textures are allocated with the same layout of data
+    return _video_uid.is_valid() ? get_data_size() : 0;
 }
 
 bool Image::initialize(unsigned width, unsigned height, unsigned components, ImageElementFormat element)
 {
-    if( width == _width && height == _width && element == _element_format )
+    if( width == _width && height == _width && element == _element_format && !is_compressed() )
         return true;
 
     if( width <= 0 || height <= 0 || components <=0 || components > 4 )
@@ -117,7 +497,7 @@ bool Image::initialize(unsigned width, unsigned height, unsigned components, Ima
         return false;
     }
 
-    _data.reset(new uint8_t[width*height*components]);
+    _data = allocate_tagged_shared(MemoryTag::IMAGE, width*height*components);
     if( !_data )
     {
         LOGW("failed to allocate memory for image data.");
@@ -127,7 +507,10 @@ bool Image::initialize(unsigned width, unsigned height, unsigned components, Ima
     _width = width;
     _height = height;
     _components = components;
+    _levels = 1;
+    _readonly = false;
     _element_format = element;
+    _compression = ImageCompression::NONE;
     return true;
 }
 
@@ -136,107 +519,133 @@ void Image::set_data(const uint8_t* data)
     if( !data )
         return;
 
-    memcpy(_data.get(), data, _width*_height*_components);
+    detach(false);
+    memcpy(_data.get(), data, size_of_image(_width, _height, _components, _element_format, _compression, 1));
 }
 
 void Image::set_data_raw(const uint8_t* data, unsigned offset, unsigned size)
 {
+    detach();
     memcpy(_data.get()+offset, data, size);
 }
 
 void Image::clear(const math::Color& color)
 {
-    if( !_data )
+    if( !_data || !is_accessible() )
         return;
 
-    for( unsigned y = 0; y < _height; y++ )
-        for( unsigned x = 0; x < _width; x++ )
-            set_pixel(x, y, color);
+    uint8_t value[4];
+    encode_pixel(color, _components, value);
+
+    detach(false);
+    fill_pixels(_data.get(), _width*_height, _components, value);
 }
 
-void Image::set_pixel(unsigned x, unsigned y, const math::Color& color)
+bool Image::convert(ImageElementFormat element)
 {
-    if( !_data || x >= _width || y >= _height )
-        return;
+    if( !_data || is_compressed() )
+    {
+        LOGW("can't convert image %s.", _name.c_str());
+        return false;
+    }
 
-    uint8_t* dest = _data.get() + (y*_width+x) * _components;
-    uint32_t ic = color.to_uint32();
-    switch(_components)
+    if( element == _element_format )
+        return true;
+
+    if( _element_format == ImageElementFormat::UBYTE && _components != 4 )
     {
-        case 4: // RGBA
-            dest[3] = (uint8_t)((ic & 0x000000FF) >> 0);
-        case 3: // RGB
-        {
-            dest[0] = (uint8_t)((ic & 0xFF000000) >> 24);
-            dest[1] = (uint8_t)((ic & 0x00FF0000) >> 16);
-            dest[2] = (uint8_t)((ic & 0x0000FF00) >> 8);
-            break;
-        }
-        case 2: // LUMINANCE_ALPHA
-        {
-            dest[0] = (uint8_t)math::clamp(255.f * color.grayscale(), 0.f, 255.f);
-            dest[1] = (uint8_t)((ic & 0x000000FF) >> 0);
-            break;
-        }
-        case 1: // ALPHA
-        {
-            dest[0] = (uint8_t)((ic & 0x000000FF) >> 0);
-            break;
-        }
-        default: FATAL("invalid components");
+        LOGW("only RGBA image could be packed, %s.", _name.c_str());
+        return false;
+    }
+
+    auto count = _width*_height;
+    auto components = element == ImageElementFormat::UBYTE ? 4U :
+        element == ImageElementFormat::USHORT_565 ? 3U : 4U;
+    auto size = element == ImageElementFormat::UBYTE ? count * 4 : count * 2;
+
+    auto data = allocate_tagged_shared(MemoryTag::IMAGE, size);
+    if( !data )
+    {
+        LOGW("failed to allocate memory for image data.");
+        return false;
     }
+
+    if( _element_format == ImageElementFormat::UBYTE )
+    {
+        pack_pixels(_data.get(), count, element, (uint16_t*)data.get());
+    }
+    else if( element == ImageElementFormat::UBYTE )
+    {
+        unpack_pixels((const uint16_t*)_data.get(), count, _element_format, data.get());
+    }
+    else
+    {
+        std::unique_ptr<uint8_t[]> rgba(new (std::nothrow) uint8_t[count*4]);
+        ENSURE(rgba != nullptr);
+        unpack_pixels((const uint16_t*)_data.get(), count, _element_format, rgba.get());
+        pack_pixels(rgba.get(), count, element, (uint16_t*)data.get());
+    }
+
+    _data = data;
+    _readonly = false;
+    _levels = 1;
+    _components = components;
+    _element_format = element;
+    return true;
+}
+
+bool Image::premultiply_alpha()
+{
+    if( !_data || is_compressed() || _components != 4 || _element_format != ImageElementFormat::UBYTE )
+    {
+        LOGW("can't premultiply alpha of image %s.", _name.c_str());
+        return false;
+    }
+
+    detach();
+    premultiply_pixels(_data.get(), _width*_height);
+    return true;
+}
+
+void Image::set_pixel(unsigned x, unsigned y, const math::Color& color)
+{
+    if( !_data || !is_accessible() || x >= _width || y >= _height )
+        return;
+
+    detach();
+    encode_pixel(color, _components, _data.get() + (y*_width+x) * _components);
 }
 
 math::Color Image::get_pixel(unsigned x, unsigned y) const
 {
-    if( !_data )
+    if( !_data || !is_accessible() )
         return 0xFF000000;
 
     x = x >= _width ? _width - 1 : x;
     y = y >= _height ? _height - 1 : y;
-    uint8_t* src = _data.get() + (y*_width+x) * _components;
-
-    math::Color ret = { 0.f, 0.f, 0.f, 1.f };
-    switch(_components)
-    {
-        case 4: // RGBA
-            ret.a = (float)src[3] / 255.0f;
-        case 3: // RGB
-        {
-            ret.r = (float)src[0] / 255.0f;
-            ret.g = (float)src[1] / 255.0f;
-            ret.b = (float)src[2] / 255.0f;
-            break;
-        }
-        case 2: // LUMINANCE_ALPHA
-        {
-            ret.r = ret.g = ret.b = (float)src[0] / 255.0f;
-            ret.a = (float)src[1] / 255.f;
-            break;
-        }
-        case 1:
-        {
-            ret.a = (float)src[0] / 255.f;
-            break;
-        }
-        default: FATAL("invalid components");
-    }
-    return ret;
+    return decode_pixel(_data.get() + (y*_width+x) * _components, _components);
 }
 
 math::Color Image::get_pixel_linear(float x, float y) const
 {
+    if( !_data || !is_accessible() )
+        return 0xFF000000;
+
     x = math::clamp(x * _width - 0.5f, 0.f, (float)(_width-1));
     y = math::clamp(y * _height - 0.5f, 0.f, (float)(_height-1));
 
-    int xi = (int)x;
-    int yi = (int)y;
+    // the coordinates are clamped already, so are the neighbours
+    unsigned x0 = (unsigned)x, x1 = std::min(x0+1, _width-1);
+    unsigned y0 = (unsigned)y, y1 = std::min(y0+1, _height-1);
 
     float xd = x - std::floor(x);
     float yd = y - std::floor(y);
 
-    auto top    = lerp(get_pixel(xi, yi+1), get_pixel(xi+1, yi+1), xd);
-    auto bottom = lerp(get_pixel(xi, yi), get_pixel(xi+1, yi), xd);
+    auto r0 = _data.get() + y0 * _width * _components;
+    auto r1 = _data.get() + y1 * _width * _components;
+
+    auto top    = lerp(decode_pixel(r1 + x0*_components, _components), decode_pixel(r1 + x1*_components, _components), xd);
+    auto bottom = lerp(decode_pixel(r0 + x0*_components, _components), decode_pixel(r0 + x1*_components, _components), xd);
     return lerp(top, bottom, yd);
 }
 
@@ -17,17 +17,42 @@ enum class ImageElementFormat : uint8_t
     USHORT_5551
 };
 
+// block compression of baked textures, which are produced by external tools
+enum class ImageCompression : uint8_t
+{
+    NONE = 0,
+    DXT1,
+    DXT5,
+    ETC1
+};
+
 struct Image : public Resource
 {
     using ptr = std::shared_ptr<Image>;
     using weak_ptr = std::weak_ptr<Image>;
 
+    // decodes a batch of images concurrently on workers of TaskSystem, the estimated
+    // decoded bytes in flight are bounded by budget. returns images in the same order
+    // of paths, and nullptr for the failed ones.
+    static std::vector<Image::ptr> read_batch(const std::vector<fs::Path>&, size_t budget = 64*1024*1024);
+
+public:
     virtual ~Image();
 
+    using Resource::read;
     bool read(std::istream&) override;
+    bool read(fs::ByteSpan) override;
+    bool read(const fs::MappedFile&) override;
     bool save(std::ostream&) override;
     bool update_video_object() override;
 
+    // saves as a baked texture, which has the levels stored in the layout of uploading,
+    // and could be mapped and uploaded directly without decoding when read.
+    bool save_texture(std::ostream&);
+    // generates the mip chain with box filter on cpu, requires an uncompressed image with
+    // UBYTE elements. the levels are discarded once the pixels modified.
+    bool generate_mipmaps();
+
     size_t get_memory_usage() const override;
     size_t get_video_memory_usage() const override;
 
@@ -38,6 +63,11 @@ struct Image : public Resource
     void set_data_raw(const uint8_t* data, unsigned offset, unsigned size);
     // clear the image with a color
     void clear(const math::Color&);
+    // convert between RGBA8 and the 16-bit packed formats, RGBA8 image is required to
+    // be packed. packed images are converted to RGBA8 first when converted to others.
+    bool convert(ImageElementFormat);
+    // multiply the color channels by alpha, requires a RGBA8 image
+    bool premultiply_alpha();
     // set a 2d pixel
     void set_pixel(unsigned, unsigned, const math::Color&);
     // specifies the expected usage pattern of the data source
@@ -54,18 +84,34 @@ struct Image : public Resource
     unsigned get_components() const { return _components; }
     // returns the internal format of image
     ImageElementFormat get_element_format() const { return _element_format; }
+    // returns the number of mip levels, and the compression of baked texture
+    unsigned get_levels() const { return _levels; }
+    ImageCompression get_compression() const { return _compression; }
+    bool is_compressed() const { return _compression != ImageCompression::NONE; }
     // returns memory usage of this image
     graphics::BufferUsage get_video_memory_hint() const { return _usage; }
     // returns graphics object of texture
     Handle get_video_uid() const;
 
 protected:
+    // pixels are accessible by components bytes, with UBYTE elements and no compression
+    bool is_accessible() const;
+    bool decode(const uint8_t*, size_t);
+    bool load_texture(std::shared_ptr<const uint8_t>, size_t);
+    // makes the pixels writable, the contents are copied unless they are overwritten
+    void detach(bool preserve = true);
+    size_t get_data_size() const;
+
     // with/height
     unsigned _width = 0, _height = 0, _components = 1;
-    // pixel data
-    std::unique_ptr<uint8_t[]> _data;
+    // pixel data followed by mip levels, shared with pending texture uploads. it might
+    // refer to a read-only mapping of baked texture, which is copied before written.
+    std::shared_ptr<uint8_t> _data;
+    bool _readonly = false;
+    unsigned _levels = 1;
     //
     ImageElementFormat _element_format = ImageElementFormat::UBYTE;
+    ImageCompression _compression = ImageCompression::NONE;
     //
     graphics::BufferUsage _usage = graphics::BufferUsage::STATIC;
     // 
@@ -77,6 +123,11 @@ INLINE void Image::set_video_memory_hint(graphics::BufferUsage usage)
     _usage = usage;
 }
 
+INLINE bool Image::is_accessible() const
+{
+    return _element_format == ImageElementFormat::UBYTE && _compression == ImageCompression::NONE;
+}
+
 INLINE Handle Image::get_video_uid() const
 {
     return _video_uid;
@@ -65,29 +65,40 @@ bool Material::initialize(Shader::ptr shader)
 
 bool Material::set_uniform_variable(const char* name, const graphics::UniformVariable& v)
 {
-    if( !_shader || !_shader->has_uniform_variable(name) )
+    auto slot = _shader ? _shader->get_uniform_slot(name) : graphics::kInvalidUniformSlot;
+    if( slot == graphics::kInvalidUniformSlot )
         return false;
 
     _uniform_dirty = true;
 
-    auto hash = math::StringHash(name);
-    for( size_t i = 0; i < _uniform_size; i++ )
+    auto index = _uniform_indices[slot];
+    if( index < _uniform_size && _uniforms[index].first == slot )
     {
-        if( _uniforms[i].first == hash )
-        {
-            _uniforms[i].second = v;
-            return true;
-        }
+        _uniforms[index].second = v;
+        return true;
     }
 
     ASSERT( _uniform_size < graphics::kMaxUniformsPerMaterial,
         "too many unifoms(%d) per material.", graphics::kMaxUniformsPerMaterial );
 
-    _uniforms[_uniform_size].first = hash;
+    _uniform_indices[slot] = _uniform_size;
+    _uniforms[_uniform_size].first = slot;
     _uniforms[_uniform_size++].second = v;
     return true;
 }
 
+const graphics::UniformVariable* Material::get_uniform_variable(const char* name) const
+{
+    auto slot = _shader ? _shader->get_uniform_slot(name) : graphics::kInvalidUniformSlot;
+    if( slot == graphics::kInvalidUniformSlot )
+        return nullptr;
+
+    auto index = _uniform_indices[slot];
+    if( index < _uniform_size && _uniforms[index].first == slot )
+        return &_uniforms[index].second;
+    return nullptr;
+}
+
 bool Material::set_texture(const char* name, Image::ptr image)
 {
     auto hash = math::StringHash(name);
@@ -32,8 +32,10 @@ public:
     bool initialize(Shader::ptr);
     // material will keep a reference to this image
     bool set_texture(const char*, Image::ptr);
-    // set the uniform variable of material
+    // set the uniform variable of material, the slot of uniform in shader is resolved here
     bool set_uniform_variable(const char*, const graphics::UniformVariable&);
+    // returns the value of uniform variable, nullptr if its not set
+    const graphics::UniformVariable* get_uniform_variable(const char*) const;
     // set the render state of material
     bool set_render_state(const graphics::RenderState&);
     // returns internal shader
@@ -44,8 +46,10 @@ public:
     Handle get_video_state();
 
 protected:    
+    // uniforms are stored with their slots in program, and _uniform_indices maps slots
+    // back to positions in _uniforms.
     template<size_t S> using uniform_array_t = 
-        std::array<std::pair<math::StringHash, graphics::UniformVariable>, S>;
+        std::array<std::pair<uint8_t, graphics::UniformVariable>, S>;
 
     template<size_t S> using texture_array_t =
         std::array<std::pair<math::StringHash, Image::ptr>, S>;
@@ -54,6 +58,7 @@ protected:
 
     uint8_t _uniform_size = 0;
     uniform_array_t<graphics::kMaxUniformsPerMaterial> _uniforms;
+    std::array<uint8_t, graphics::kMaxUniformsPerMaterial> _uniform_indices;
 
     uint8_t _texture_size = 0;
     texture_array_t<graphics::kMaxTexturePerMaterial> _textures;
@@ -310,4 +310,23 @@ Path Path::get_root() const
     return _pathname.substr(0, found+1);
 }
 
+Path Path::get_relative(const Path& base) const
+{
+    if( base.is_empty() )
+        return is_absolute() ? Path() : *this;
+
+    // both are tokenized, so comparing the whole components of strings is sufficient
+    const auto& prefix = base._pathname;
+    if( _pathname.size() <= prefix.size() || _pathname.compare(0, prefix.size(), prefix) != 0 )
+        return Path();
+
+    if( prefix == Path::sperator )
+        return _pathname.substr(prefix.size());
+
+    if( _pathname.compare(prefix.size(), strlen(Path::sperator), Path::sperator) != 0 )
+        return Path();
+
+    return _pathname.substr(prefix.size() + strlen(Path::sperator));
+}
+
 NS_LEMON_FILESYSTEM_END
\ No newline at end of file
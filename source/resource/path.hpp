@@ -49,6 +49,8 @@ struct Path
     // return parent/root path of this
     Path        get_root() const;
     Path        get_parent() const;
+    // return this path relative to base, an empty path if its not under base
+    Path        get_relative(const Path& base) const;
 
     // operator overloading of concatenation
     Path&   operator /= (const Path& rhs) { return concat(rhs); }
@@ -0,0 +1,319 @@
+// @date 2016/11/02
+// @author Mao Jingkai(oammix@gmail.com)
+
+#include <resource/pixel.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LEMON_PIXEL_SSE2
+#include <emmintrin.h>
+#endif
+
+NS_LEMON_RESOURCE_BEGIN
+
+void fill_pixels(uint8_t* dst, size_t count, unsigned components, const uint8_t* value)
+{
+    ASSERT(components > 0 && components <= 4, "invalid components.");
+
+    // 48 bytes is a multiple of every pixel size, and of the vector size
+    const size_t kPattern = 48;
+    uint8_t pattern[kPattern];
+    for( size_t i = 0; i < kPattern; i++ )
+        pattern[i] = value[i % components];
+
+    auto size = count * components;
+    auto end = dst + size - size % kPattern;
+
+#ifdef LEMON_PIXEL_SSE2
+    auto p0 = _mm_loadu_si128((const __m128i*)(pattern));
+    auto p1 = _mm_loadu_si128((const __m128i*)(pattern+16));
+    auto p2 = _mm_loadu_si128((const __m128i*)(pattern+32));
+    for( ; dst < end; dst += kPattern )
+    {
+        _mm_storeu_si128((__m128i*)(dst), p0);
+        _mm_storeu_si128((__m128i*)(dst+16), p1);
+        _mm_storeu_si128((__m128i*)(dst+32), p2);
+    }
+#else
+    for( ; dst < end; dst += kPattern )
+        memcpy(dst, pattern, kPattern);
+#endif
+
+    memcpy(dst, pattern, size % kPattern);
+}
+
+static uint16_t pack_pixel(const uint8_t* src, ImageElementFormat format)
+{
+    switch(format)
+    {
+        case ImageElementFormat::USHORT_565:
+            return ((src[0] >> 3) << 11) | ((src[1] >> 2) << 5) | (src[2] >> 3);
+        case ImageElementFormat::USHORT_4444:
+            return ((src[0] >> 4) << 12) | ((src[1] >> 4) << 8) | ((src[2] >> 4) << 4) | (src[3] >> 4);
+        case ImageElementFormat::USHORT_5551:
+            return ((src[0] >> 3) << 11) | ((src[1] >> 3) << 6) | ((src[2] >> 3) << 1) | (src[3] >> 7);
+        default:
+            FATAL("invalid packed format.");
+            return 0;
+    }
+}
+
+static void unpack_pixel(uint16_t src, ImageElementFormat format, uint8_t* dst)
+{
+    // expands with bit replication, so that the extremes are kept
+    switch(format)
+    {
+        case ImageElementFormat::USHORT_565:
+        {
+            unsigned r = (src >> 11) & 0x1F, g = (src >> 5) & 0x3F, b = src & 0x1F;
+            dst[0] = (r << 3) | (r >> 2);
+            dst[1] = (g << 2) | (g >> 4);
+            dst[2] = (b << 3) | (b >> 2);
+            dst[3] = 0xFF;
+            break;
+        }
+        case ImageElementFormat::USHORT_4444:
+        {
+            dst[0] = ((src >> 12) & 0xF) * 17;
+            dst[1] = ((src >> 8) & 0xF) * 17;
+            dst[2] = ((src >> 4) & 0xF) * 17;
+            dst[3] = (src & 0xF) * 17;
+            break;
+        }
+        case ImageElementFormat::USHORT_5551:
+        {
+            unsigned r = (src >> 11) & 0x1F, g = (src >> 6) & 0x1F, b = (src >> 1) & 0x1F;
+            dst[0] = (r << 3) | (r >> 2);
+            dst[1] = (g << 3) | (g >> 2);
+            dst[2] = (b << 3) | (b >> 2);
+            dst[3] = (src & 0x1) ? 0xFF : 0;
+            break;
+        }
+        default:
+            FATAL("invalid packed format.");
+    }
+}
+
+#ifdef LEMON_PIXEL_SSE2
+// packs 32-bit lanes holding unsigned 16-bit values, which _mm_packs_epi32 would saturate
+static __m128i pack_u32_u16(__m128i lo, __m128i hi)
+{
+    const auto bias32 = _mm_set1_epi32(0x8000);
+    const auto bias16 = _mm_set1_epi16((short)0x8000);
+    auto packed = _mm_packs_epi32(_mm_sub_epi32(lo, bias32), _mm_sub_epi32(hi, bias32));
+    return _mm_xor_si128(packed, bias16);
+}
+
+// packs 4 RGBA8 pixels into 32-bit lanes
+static __m128i pack_pixels_sse2(__m128i v, ImageElementFormat format)
+{
+    const auto mask = _mm_set1_epi32(0xFF);
+    auto r = _mm_and_si128(v, mask);
+    auto g = _mm_and_si128(_mm_srli_epi32(v, 8), mask);
+    auto b = _mm_and_si128(_mm_srli_epi32(v, 16), mask);
+    auto a = _mm_srli_epi32(v, 24);
+
+    switch(format)
+    {
+        case ImageElementFormat::USHORT_565:
+            return _mm_or_si128(_mm_or_si128(
+                _mm_slli_epi32(_mm_srli_epi32(r, 3), 11),
+                _mm_slli_epi32(_mm_srli_epi32(g, 2), 5)),
+                _mm_srli_epi32(b, 3));
+        case ImageElementFormat::USHORT_4444:
+            return _mm_or_si128(_mm_or_si128(
+                _mm_slli_epi32(_mm_srli_epi32(r, 4), 12),
+                _mm_slli_epi32(_mm_srli_epi32(g, 4), 8)), _mm_or_si128(
+                _mm_slli_epi32(_mm_srli_epi32(b, 4), 4),
+                _mm_srli_epi32(a, 4)));
+        default:
+            return _mm_or_si128(_mm_or_si128(
+                _mm_slli_epi32(_mm_srli_epi32(r, 3), 11),
+                _mm_slli_epi32(_mm_srli_epi32(g, 3), 6)), _mm_or_si128(
+                _mm_slli_epi32(_mm_srli_epi32(b, 3), 1),
+                _mm_srli_epi32(a, 7)));
+    }
+}
+
+// expands 5/6 bits channel in 32-bit lanes to 8 bits
+static __m128i expand_sse2(__m128i v, int bits)
+{
+    return _mm_or_si128(_mm_slli_epi32(v, 8-bits), _mm_srli_epi32(v, 2*bits-8));
+}
+
+// unpacks 4 packed pixels in 32-bit lanes to RGBA8
+static __m128i unpack_pixels_sse2(__m128i v, ImageElementFormat format)
+{
+    __m128i r, g, b, a;
+    switch(format)
+    {
+        case ImageElementFormat::USHORT_565:
+        {
+            r = expand_sse2(_mm_srli_epi32(v, 11), 5);
+            g = expand_sse2(_mm_and_si128(_mm_srli_epi32(v, 5), _mm_set1_epi32(0x3F)), 6);
+            b = expand_sse2(_mm_and_si128(v, _mm_set1_epi32(0x1F)), 5);
+            a = _mm_set1_epi32(0xFF);
+            break;
+        }
+        case ImageElementFormat::USHORT_4444:
+        {
+            const auto mask = _mm_set1_epi32(0xF);
+            // x * 17 == x << 4 | x for 4 bits
+            r = _mm_srli_epi32(v, 12);
+            g = _mm_and_si128(_mm_srli_epi32(v, 8), mask);
+            b = _mm_and_si128(_mm_srli_epi32(v, 4), mask);
+            a = _mm_and_si128(v, mask);
+            r = _mm_or_si128(_mm_slli_epi32(r, 4), r);
+            g = _mm_or_si128(_mm_slli_epi32(g, 4), g);
+            b = _mm_or_si128(_mm_slli_epi32(b, 4), b);
+            a = _mm_or_si128(_mm_slli_epi32(a, 4), a);
+            break;
+        }
+        default:
+        {
+            const auto mask = _mm_set1_epi32(0x1F);
+            r = expand_sse2(_mm_srli_epi32(v, 11), 5);
+            g = expand_sse2(_mm_and_si128(_mm_srli_epi32(v, 6), mask), 5);
+            b = expand_sse2(_mm_and_si128(_mm_srli_epi32(v, 1), mask), 5);
+            a = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi32(0x1)));
+            a = _mm_and_si128(a, _mm_set1_epi32(0xFF));
+            break;
+        }
+    }
+
+    return _mm_or_si128(
+        _mm_or_si128(r, _mm_slli_epi32(g, 8)),
+        _mm_or_si128(_mm_slli_epi32(b, 16), _mm_slli_epi32(a, 24)));
+}
+#endif
+
+void pack_pixels(const uint8_t* src, size_t count, ImageElementFormat format, uint16_t* dst)
+{
+    ASSERT(format != ImageElementFormat::UBYTE, "invalid packed format.");
+
+    size_t i = 0;
+#ifdef LEMON_PIXEL_SSE2
+    for( ; i + 8 <= count; i += 8 )
+    {
+        auto lo = pack_pixels_sse2(_mm_loadu_si128((const __m128i*)(src + i*4)), format);
+        auto hi = pack_pixels_sse2(_mm_loadu_si128((const __m128i*)(src + i*4 + 16)), format);
+        _mm_storeu_si128((__m128i*)(dst + i), pack_u32_u16(lo, hi));
+    }
+#endif
+
+    for( ; i < count; i++ )
+        dst[i] = pack_pixel(src + i*4, format);
+}
+
+void unpack_pixels(const uint16_t* src, size_t count, ImageElementFormat format, uint8_t* dst)
+{
+    ASSERT(format != ImageElementFormat::UBYTE, "invalid packed format.");
+
+    size_t i = 0;
+#ifdef LEMON_PIXEL_SSE2
+    const auto zero = _mm_setzero_si128();
+    for( ; i + 8 <= count; i += 8 )
+    {
+        auto v = _mm_loadu_si128((const __m128i*)(src + i));
+        auto lo = unpack_pixels_sse2(_mm_unpacklo_epi16(v, zero), format);
+        auto hi = unpack_pixels_sse2(_mm_unpackhi_epi16(v, zero), format);
+        _mm_storeu_si128((__m128i*)(dst + i*4), lo);
+        _mm_storeu_si128((__m128i*)(dst + i*4 + 16), hi);
+    }
+#endif
+
+    for( ; i < count; i++ )
+        unpack_pixel(src[i], format, dst + i*4);
+}
+
+// rounded x / 255 for x in [0, 255*255]
+static uint8_t div255(unsigned x)
+{
+    x += 128;
+    return (uint8_t)((x + (x >> 8)) >> 8);
+}
+
+void premultiply_pixels(uint8_t* pixels, size_t count)
+{
+    size_t i = 0;
+#ifdef LEMON_PIXEL_SSE2
+    const auto zero = _mm_setzero_si128();
+    const auto round = _mm_set1_epi16(128);
+    // alpha channel is multiplied by 255, which keeps itself
+    const auto alpha_mask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    const auto alpha_keep = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+    for( ; i + 4 <= count; i += 4 )
+    {
+        auto v = _mm_loadu_si128((const __m128i*)(pixels + i*4));
+        __m128i halves[2] = { _mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero) };
+
+        for( auto& c : halves )
+        {
+            auto a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm_or_si128(_mm_andnot_si128(alpha_mask, a), alpha_keep);
+
+            auto x = _mm_add_epi16(_mm_mullo_epi16(c, a), round);
+            c = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+        }
+
+        _mm_storeu_si128((__m128i*)(pixels + i*4), _mm_packus_epi16(halves[0], halves[1]));
+    }
+#endif
+
+    for( ; i < count; i++ )
+    {
+        auto p = pixels + i*4;
+        p[0] = div255(p[0] * p[3]);
+        p[1] = div255(p[1] * p[3]);
+        p[2] = div255(p[2] * p[3]);
+    }
+}
+
+void downsample_pixels(const uint8_t* src, unsigned width, unsigned height, unsigned components, uint8_t* dst)
+{
+    auto dw = std::max(width / 2, 1U);
+    auto dh = std::max(height / 2, 1U);
+
+    for( unsigned y = 0; y < dh; y++ )
+    {
+        auto r0 = src + std::min(y*2, height-1) * width * components;
+        auto r1 = src + std::min(y*2+1, height-1) * width * components;
+        unsigned x = 0;
+
+#ifdef LEMON_PIXEL_SSE2
+        // 4 pixels of RGBA8 to 2, columns are never clamped with width >= 2
+        if( components == 4 && width >= 2 )
+        {
+            const auto zero = _mm_setzero_si128();
+            const auto round = _mm_set1_epi16(2);
+            for( ; x + 2 <= dw; x += 2 )
+            {
+                auto a = _mm_loadu_si128((const __m128i*)(r0 + x*8));
+                auto b = _mm_loadu_si128((const __m128i*)(r1 + x*8));
+
+                // vertical sums of pixel 0, 1 and 2, 3 in 16-bit lanes
+                auto lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                auto hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+                // horizontal sums of neighbouring pixels
+                auto sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+                sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+
+                _mm_storel_epi64((__m128i*)(dst), _mm_packus_epi16(sum, zero));
+                dst += 8;
+            }
+        }
+#endif
+
+        for( ; x < dw; x++ )
+        {
+            auto c0 = std::min(x*2, width-1) * components;
+            auto c1 = std::min(x*2+1, width-1) * components;
+
+            for( unsigned i = 0; i < components; i++ )
+                *dst++ = (uint8_t)((r0[c0+i] + r0[c1+i] + r1[c0+i] + r1[c1+i] + 2) / 4);
+        }
+    }
+}
+
+NS_LEMON_RESOURCE_END
@@ -0,0 +1,29 @@
+// @date 2016/11/02
+// @author Mao Jingkai(oammix@gmail.com)
+
+#pragma once
+
+#include <resource/image.hpp>
+
+NS_LEMON_RESOURCE_BEGIN
+
+// bulk kernels operate on contiguous pixels of images, they are vectorized with SSE2
+// when available and fall back to scalar loops otherwise. any count is accepted, the
+// tails not filling a whole vector are handled by scalar code.
+
+// fill count pixels with a value of components bytes
+void fill_pixels(uint8_t* dst, size_t count, unsigned components, const uint8_t* value);
+
+// convert RGBA8 pixels to the 16-bit packed format, the dropped bits are truncated
+void pack_pixels(const uint8_t* src, size_t count, ImageElementFormat, uint16_t* dst);
+// convert 16-bit packed pixels to RGBA8, alpha is opaque if the format has none
+void unpack_pixels(const uint16_t* src, size_t count, ImageElementFormat, uint8_t* dst);
+
+// multiply color channels of RGBA8 pixels by its alpha in place
+void premultiply_pixels(uint8_t* pixels, size_t count);
+
+// downsample to half size with 2x2 box filter, the last row/column are repeated
+// for sizes of 1. dst should have max(width/2, 1) * max(height/2, 1) pixels.
+void downsample_pixels(const uint8_t* src, unsigned width, unsigned height, unsigned components, uint8_t* dst);
+
+NS_LEMON_RESOURCE_END
@@ -118,7 +118,7 @@ bool Primitive::initialize(const void* data, const graphics::VertexLayout& layou
         return false;
     }
 
-    _vertices.reset( new (std::nothrow) uint8_t[layout.get_stride()*size] );
+    _vertices = allocate_tagged(MemoryTag::PRIMITIVE, layout.get_stride()*size);
     if( _vertices == nullptr )
     {
         LOGW("failed to allocate memory(%d bytes) for primitive.", layout.get_stride()*size);
@@ -148,7 +148,7 @@ bool Primitive::initialize(
     }
 
     size_t vdata_size = layout.get_stride()*vsize;
-    _vertices.reset( new (std::nothrow) uint8_t[vdata_size] );
+    _vertices = allocate_tagged(MemoryTag::PRIMITIVE, vdata_size);
     if( _vertices == nullptr )
     {
         LOGW("failed to allocate memory(%d bytes) for primitive.", vdata_size);
@@ -156,7 +156,7 @@ bool Primitive::initialize(
     }
 
     size_t idata_size = INDEX_ELEMENT_SIZES[value(format)]*isize;
-    _indices.reset( new (std::nothrow) uint8_t[idata_size] );
+    _indices = allocate_tagged(MemoryTag::PRIMITIVE, idata_size);
     if( _indices == nullptr )
     {
         _vertices.reset();
@@ -184,7 +184,12 @@ size_t Primitive::get_memory_usage() const
 
 size_t Primitive::get_video_memory_usage() const
 {
-    return 0;
+    size_t size = 0;
+    if( _vb_handle.is_valid() )
+        size += _layout.get_stride() * _vertex_size;
+    if( _ib_handle.is_valid() )
+        size += INDEX_ELEMENT_SIZES[value(_index_format)] * _index_size;
+    return size;
 }
 
 NS_LEMON_RESOURCE_END
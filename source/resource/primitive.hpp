@@ -5,6 +5,7 @@
 
 #include <resource/resource.hpp>
 #include <codebase/handle.hpp>
+#include <codebase/memory_tracker.hpp>
 #include <graphics/graphics.hpp>
 
 NS_LEMON_RESOURCE_BEGIN
@@ -52,9 +53,9 @@ protected:
     size_t _vertex_size = 0;
     size_t _index_size = 0;
     graphics::VertexLayout _layout;
-    std::unique_ptr<uint8_t[]> _vertices;
+    TaggedBytes _vertices;
     graphics::IndexElementFormat _index_format;
-    std::unique_ptr<uint8_t[]> _indices;
+    TaggedBytes _indices;
     graphics::BufferUsage _usage = graphics::BufferUsage::STATIC;
     graphics::PrimitiveType _type = graphics::PrimitiveType::TRIANGLES;
 
@@ -3,9 +3,20 @@
 
 #include <resource/resource.hpp>
 #include <resource/archives.hpp>
+#include <core/task.hpp>
+
+#include <algorithm>
 
 NS_LEMON_RESOURCE_BEGIN
 
+fs::MappedFile Resource::map_file(const fs::Path& path)
+{
+    if( core::details::status() != core::details::Status::RUNNING )
+        return fs::MappedFile();
+
+    return core::get_subsystem<ArchiveCollection>()->map(path);
+}
+
 std::fstream Resource::search_file(const fs::Path& path)
 {
     if( core::details::status() != core::details::Status::RUNNING )
@@ -29,11 +40,140 @@ bool ResourceCache::initialize()
     _video_memory_threshold = 0;
     _memory_usage = 0;
     _video_memory_usage = 0;
+    _evict_cursor = 0;
     return true;
 }
 
 void ResourceCache::dispose()
 {
+    // wait for the in-flight readings, which refer to this cache
+    std::vector<fetch_state> fetching;
+    {
+        std::unique_lock<std::mutex> L(_async_mutex);
+        for( auto& pair : _fetching )
+            fetching.push_back(pair.second);
+    }
+
+    if( auto tasks = core::get_subsystem<core::TaskSystem>() )
+    {
+        for( auto& state : fetching )
+            tasks->wait(state->task);
+    }
+
+    for( auto& state : fetching )
+    {
+        state->resource.reset();
+        state->status = AsyncFetchState::Status::FAILED;
+    }
+
+    _fetching.clear();
+    _decoded.clear();
+}
+
+ResourceCache::fetch_state ResourceCache::fetch_async_internal(
+    const fs::Path& name, TypeInfoGeneric::index_t type, reader read)
+{
+    auto hash = math::StringHash(name.c_str());
+    auto state = std::make_shared<AsyncFetchState>();
+    state->hash = hash;
+    state->type = type;
+
+    if( auto resource = find<Resource>(hash) )
+    {
+        state->resource = resource;
+        state->status = AsyncFetchState::Status::COMPLETED;
+        return state;
+    }
+
+    {
+        std::unique_lock<std::mutex> L(_async_mutex);
+        auto found = _fetching.find(hash);
+        if( found != _fetching.end() )
+        {
+            if( found->second->type == type )
+                return found->second;
+
+            // only one resource is cached for a path, sharing would hand out a wrong type
+            LOGW("failed to fetch %s, its being fetched as another type.", name.c_str());
+            state->status = AsyncFetchState::Status::FAILED;
+            return state;
+        }
+
+        state->status = AsyncFetchState::Status::READING;
+        _fetching.insert(std::make_pair(hash, state));
+    }
+
+    auto path = name;
+    auto closure = [=]()
+    {
+        auto resource = read(path);
+        if( resource != nullptr )
+            resource->set_name(path.c_str());
+
+        // failed readings are finished on main thread too, which drops them from _fetching
+        std::unique_lock<std::mutex> L(_async_mutex);
+        state->resource = resource;
+        state->status = AsyncFetchState::Status::UPLOADING;
+        _decoded.push_back(state);
+    };
+
+    auto tasks = core::get_subsystem<core::TaskSystem>();
+    if( tasks == nullptr )
+    {
+        closure();
+        return state;
+    }
+
+    state->task = tasks->create("ResourceCache::fetch_async", closure);
+    tasks->run(state->task);
+    return state;
+}
+
+void ResourceCache::wait_internal(fetch_state state)
+{
+    if( state->status.load() == AsyncFetchState::Status::READING )
+    {
+        if( auto tasks = core::get_subsystem<core::TaskSystem>() )
+            tasks->wait(state->task);
+    }
+
+    if( state->status.load() == AsyncFetchState::Status::UPLOADING )
+        update_video_objects();
+}
+
+void ResourceCache::update_video_objects()
+{
+    {
+        std::unique_lock<std::mutex> L(_async_mutex);
+        if( _decoded.empty() )
+            return;
+        _uploading.swap(_decoded);
+    }
+
+    for( auto& state : _uploading )
+    {
+        auto resource = state->resource;
+        if( auto cached = find<Resource>(state->hash) )
+        {
+            // fetched synchronously in the meantime
+            resource = cached;
+        }
+        else if( resource == nullptr || !resource->update_video_object() || !add(state->hash, resource) )
+        {
+            resource.reset();
+        }
+
+        {
+            std::unique_lock<std::mutex> L(_async_mutex);
+            _fetching.erase(state->hash);
+        }
+
+        state->resource = resource;
+        state->status = resource != nullptr ?
+            AsyncFetchState::Status::COMPLETED : AsyncFetchState::Status::FAILED;
+    }
+
+    _uploading.clear();
 }
 
 bool ResourceCache::add(math::StringHash hash, Resource::ptr resource)
@@ -41,45 +181,87 @@ bool ResourceCache::add(math::StringHash hash, Resource::ptr resource)
     if( resource == nullptr )
         return false;
 
-    auto found = _resources.find(hash);
-    if( found != _resources.end() )
-        return false;
+    std::unique_lock<std::mutex> L(_mutex);
 
+    auto& shard = get_shard(hash);
     {
-        std::unique_lock<std::mutex> L(_mutex);
-        make_room(resource);
-        _resources[hash] = resource;
-        _lru.push_back(std::make_pair(hash, resource));
+        SharedLockGuard<SharedSpinMutex> SL(shard.mutex);
+        if( shard.resources.find(hash) != shard.resources.end() )
+            return false;
     }
+
+    make_room(resource);
+
+    std::unique_lock<SharedSpinMutex> SL(shard.mutex);
+    Entry entry;
+    entry.resource = resource;
+    entry.position = shard.lru.emplace(shard.lru.end(), hash, resource);
+    shard.resources.insert(std::make_pair(hash, entry));
     return true;
 }
 
+Resource::ptr ResourceCache::find_internal(math::StringHash hash)
+{
+    auto& shard = get_shard(hash);
+
+    SharedLockGuard<SharedSpinMutex> L(shard.mutex);
+    auto found = shard.resources.find(hash);
+    if( found == shard.resources.end() )
+        return nullptr;
+
+    // the flag is written only if its cleared, so hot lookups never write shared memory
+    auto& referenced = found->second.position->referenced;
+    if( !referenced.load(std::memory_order_relaxed) )
+        referenced.store(true, std::memory_order_relaxed);
+    return found->second.resource;
+}
+
 void ResourceCache::make_room(Resource::ptr resource)
 {
     _memory_usage += resource->get_memory_usage();
     _video_memory_usage += resource->get_video_memory_usage();
 
-    if( _memory_usage <= _memory_threshold && _video_memory_usage <= _video_memory_threshold )
-        return;
+    auto is_full = [this]()
+    {
+        return _memory_usage > _memory_threshold || _video_memory_usage > _video_memory_threshold;
+    };
 
-    for( auto cursor = _lru.begin(); cursor != _lru.end(); )
+    // evicts the least-recently-used resource of shards in turn, until a whole round of
+    // shards has nothing to evict. the resources looked up since last visit, or held by
+    // others, are moved to the back of list as if they were accessed just now. the list
+    // is walked twice, so the ones referenced only are evicted in the same visit.
+    size_t idle = 0;
+    while( is_full() && idle < kShards )
     {
-        // if this resource are referenced by resource table and least-recently-used list only
-        if( cursor->second.use_count() == 2 )
+        auto& shard = _shards[_evict_cursor];
+        _evict_cursor = (_evict_cursor + 1) % kShards;
+
+        bool evicted = false;
+        std::unique_lock<SharedSpinMutex> L(shard.mutex);
+        for( auto n = shard.lru.size() * 2; n > 0 && !evicted; n-- )
         {
-            _memory_usage -= cursor->second->get_memory_usage();
-            _video_memory_usage -= cursor->second->get_video_memory_usage();
+            auto& node = shard.lru.front();
+            if( node.referenced.exchange(false, std::memory_order_relaxed) ||
+                node.resource.use_count() != 2 )
+            {
+                shard.lru.splice(shard.lru.end(), shard.lru, shard.lru.begin());
+                continue;
+            }
 
-            _resources.erase(cursor->first);
-            _lru.erase(cursor++);
+            _memory_usage -= node.resource->get_memory_usage();
+            _video_memory_usage -= node.resource->get_video_memory_usage();
 
-            if( _memory_usage <= _memory_threshold && _video_memory_usage <= _video_memory_threshold )
-                return;
+            shard.resources.erase(node.hash);
+            shard.lru.pop_front();
+            evicted = true;
         }
-        else
-            cursor ++;
+
+        idle = evicted ? 0 : idle + 1;
     }
 
+    if( !is_full() )
+        return;
+
     LOGW("failed to get spare memory in ResourceCache.\n\tRAM: %.2f/%.2f mb\n\tVRAM: %.2f/%.2f mb",
         (float)_memory_usage / 1024.f / 1024.f,
         (float)_memory_threshold / 1024.f / 1024.f,
@@ -87,35 +269,24 @@ void ResourceCache::make_room(Resource::ptr resource)
         (float)_video_memory_threshold / 1024.f / 1024.f);
 }
 
-void ResourceCache::touch(math::StringHash hash)
-{
-    auto found = std::find_if(_lru.begin(), _lru.end(),
-        [=](const std::pair<math::StringHash, Resource::ptr>& pair)
-        {
-            return pair.first == hash;
-        });
-
-    if( found != _lru.end() )
-    {
-        std::unique_lock<std::mutex> L(_mutex);
-        _lru.push_back(*found);
-        _lru.erase(found);
-    }
-}
-
 std::ostream& operator << (std::ostream& out, const ResourceCache& cache)
 {
     out << "ResourceCache" << std::endl;
 
     size_t usage = 0;
-    for( auto pair : cache._resources )
+    for( auto& shard : cache._shards )
     {
-        usage += pair.second->get_memory_usage();
+        SharedLockGuard<SharedSpinMutex> L(shard.mutex);
+        for( auto& pair : shard.resources )
+        {
+            auto& resource = pair.second.resource;
+            usage += resource->get_memory_usage();
 
-        out << "\t" << pair.second->get_name()
-            << " REF("<<pair.second.use_count() << "): RAM "
-            << pair.second->get_memory_usage() << " byte(s), VRAM "
-            << pair.second->get_video_memory_usage() << " byte(s)." << std::endl;
+            out << "\t" << resource->get_name()
+                << " REF("<< resource.use_count() << "): RAM "
+                << resource->get_memory_usage() << " byte(s), VRAM "
+                << resource->get_video_memory_usage() << " byte(s)." << std::endl;
+        }
     }
 
     return out << usage << " byte(s)" <<std::endl;
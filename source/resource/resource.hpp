@@ -6,12 +6,18 @@
 #include <forwards.hpp>
 #include <core/core.hpp>
 #include <resource/path.hpp>
+#include <resource/filesystem.hpp>
 #include <math/string_hash.hpp>
+#include <codebase/handle.hpp>
+#include <codebase/spin.hpp>
 
 #include <list>
+#include <array>
 #include <fstream>
 #include <vector>
 #include <mutex>
+#include <atomic>
+#include <functional>
 
 NS_LEMON_RESOURCE_BEGIN
 
@@ -37,6 +43,12 @@ public:
     // return true if successful
     virtual bool read(std::istream&) = 0;
     virtual bool save(std::ostream&) = 0;
+    // load resource from a span of bytes, override this to parse the memory directly.
+    // by default its read through a stream wraps the memory without copying.
+    virtual bool read(fs::ByteSpan);
+    // load resource from a mapped view of file, by default its parsed as a span of the
+    // mapping. override this to keep references to the mapping beyond reading.
+    virtual bool read(const fs::MappedFile&);
 
     // returns memory/video memory consumptions of this resource
     virtual size_t get_memory_usage() const;
@@ -51,12 +63,51 @@ public:
 
 protected:
     bool initialize() { return true; }
+    static fs::MappedFile map_file(const fs::Path&);
     static std::fstream search_file(const fs::Path&);
 
 protected:
     std::string _name;
 };
 
+// the shared state of an asynchronous fetching. reading and decoding are performed
+// on workers of TaskSystem, then the video objects are updated on main thread.
+struct AsyncFetchState
+{
+    enum class Status : uint8_t
+    {
+        READING,
+        UPLOADING,
+        COMPLETED,
+        FAILED
+    };
+
+    std::atomic<Status> status { Status::READING };
+    math::StringHash hash;
+    // the type of resource requested
+    TypeInfoGeneric::index_t type;
+    Handle task;
+    Resource::ptr resource;
+};
+
+// a future-like handle of resource fetched asynchronously
+template<typename T> struct AsyncResource
+{
+    AsyncResource() = default;
+    explicit AsyncResource(std::shared_ptr<AsyncFetchState> state) : _state(state) {}
+
+    // returns true if this handle refers to a fetching
+    bool is_valid() const { return _state != nullptr; }
+    // returns true if the fetching is finished, successfully or not
+    bool is_ready() const;
+    // returns the resource if fetched successfully, nullptr otherwise
+    Resource::shared_derived_ptr<T> get() const;
+
+protected:
+    friend struct ResourceCache;
+    std::shared_ptr<AsyncFetchState> _state;
+};
+
 // resource cache subsystems. loads resources on demand and cache them
 // for later access with a LRU strategy.
 struct ResourceCache : public core::Subsystem
@@ -77,6 +128,15 @@ struct ResourceCache : public core::Subsystem
     template<typename T> Resource::shared_derived_ptr<T> find(math::StringHash);
     // if resource associated with name not exists in cache, then try to read it from a
     template<typename T> Resource::shared_derived_ptr<T> fetch(const fs::Path&);
+    // fetch resource without blocking, the reading and decoding are scheduled on TaskSystem,
+    // and concurrent requests of the same path share the same fetching. requests of the
+    // path being fetched as another type of resource are failed immediately.
+    template<typename T> AsyncResource<T> fetch_async(const fs::Path&);
+    // block until the asynchronous fetching finished, should be called from main thread
+    template<typename T> Resource::shared_derived_ptr<T> wait(const AsyncResource<T>&);
+    // update video objects of asynchronously decoded resources and add them to cache,
+    // should be called from main thread on the render side of a frame
+    void update_video_objects();
     // returns memory/video usage of cached resource
     size_t get_memory_usage() const;
     size_t get_video_memory_usage() const;
@@ -87,16 +147,61 @@ protected:
     friend std::ostream& operator << (std::ostream&, const ResourceCache&);
 
     void make_room(Resource::ptr);
-    void touch(math::StringHash);
+    Resource::ptr find_internal(math::StringHash);
+
+    using fetch_state = std::shared_ptr<AsyncFetchState>;
+    using reader = std::function<Resource::ptr(const fs::Path&)>;
+    fetch_state fetch_async_internal(const fs::Path&, TypeInfoGeneric::index_t, reader);
+    void wait_internal(fetch_state);
+
+    // cached resources are distributed into shards by hash, each shard has its own
+    // lock and least-recently-used list. lookups hold the lock in shared mode and only
+    // mark the node referenced, instead of reordering the list. evictions take the
+    // ones at the front from shards in a round-robin fashion, the referenced ones are
+    // given a second chance at the back, which approximates the LRU order.
+    struct LRUNode
+    {
+        LRUNode(math::StringHash hash, Resource::ptr resource)
+        : hash(hash), resource(resource) {}
+
+        math::StringHash hash;
+        Resource::ptr resource;
+        std::atomic<bool> referenced { false };
+    };
+
+    using lru_list = std::list<LRUNode>;
+    struct Entry
+    {
+        Resource::ptr resource;
+        lru_list::iterator position;
+    };
 
+    struct Shard
+    {
+        mutable SharedSpinMutex mutex;
+        std::unordered_map<math::StringHash, Entry> resources;
+        lru_list lru;
+    };
+
+    const static size_t kShards = 16;
+    Shard& get_shard(math::StringHash);
+    const Shard& get_shard(math::StringHash) const;
+
+    // serializes the insertions and evictions
     std::mutex _mutex;
-    size_t _memory_usage;
-    size_t _video_memory_usage;
+    std::atomic<size_t> _memory_usage;
+    std::atomic<size_t> _video_memory_usage;
     size_t _memory_threshold;
     size_t _video_memory_threshold;
 
-    std::unordered_map<math::StringHash, Resource::ptr> _resources;
-    std::list<std::pair<math::StringHash, Resource::ptr>> _lru;
+    std::array<Shard, kShards> _shards;
+    // the shard evicted from next time
+    size_t _evict_cursor;
+
+    std::mutex _async_mutex;
+    std::unordered_map<math::StringHash, fetch_state> _fetching;
+    std::vector<fetch_state> _decoded;
+    std::vector<fetch_state> _uploading;
 };
 
 std::ostream& operator << (std::ostream&, const ResourceCache&);
@@ -115,6 +220,15 @@ Resource::shared_derived_ptr<T> Resource::create(Args&& ... args)
 template<typename T>
 Resource::shared_derived_ptr<T> Resource::read(const fs::Path& name)
 {
+    // mapped files are read from memory directly
+    if( auto file = Resource::map_file(name) )
+    {
+        auto v = new (std::nothrow) T();
+        if( v && static_cast<Resource*>(v)->read(file) ) return shared_derived_ptr<T>(v);
+        if( v ) delete v;
+        return nullptr;
+    }
+
     auto fstream = Resource::search_file(name);
     if( fstream.is_open() )
     {
@@ -125,6 +239,17 @@ Resource::shared_derived_ptr<T> Resource::read(const fs::Path& name)
     return nullptr;
 }
 
+INLINE bool Resource::read(fs::ByteSpan span)
+{
+    fs::MemoryStream stream(span);
+    return read(stream);
+}
+
+INLINE bool Resource::read(const fs::MappedFile& file)
+{
+    return read(file.span());
+}
+
 INLINE size_t Resource::get_memory_usage() const
 {
     return 0;
@@ -165,11 +290,7 @@ INLINE bool ResourceCache::add(const fs::Path& name, Resource::ptr resource)
 template<typename T>
 Resource::shared_derived_ptr<T> ResourceCache::find(math::StringHash hash)
 {
-    auto found = _resources.find(hash);
-    if( found == _resources.end() )
-        return nullptr;
-    touch(hash);
-    return std::dynamic_pointer_cast<T>(found->second);
+    return std::dynamic_pointer_cast<T>(find_internal(hash));
 }
 
 template<typename T>
@@ -196,9 +317,57 @@ Resource::shared_derived_ptr<T> ResourceCache::fetch(const fs::Path& name)
     return nullptr;
 }
 
+template<typename T>
+AsyncResource<T> ResourceCache::fetch_async(const fs::Path& name)
+{
+    const auto type = TypeInfoGeneric::id<Resource, T>();
+    return AsyncResource<T>(fetch_async_internal(name, type, [](const fs::Path& path) -> Resource::ptr
+    {
+        return Resource::read<T>(path);
+    }));
+}
+
+template<typename T>
+Resource::shared_derived_ptr<T> ResourceCache::wait(const AsyncResource<T>& handle)
+{
+    if( handle._state != nullptr )
+        wait_internal(handle._state);
+    return handle.get();
+}
+
+template<typename T> INLINE bool AsyncResource<T>::is_ready() const
+{
+    if( _state == nullptr )
+        return false;
+
+    auto status = _state->status.load();
+    return status == AsyncFetchState::Status::COMPLETED || status == AsyncFetchState::Status::FAILED;
+}
+
+template<typename T> INLINE Resource::shared_derived_ptr<T> AsyncResource<T>::get() const
+{
+    if( _state == nullptr || _state->status.load() != AsyncFetchState::Status::COMPLETED )
+        return nullptr;
+    return std::dynamic_pointer_cast<T>(_state->resource);
+}
+
+INLINE ResourceCache::Shard& ResourceCache::get_shard(math::StringHash hash)
+{
+    return _shards[hash.get_hash() % kShards];
+}
+
+INLINE const ResourceCache::Shard& ResourceCache::get_shard(math::StringHash hash) const
+{
+    return _shards[hash.get_hash() % kShards];
+}
+
 INLINE bool ResourceCache::is_exist(const fs::Path& path) const
 {
-    return _resources.find(path.c_str()) != _resources.end();
+    auto hash = math::StringHash(path.c_str());
+    auto& shard = get_shard(hash);
+
+    SharedLockGuard<SharedSpinMutex> L(shard.mutex);
+    return shard.resources.find(hash) != shard.resources.end();
 }
 
 INLINE size_t ResourceCache::get_memory_usage() const
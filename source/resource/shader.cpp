@@ -4,8 +4,9 @@
 #include <resource/shader.hpp>
 #include <graphics/frontend.hpp>
 
-#include <regex>
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 
 NS_LEMON_RESOURCE_BEGIN
 
@@ -42,8 +43,10 @@ Shader::ptr Shader::color()
     return nullptr;
 }
 
+// directives of sections are lines start with "//->", and separated by whitespaces
 struct Token
 {
+    constexpr static char const*const Directive = "//->";
     constexpr static char const*const VertexShader = "VERTEX_SHADER";
     constexpr static char const*const FragmentShader = "FRAGMENT_SHADER";
     constexpr static char const*const OpenBracket = "{";
@@ -56,6 +59,191 @@ enum class ShaderType
     FRAGMENT
 };
 
+static bool is_whitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool is_word(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool equals(const char* begin, const char* end, const char* token)
+{
+    auto len = strlen(token);
+    return (size_t)(end - begin) == len && memcmp(begin, token, len) == 0;
+}
+
+// scans uniform declarations of glsl incrementally, line by line. comments and
+// preprocessor directives are skipped, and declarations could span lines. words
+// are compared in place, so only the found uniforms allocate.
+struct UniformScanner
+{
+    UniformScanner(std::vector<ShaderUniform>& uniforms) : _uniforms(uniforms) {}
+
+    // scans a line without the line break
+    void scan(const char* begin, const char* end)
+    {
+        auto p = begin;
+        if( !_comment )
+        {
+            while( p < end && is_whitespace(*p) ) p++;
+            if( p < end && *p == '#' )
+                return;
+        }
+
+        while( p < end )
+        {
+            if( _comment )
+            {
+                for( ; p + 1 < end && !(p[0] == '*' && p[1] == '/'); p++ );
+                if( p + 1 >= end )
+                    return;
+
+                _comment = false;
+                p += 2;
+                continue;
+            }
+
+            if( p[0] == '/' && p + 1 < end && p[1] == '/' )
+                return;
+
+            if( p[0] == '/' && p + 1 < end && p[1] == '*' )
+            {
+                _comment = true;
+                p += 2;
+                continue;
+            }
+
+            if( is_word(*p) )
+            {
+                auto start = p;
+                for( ; p < end && (is_word(*p) || *p == '.'); p++ );
+                on_word(start, p);
+                continue;
+            }
+
+            if( !is_whitespace(*p) )
+                on_punctuation(*p);
+            p++;
+        }
+    }
+
+protected:
+    enum class State : uint8_t
+    {
+        IDLE,
+        TYPE,
+        NAME,
+        DECLARATOR,
+        ARRAY,
+        BLOCK,
+        INITIALIZER
+    };
+
+    void on_word(const char* begin, const char* end)
+    {
+        switch(_state)
+        {
+            case State::IDLE:
+                if( equals(begin, end, "uniform") )
+                    _state = State::TYPE;
+                break;
+
+            case State::TYPE:
+                if( !equals(begin, end, "lowp") && !equals(begin, end, "mediump") && !equals(begin, end, "highp") )
+                {
+                    _type.assign(begin, end);
+                    _state = State::NAME;
+                }
+                break;
+
+            case State::NAME:
+                declare(begin, end);
+                _state = State::DECLARATOR;
+                break;
+
+            case State::ARRAY:
+                // sizes of constant expressions are unknown
+                if( *begin >= '0' && *begin <= '9' )
+                    _uniforms[_current].size = (uint16_t)atoi(begin);
+                break;
+
+            case State::DECLARATOR:
+                _state = State::IDLE;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void on_punctuation(char c)
+    {
+        switch(_state)
+        {
+            case State::TYPE:
+                _state = State::IDLE;
+                break;
+
+            case State::NAME:
+                // uniform blocks are not supported by program yet
+                _state = c == '{' ? State::BLOCK : State::IDLE;
+                break;
+
+            case State::DECLARATOR:
+                if( c == '[' ) _state = State::ARRAY;
+                else if( c == ',' ) _state = State::NAME;
+                else if( c == '=' ) { _state = State::INITIALIZER; _depth = 0; }
+                else _state = State::IDLE;
+                break;
+
+            case State::ARRAY:
+                if( c == ']' ) _state = State::DECLARATOR;
+                break;
+
+            case State::BLOCK:
+                if( c == '}' ) _state = State::IDLE;
+                break;
+
+            case State::INITIALIZER:
+                if( c == '(' ) _depth ++;
+                else if( c == ')' ) _depth --;
+                else if( c == ';' ) _state = State::IDLE;
+                else if( c == ',' && _depth == 0 ) _state = State::NAME;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void declare(const char* begin, const char* end)
+    {
+        // the same uniform might be declared by both stages
+        for( _current = 0; _current < _uniforms.size(); _current++ )
+        {
+            auto& name = _uniforms[_current].name;
+            if( name.size() == (size_t)(end - begin) && memcmp(name.data(), begin, name.size()) == 0 )
+                return;
+        }
+
+        ShaderUniform uniform;
+        uniform.name.assign(begin, end);
+        uniform.type = _type;
+        uniform.size = 1;
+        _uniforms.push_back(uniform);
+    }
+
+    std::vector<ShaderUniform>& _uniforms;
+    State _state = State::IDLE;
+    bool _comment = false;
+    int _depth = 0;
+    size_t _current = 0;
+    std::string _type;
+};
+
 Shader::~Shader()
 {
     if( auto frontend = core::get_subsystem<graphics::RenderFrontend>() )
@@ -64,64 +252,104 @@ Shader::~Shader()
 
 bool Shader::read(std::istream& in)
 {
-    std::regex syntax("//->.*");
-    std::regex tokenize("(\\S+)");
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    auto str = buffer.str();
+    return parse(str.data(), str.size());
+}
 
-    std::smatch pieces;
+bool Shader::read(fs::ByteSpan span)
+{
+    return parse((const char*)span.data(), span.size());
+}
+
+bool Shader::parse(const char* data, size_t size)
+{
+    std::string vertex, fragment;
+    std::vector<ShaderUniform> uniforms;
+    UniformScanner vertex_scanner(uniforms), fragment_scanner(uniforms);
 
-    std::string line;
     bool bracket = false;
     ShaderType type = ShaderType::VERTEX;
 
-    std::string vertex, fragment;
-    while( std::getline(in, line) )
+    // splits sections and scans uniforms in a single pass
+    const auto end = data + size;
+    const auto directive = strlen(Token::Directive);
+    for( auto line = data; line < end; )
     {
-        if( std::regex_match(line, syntax) )
+        auto eol = static_cast<const char*>(memchr(line, '\n', end - line));
+        eol = eol ? eol : end;
+
+        if( (size_t)(eol - line) >= directive && memcmp(line, Token::Directive, directive) == 0 )
         {
-            auto iterator = std::sregex_iterator(line.begin()+4, line.end(), tokenize);
-            for( ; iterator != std::sregex_iterator(); iterator ++ )
+            for( auto p = line + directive; p < eol; )
             {
-                if( strcmp((*iterator).str().c_str(), Token::VertexShader) == 0 )
+                for( ; p < eol && is_whitespace(*p); p++ );
+                auto start = p;
+                for( ; p < eol && !is_whitespace(*p); p++ );
+                if( start == p )
+                    break;
+
+                bool valid = true;
+                if( equals(start, p, Token::VertexShader) )
                 {
-                    ENSURE(!bracket);
+                    valid = !bracket;
                     type = ShaderType::VERTEX;
                     vertex.clear();
                 }
-                else if( strcmp((*iterator).str().c_str(), Token::FragmentShader) == 0 )
+                else if( equals(start, p, Token::FragmentShader) )
                 {
-                    ENSURE(!bracket);
+                    valid = !bracket;
                     type = ShaderType::FRAGMENT;
                     fragment.clear();
                 }
-                else if( strcmp((*iterator).str().c_str(), Token::OpenBracket) == 0 )
+                else if( equals(start, p, Token::OpenBracket) )
                 {
-                    ENSURE(!bracket);
+                    valid = !bracket;
                     bracket = true;
                 }
-                else if( strcmp((*iterator).str().c_str(), Token::CloseBracket) == 0 )
+                else if( equals(start, p, Token::CloseBracket) )
                 {
-                    ENSURE(bracket);
+                    valid = bracket;
                     bracket = false;
                 }
+
+                if( !valid )
+                {
+                    LOGW("unbalanced section of shader %s.", _name.c_str());
+                    return false;
+                }
             }
         }
+        else if( type == ShaderType::VERTEX )
+        {
+            vertex.append(line, eol);
+            vertex.push_back('\n');
+            vertex_scanner.scan(line, eol);
+        }
         else
         {
-            if( type == ShaderType::VERTEX )
-            {
-                vertex.append(line);
-                vertex.push_back('\n');
-            }
-            else
-            {
-                fragment.append(line);
-                fragment.push_back('\n');
-            }
+            fragment.append(line, eol);
+            fragment.push_back('\n');
+            fragment_scanner.scan(line, eol);
         }
+
+        line = eol + 1;
     }
 
-    ENSURE(!bracket);
-    return initialize(vertex.c_str(), fragment.c_str());
+    if( bracket )
+    {
+        LOGW("unbalanced section of shader %s.", _name.c_str());
+        return false;
+    }
+
+    _vertex.swap(vertex);
+    _fragment.swap(fragment);
+    _uniforms.swap(uniforms);
+    update_cache(true);
+
+    _dirty = true;
+    return true;
 }
 
 bool Shader::save(std::ostream& out)
@@ -152,25 +380,65 @@ bool Shader::initialize(const char* vs, const char* fs)
 
     _vertex = vs;
     _fragment = fs;
-
-    scan_uniforms(_vertex);
-    scan_uniforms(_fragment);
+    _uniforms.clear();
+    update_cache(false);
 
     _dirty = true;
     return true;
 }
 
+void Shader::update_cache(bool scanned)
+{
+    _binary.reset();
+
+    // reflected uniforms of the same sources are reused from cache
+    auto cache = core::get_subsystem<ShaderCache>();
+    auto key = cache ? ShaderCache::hash(_vertex.c_str(), _fragment.c_str()) : 0;
+    if( auto entry = cache ? cache->find(key) : nullptr )
+    {
+        _uniforms = entry->uniforms;
+        _binary = entry->binary;
+        update_uniform_hashes();
+        return;
+    }
+
+    if( !scanned )
+    {
+        scan_uniforms(_vertex);
+        scan_uniforms(_fragment);
+    }
+
+    if( cache )
+    {
+        // the binary is retrieved when the program linked
+        auto entry = std::make_shared<ShaderCache::Entry>();
+        entry->uniforms = _uniforms;
+        entry->binary = std::make_shared<graphics::ProgramBinary>();
+        cache->add(key, entry);
+        _binary = entry->binary;
+    }
+
+    update_uniform_hashes();
+}
+
+void Shader::update_uniform_hashes()
+{
+    _uniform_hashes.clear();
+    for( auto& uniform : _uniforms )
+        _uniform_hashes.push_back(math::StringHash(uniform.name));
+}
+
 void Shader::scan_uniforms(const std::string& str)
 {
-    std::regex uniform("uniform( +)(\\w+)( +)(\\w+)( *);");
-    std::smatch match;
-    
-    auto iterator = std::sregex_iterator(str.begin(), str.end(), uniform);
-    for( ; iterator != std::sregex_iterator(); iterator ++ )
+    UniformScanner scanner(_uniforms);
+
+    const auto end = str.data() + str.size();
+    for( auto line = str.data(); line < end; )
     {
-        std::string line = iterator->str();
-        if( std::regex_search(line, match, uniform) && match.size() >= 4 )
-            _uniforms.push_back(match[4].str());
+        auto eol = static_cast<const char*>(memchr(line, '\n', end - line));
+        eol = eol ? eol : end;
+        scanner.scan(line, eol);
+        line = eol + 1;
     }
 }
 
@@ -181,9 +449,9 @@ bool Shader::update_video_object()
         if( auto frontend = core::get_subsystem<graphics::RenderFrontend>() )
         {
             frontend->free_program(_program);
-            _program = frontend->create_program(_vertex.c_str(), _fragment.c_str());
+            _program = frontend->create_program(_vertex.c_str(), _fragment.c_str(), _binary);
             for( auto& uniform : _uniforms )
-                frontend->create_program_uniform(_program, uniform.c_str());
+                frontend->create_program_uniform(_program, uniform.name.c_str());
             _dirty = false;
         }
     }
@@ -191,4 +459,187 @@ bool Shader::update_video_object()
     return _program.is_valid();
 }
 
+static const char kShaderCacheMagic[4] = { 'L', 'S', 'H', 'C' };
+
+template<typename T> static bool read_value(std::istream& in, T& value)
+{
+    in.read((char*)&value, sizeof(T));
+    return in.good();
+}
+
+template<typename T> static void write_value(std::ostream& out, const T& value)
+{
+    out.write((const char*)&value, sizeof(T));
+}
+
+// returns the number of bytes left before the end of stream of total size
+static uint64_t get_remaining(std::istream& in, uint64_t total)
+{
+    auto position = in.tellg();
+    return position < 0 || (uint64_t)position > total ? 0 : total - (uint64_t)position;
+}
+
+// lengths are verified against the remaining bytes before allocating for them
+static bool read_string(std::istream& in, uint64_t total, std::string& str)
+{
+    uint32_t len;
+    if( !read_value(in, len) || len > get_remaining(in, total) )
+        return false;
+
+    str.resize(len);
+    in.read(&str[0], len);
+    return in.good();
+}
+
+static void write_string(std::ostream& out, const std::string& str)
+{
+    write_value(out, (uint32_t)str.size());
+    out.write(str.data(), str.size());
+}
+
+uint64_t ShaderCache::hash(const char* vs, const char* fs)
+{
+    // 64-bit FNV-1a over both sources, separated by the terminator
+    uint64_t value = 14695981039346656037ULL;
+    for( auto str : { vs, fs } )
+    {
+        do
+        {
+            value ^= (uint8_t)*str;
+            value *= 1099511628211ULL;
+        } while( *str++ != 0 );
+    }
+    return value;
+}
+
+bool ShaderCache::initialize()
+{
+    // the cache is optional, a missing or stale file is rebuilt
+    if( fs::is_regular_file(_path) )
+        load();
+    return true;
+}
+
+void ShaderCache::dispose()
+{
+    save();
+}
+
+ShaderCache::entry_ptr ShaderCache::find(uint64_t key) const
+{
+    std::unique_lock<std::mutex> L(_mutex);
+    auto found = _entries.find(key);
+    return found == _entries.end() ? nullptr : found->second;
+}
+
+void ShaderCache::add(uint64_t key, entry_ptr entry)
+{
+    std::unique_lock<std::mutex> L(_mutex);
+    _entries[key] = entry;
+}
+
+bool ShaderCache::load()
+{
+    auto in = fs::open(_path, fs::FileMode::READ | fs::FileMode::BINARY);
+    if( !in.is_open() )
+        return false;
+
+    in.seekg(0, std::ios::end);
+    auto total = (uint64_t)std::max((std::streamoff)0, (std::streamoff)in.tellg());
+    in.seekg(0, std::ios::beg);
+
+    char magic[4];
+    uint32_t version, count;
+    in.read(magic, sizeof(magic));
+    if( !in.good() || memcmp(magic, kShaderCacheMagic, sizeof(magic)) != 0 ||
+        !read_value(in, version) || version != kVersion || !read_value(in, count) )
+    {
+        LOGW("invalid shader cache %s.", _path.c_str());
+        return false;
+    }
+
+    std::unordered_map<uint64_t, entry_ptr> entries;
+    for( uint32_t i = 0; i < count; i++ )
+    {
+        uint64_t key;
+        uint32_t uniforms, format, size;
+        auto entry = std::make_shared<Entry>();
+        entry->binary = std::make_shared<graphics::ProgramBinary>();
+
+        if( !read_value(in, key) || !read_value(in, uniforms) )
+            break;
+
+        bool valid = true;
+        for( uint32_t j = 0; j < uniforms && valid; j++ )
+        {
+            ShaderUniform uniform;
+            valid = read_string(in, total, uniform.name) &&
+                read_string(in, total, uniform.type) &&
+                read_value(in, uniform.size);
+            if( valid )
+                entry->uniforms.push_back(uniform);
+        }
+
+        if( !valid || !read_value(in, format) || !read_value(in, size) || size > get_remaining(in, total) )
+            break;
+
+        entry->binary->format = format;
+        entry->binary->data.resize(size);
+        in.read((char*)entry->binary->data.data(), size);
+        if( !in.good() )
+            break;
+
+        entries.insert(std::make_pair(key, entry));
+    }
+
+    if( entries.size() != count )
+    {
+        LOGW("truncated or corrupted shader cache %s.", _path.c_str());
+        return false;
+    }
+
+    std::unique_lock<std::mutex> L(_mutex);
+    _entries.swap(entries);
+    return true;
+}
+
+bool ShaderCache::save()
+{
+    auto out = fs::open(_path, fs::FileMode::WRITE | fs::FileMode::BINARY | fs::FileMode::TRUNCATE);
+    if( !out.is_open() )
+        return false;
+
+    std::unique_lock<std::mutex> L(_mutex);
+    out.write(kShaderCacheMagic, sizeof(kShaderCacheMagic));
+    write_value(out, (uint32_t)kVersion);
+    write_value(out, (uint32_t)_entries.size());
+
+    for( auto& pair : _entries )
+    {
+        write_value(out, pair.first);
+        write_value(out, (uint32_t)pair.second->uniforms.size());
+        for( auto& uniform : pair.second->uniforms )
+        {
+            write_string(out, uniform.name);
+            write_string(out, uniform.type);
+            write_value(out, uniform.size);
+        }
+
+        // binaries not retrieved yet are saved as empty
+        auto& binary = *pair.second->binary;
+        std::unique_lock<std::mutex> BL(binary.mutex);
+        write_value(out, binary.format);
+        write_value(out, (uint32_t)binary.data.size());
+        out.write((const char*)binary.data.data(), binary.data.size());
+    }
+
+    if( (out.rdstate() & std::ifstream::failbit ) != 0 )
+    {
+        LOGW("failed to write shader cache %s.", _path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
 NS_LEMON_RESOURCE_END
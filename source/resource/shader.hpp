@@ -6,8 +6,23 @@
 #include <resource/resource.hpp>
 #include <graphics/graphics.hpp>
 
+#include <mutex>
+#include <unordered_map>
+
 NS_LEMON_RESOURCE_BEGIN
 
+// an uniform variable declared in shader sources
+struct ShaderUniform
+{
+    std::string name;
+    // the glsl type, e.g. vec3, sampler2D
+    std::string type;
+    // number of elements if its an array, 1 otherwise
+    uint16_t size;
+
+    bool is_sampler() const { return type.compare(0, 7, "sampler") == 0; }
+};
+
 struct Shader : public Resource
 {
     using ptr = std::shared_ptr<Shader>;
@@ -18,7 +33,9 @@ struct Shader : public Resource
 public:
     virtual ~Shader();
 
+    using Resource::read;
     bool read(std::istream&) override;
+    bool read(fs::ByteSpan) override;
     bool save(std::ostream&) override;
     bool update_video_object() override;
 
@@ -32,17 +49,65 @@ public:
     const std::string& get_fragment_shader() const;
 
     bool has_uniform_variable(const char* name) const;
+    const std::vector<ShaderUniform>& get_uniforms() const;
+    // returns the slot of uniform in program, which is its index in uniforms, or
+    // kInvalidUniformSlot if not exists
+    uint8_t get_uniform_slot(math::StringHash) const;
 
     Handle get_video_uid() const;
 
 protected:
+    bool parse(const char*, size_t);
     void scan_uniforms(const std::string&);
+    void update_cache(bool scanned);
+    void update_uniform_hashes();
 
     Handle _program;
     bool _dirty = false;
     std::string _vertex;
     std::string _fragment;
-    std::vector<std::string> _uniforms;
+    std::vector<ShaderUniform> _uniforms;
+    std::vector<math::StringHash> _uniform_hashes;
+    std::shared_ptr<graphics::ProgramBinary> _binary;
+};
+
+// persistent cache of shaders keyed by the hash of vertex/fragment sources. it keeps the
+// reflected uniforms and the linked program binaries, so warm starts could skip both the
+// scanning and linking. entries are loaded when initialized and saved when disposed.
+struct ShaderCache : public core::Subsystem
+{
+    struct Entry
+    {
+        std::vector<ShaderUniform> uniforms;
+        std::shared_ptr<graphics::ProgramBinary> binary;
+    };
+
+    using entry_ptr = std::shared_ptr<Entry>;
+
+    // returns the key of sources
+    static uint64_t hash(const char* vs, const char* fs);
+
+public:
+    ShaderCache(const fs::Path& path) : _path(path) {}
+
+    bool initialize() override;
+    void dispose() override;
+
+    // returns the entry associated with key, nullptr if not exists. its safe to be
+    // called from any thread.
+    entry_ptr find(uint64_t) const;
+    // add or replace the entry associated with key
+    void add(uint64_t, entry_ptr);
+    // load/save entries from/to file, returns true if successful
+    bool load();
+    bool save();
+
+protected:
+    const static uint32_t kVersion = 2;
+
+    fs::Path _path;
+    mutable std::mutex _mutex;
+    std::unordered_map<uint64_t, entry_ptr> _entries;
 };
 
 INLINE const std::string& Shader::get_vertex_shader() const
@@ -62,13 +127,23 @@ INLINE Handle Shader::get_video_uid() const
 
 INLINE bool Shader::has_uniform_variable(const char* name) const
 {
-    for( size_t i = 0; i < _uniforms.size(); i++ )
+    return get_uniform_slot(name) != graphics::kInvalidUniformSlot;
+}
+
+INLINE uint8_t Shader::get_uniform_slot(math::StringHash hash) const
+{
+    for( size_t i = 0; i < _uniform_hashes.size() && i < graphics::kMaxUniformsPerMaterial; i++ )
     {
-        if( _uniforms[i] == name )
-            return true;
+        if( _uniform_hashes[i] == hash )
+            return (uint8_t)i;
     }
 
-    return false;
+    return graphics::kInvalidUniformSlot;
+}
+
+INLINE const std::vector<ShaderUniform>& Shader::get_uniforms() const
+{
+    return _uniforms;
 }
 
 NS_LEMON_RESOURCE_END
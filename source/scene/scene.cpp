@@ -3,9 +3,11 @@
 
 #include <scene/scene.hpp>
 #include <core/event.hpp>
+#include <core/profiler.hpp>
 #include <scene/mesh.hpp>
 #include <math/vector.hpp>
 #include <graphics/frontend.hpp>
+#include <codebase/frame_allocator.hpp>
 
 NS_LEMON_BEGIN
 
@@ -13,56 +15,21 @@ using namespace core;
 
 bool Scene::initialize()
 {
-    core::get_subsystem<EventSystem>()->subscribe<EvtRenderUpdate>(this);
     core::get_subsystem<EventSystem>()->subscribe<EvtRender>(this);
     return true;
 }
 
 void Scene::dispose()
 {
-    core::get_subsystem<EventSystem>()->unsubscribe<EvtRenderUpdate>(this);
     core::get_subsystem<EventSystem>()->unsubscribe<EvtRender>(this);
 }
 
-void Scene::receive(const EvtRenderUpdate& evt)
-{
-    auto ecs = core::get_subsystem<EntityComponentSystem>();
-
-    std::vector<std::tuple<Transform*, Camera*>> cameras;
-    ecs->find_entities_with<Transform, PerspectiveCamera>().collect(cameras);
-    ecs->find_entities_with<Transform, OrthoCamera>().collect(cameras);
-
-    for( auto camera : cameras )
-        update_with_camera(*std::get<0>(camera), *std::get<1>(camera));
-}
-
-void Scene::update_with_camera(Transform& transform, Camera& camera)
-{
-    auto projection_matrix = camera.get_projection_matrix();
-    auto view_matrix = Camera::get_view_matrix(transform);
-    auto view_pos = transform.get_position(TransformSpace::WORLD);
-
-    auto ecs = core::get_subsystem<EntityComponentSystem>();
-    ecs->find_entities_with<Transform, MeshRenderer>().visit(
-        [=](Entity&, Transform& transform, MeshRenderer& mesh)
-        {
-            graphics::UniformVariable v;
-            v.set<math::Matrix4f>(projection_matrix);
-            mesh.material->set_uniform_variable("lm_ProjectionMatrix", v);
-
-            v.set<math::Matrix4f>(view_matrix);
-            mesh.material->set_uniform_variable("lm_ViewMatrix", v);
-
-            v.set<math::Vector3f>(view_pos);
-            mesh.material->set_uniform_variable("lm_ViewPos", v);
-        });
-}
-
 void Scene::receive(const EvtRender& evt)
 {
+    PROFILE_SCOPE("scene.render");
     auto ecs = core::get_subsystem<EntityComponentSystem>();
 
-    std::vector<std::tuple<Transform*, Camera*>> cameras;
+    frame_vector<std::tuple<Transform*, Camera*>> cameras;
     ecs->find_entities_with<Transform, PerspectiveCamera>().collect(cameras);
     ecs->find_entities_with<Transform, OrthoCamera>().collect(cameras);
 
@@ -72,9 +39,20 @@ void Scene::receive(const EvtRender& evt)
 
 void Scene::draw_with_camera(Transform& transform, Camera& camera)
 {
+    PROFILE_SCOPE("scene.camera");
     auto frontend = core::get_subsystem<graphics::RenderFrontend>();
     frontend->clear(graphics::ClearOption::COLOR | graphics::ClearOption::DEPTH, {0.75, 0.75, 0.75}, 1.f);
 
+    // the uniforms of view are shared by all the draw calls of this camera
+    graphics::UniformVariable v;
+    auto view = frontend->allocate_uniform_buffer(3);
+    v.set<math::Matrix4f>(camera.get_projection_matrix());
+    frontend->update_uniform_buffer(view, "lm_ProjectionMatrix", v);
+    v.set<math::Matrix4f>(Camera::get_view_matrix(transform));
+    frontend->update_uniform_buffer(view, "lm_ViewMatrix", v);
+    v.set<math::Vector3f>(transform.get_position(TransformSpace::WORLD));
+    frontend->update_uniform_buffer(view, "lm_ViewPos", v);
+
     auto ecs = core::get_subsystem<EntityComponentSystem>();
     ecs->find_entities_with<Transform, MeshRenderer>().visit(
         [=](Entity&, Transform& transform, MeshRenderer& mesh)
@@ -86,6 +64,7 @@ void Scene::draw_with_camera(Transform& transform, Camera& camera)
             drawcall.buffer_vertex = mesh.primitive->get_video_vertex_buffer();
             drawcall.buffer_index = mesh.primitive->get_video_index_buffer();
             drawcall.shared_uniforms = mesh.material->get_video_uniforms();
+            drawcall.view_uniforms = view;
 
             graphics::UniformVariable v;
             auto uniforms = frontend->allocate_uniform_buffer(2);
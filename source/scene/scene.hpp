@@ -18,11 +18,9 @@ struct Scene : public core::Subsystem
     bool initialize() override;
     void dispose() override;
 
-    void receive(const EvtRenderUpdate&);
     void receive(const EvtRender&);
 
 protected:
-    void update_with_camera(Transform& transform, Camera& camera);
     void draw_with_camera(Transform& transform, Camera& camera);
 };
 
@@ -0,0 +1,210 @@
+#include <catch.hpp>
+#include <hayai.hpp>
+#include <lemon-toolkit.hpp>
+
+#include <codebase/debug/log.hpp>
+#include <codebase/debug/stacktrace.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+USING_NS_LEMON;
+
+TEST_CASE("TestAsyncLog")
+{
+    std::stringstream stream;
+    set_output_stream(LogLevel::INFORMATION, &stream);
+
+    LOGI("hello %s %d.", "world", 42);
+    flush_log();
+    REQUIRE( stream.str().find("hello world 42.") != std::string::npos );
+
+    // records of each thread are written in order
+    std::vector<std::thread> threads;
+    for( unsigned t = 0; t < 4; t++ )
+    {
+        threads.push_back(std::thread([=]()
+        {
+            for( unsigned i = 0; i < 64; i++ )
+                LOGW("thread %u record %u", t, i);
+        }));
+    }
+
+    for( auto& thread : threads )
+        thread.join();
+    flush_log();
+
+    auto str = stream.str();
+    for( unsigned t = 0; t < 4; t++ )
+    {
+        size_t last = 0;
+        for( unsigned i = 0; i < 64; i++ )
+        {
+            char expected[64];
+            snprintf(expected, sizeof(expected), "thread %u record %u\x1b", t, i);
+            auto found = str.find(expected);
+            REQUIRE( found != std::string::npos );
+            REQUIRE( found >= last );
+            last = found;
+        }
+    }
+
+    // records below filter are discarded
+    set_output_stream(LogLevel::ERROR, &stream);
+    LOGW("filtered");
+    flush_log();
+    REQUIRE( stream.str().find("filtered") == std::string::npos );
+
+    set_output_stream(LogLevel::INFORMATION, &std::cout);
+}
+
+// returns the tid in prefix of the line contains message
+static std::string find_log_tid(const std::string& str, const char* message)
+{
+    auto found = str.find(message);
+    if( found == std::string::npos )
+        return std::string();
+
+    auto start = str.rfind("][", found);
+    auto end = str.find(']', start + 2);
+    return str.substr(start + 2, end - start - 2);
+}
+
+TEST_CASE("TestLogQueueReuse")
+{
+    std::stringstream stream;
+    set_output_stream(LogLevel::INFORMATION, &stream);
+
+    // the queue of exited thread is reused with a new tid
+    std::thread([]() { LOGI("from exited thread"); }).join();
+    std::thread([]() { LOGI("from reusing thread"); }).join();
+    flush_log();
+
+    auto str = stream.str();
+    auto exited = find_log_tid(str, "from exited thread");
+    auto reusing = find_log_tid(str, "from reusing thread");
+    REQUIRE( !exited.empty() );
+    REQUIRE( !reusing.empty() );
+    REQUIRE( exited != reusing );
+
+    set_output_stream(LogLevel::INFORMATION, &std::cout);
+}
+
+TEST_CASE("TestAbortExits")
+{
+    auto pid = fork();
+    REQUIRE( pid >= 0 );
+
+    if( pid == 0 )
+    {
+        // leaked to outlive the log, which is written once more on exit
+        set_output_stream(LogLevel::INFORMATION, new std::ofstream("abort_test.log"));
+        // the fatal record is written even if the queue of thread is full
+        for( unsigned i = 0; i < 1024; i++ )
+            LOGI("before abort");
+        ABORT(__FILE__, __LINE__, "abort in child");
+        _exit(1);
+    }
+
+    // the child should exit by itself instead of hanging on the mutex of log
+    int status = 0;
+    bool exited = false;
+    for( unsigned i = 0; i < 1000 && !exited; i++ )
+    {
+        exited = waitpid(pid, &status, WNOHANG) == pid;
+        if( !exited )
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    if( !exited )
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+
+    REQUIRE( exited );
+    REQUIRE( WIFEXITED(status) );
+    REQUIRE( WEXITSTATUS(status) == 0 );
+
+    std::string output;
+    {
+        std::ifstream file("abort_test.log");
+        output.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    std::remove("abort_test.log");
+
+    REQUIRE( output.find("abort in child") != std::string::npos );
+    REQUIRE( output.find("Stacktrace:") != std::string::npos );
+}
+
+BENCHMARK(DebugTest, Log, 10, 1)
+{
+    std::stringstream stream;
+    set_output_stream(LogLevel::INFORMATION, &stream);
+
+    for( unsigned i = 0; i < 200; i++ )
+        LOGI("benchmark record %u of %s", i, "log");
+
+    flush_log();
+    set_output_stream(LogLevel::INFORMATION, &std::cout);
+}
+
+__attribute__((noinline)) static unsigned capture_for_test(void** frames, unsigned max)
+{
+    return capture_stack(frames, max, 0);
+}
+
+TEST_CASE("TestStackCapture")
+{
+    // the same frames have the same hash
+    void* stacks[2][16];
+    unsigned sizes[2];
+    for( unsigned i = 0; i < 2; i++ )
+        sizes[i] = capture_for_test(stacks[i], 16);
+
+    auto frames = stacks[0];
+    auto size = sizes[0];
+    REQUIRE( size > 0 );
+    REQUIRE( size <= 16 );
+    REQUIRE( sizes[1] == size );
+    REQUIRE( stacks[0][0] == stacks[1][0] );
+    REQUIRE( hash_stack(stacks[0], 1) == hash_stack(stacks[1], 1) );
+    REQUIRE( hash_stack(frames, size) != hash_stack(frames, size - 1) );
+
+    // frames are limited by max
+    REQUIRE( capture_for_test(frames, 2) == 2 );
+
+    // symbols are resolved and cached
+    auto symbol = symbolize(frames[0]);
+    REQUIRE( !symbol.empty() );
+    REQUIRE( symbolize(frames[0]) == symbol );
+
+    std::stringstream stream;
+    write_stack(stream, frames, 2);
+    REQUIRE( stream.str().find(symbol) != std::string::npos );
+
+    std::stringstream trace;
+    stacktrace(trace);
+    REQUIRE( !trace.str().empty() );
+}
+
+BENCHMARK(DebugTest, CaptureStack, 10, 1)
+{
+    void* frames[kDbgMaxTracebackFrames];
+    for( unsigned i = 0; i < 1000; i++ )
+        capture_stack(frames, kDbgMaxTracebackFrames);
+}
+
+BENCHMARK(DebugTest, Stacktrace, 10, 1)
+{
+    std::stringstream stream;
+    for( unsigned i = 0; i < 1000; i++ )
+        stacktrace(stream);
+}
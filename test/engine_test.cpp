@@ -0,0 +1,100 @@
+#include <catch.hpp>
+#include <lemon-toolkit.hpp>
+
+#include <sstream>
+
+USING_NS_LEMON;
+
+TEST_CASE("TestFrameStatistics")
+{
+    FrameStatistics statistics(100);
+    REQUIRE( statistics.get_summary(FramePhase::FRAME).samples == 0 );
+
+    // frames of 1ms to 100ms in shuffled order
+    std::vector<unsigned> durations;
+    for( unsigned i = 1; i <= 100; i++ )
+        durations.push_back(i);
+    std::random_shuffle(durations.begin(), durations.end());
+
+    for( auto ms : durations )
+    {
+        statistics.record(FramePhase::FRAME, std::chrono::milliseconds(ms));
+        statistics.record(FramePhase::UPDATE, std::chrono::milliseconds(1));
+        statistics.record(FramePhase::UPDATE, std::chrono::milliseconds(1));
+        statistics.end_frame();
+    }
+
+    auto frame = statistics.get_summary(FramePhase::FRAME);
+    REQUIRE( frame.samples == 100 );
+    REQUIRE( frame.p50 == Approx(50.f) );
+    REQUIRE( frame.p95 == Approx(95.f) );
+    REQUIRE( frame.p99 == Approx(99.f) );
+    REQUIRE( frame.worst == Approx(100.f) );
+    REQUIRE( frame.average == Approx(50.5f) );
+
+    // durations of a phase are accumulated in frame, and the missing ones are zero
+    REQUIRE( statistics.get_summary(FramePhase::UPDATE).p99 == Approx(2.f) );
+    REQUIRE( statistics.get_summary(FramePhase::DRAW).worst == 0.f );
+
+    // the window rolls over the oldest frames, but the worst one is kept
+    for( unsigned i = 0; i < 100; i++ )
+    {
+        statistics.record(FramePhase::FRAME, std::chrono::milliseconds(10));
+        statistics.end_frame();
+    }
+
+    frame = statistics.get_summary(FramePhase::FRAME);
+    REQUIRE( frame.samples == 100 );
+    REQUIRE( frame.worst == Approx(10.f) );
+    REQUIRE( statistics.get_worst(FramePhase::FRAME) == Approx(100.f) );
+    REQUIRE( statistics.get_frames() == 200 );
+
+    std::stringstream dump;
+    REQUIRE( statistics.save(dump) );
+    REQUIRE( dump.str().find("frame") != std::string::npos );
+
+    statistics.reset();
+    REQUIRE( statistics.get_summary(FramePhase::FRAME).samples == 0 );
+}
+
+TEST_CASE("TestFixedTimestep")
+{
+    using ms = std::chrono::milliseconds;
+
+    FixedTimestep timestep;
+    REQUIRE( !timestep.is_enabled() );
+    REQUIRE( timestep.advance(ms(100)) == 0 );
+    REQUIRE( timestep.get_alpha() == 1.f );
+
+    timestep.set_step(ms(10));
+    timestep.set_max_steps(4);
+    REQUIRE( timestep.is_enabled() );
+
+    // steps are consumed from accumulated time, the remaining is used for interpolation
+    REQUIRE( timestep.advance(ms(4)) == 0 );
+    REQUIRE( timestep.get_alpha() == Approx(0.4f) );
+    REQUIRE( timestep.advance(ms(8)) == 1 );
+    REQUIRE( timestep.get_alpha() == Approx(0.2f) );
+    REQUIRE( timestep.advance(ms(28)) == 3 );
+    REQUIRE( timestep.get_alpha() == Approx(0.0f) );
+
+    // the time can not be caught up is dropped
+    REQUIRE( timestep.advance(ms(1005)) == 4 );
+    REQUIRE( timestep.get_alpha() == Approx(0.5f) );
+    REQUIRE( timestep.advance(ms(5)) == 1 );
+}
+
+TEST_CASE("TestWaitUntil")
+{
+    using clock = std::chrono::high_resolution_clock;
+
+    auto start = clock::now();
+    auto deadline = start + std::chrono::milliseconds(5);
+    wait_until(deadline, std::chrono::milliseconds(1));
+    REQUIRE( clock::now() >= deadline );
+
+    // returns immediately if the deadline has passed
+    start = clock::now();
+    wait_until(start - std::chrono::milliseconds(1), std::chrono::milliseconds(1));
+    REQUIRE( clock::now() - start < std::chrono::milliseconds(50) );
+}
@@ -1,6 +1,11 @@
 #include <catch.hpp>
+#include <hayai.hpp>
 #include <lemon-toolkit.hpp>
 
+#include <functional>
+#include <unordered_map>
+
+USING_NS_LEMON;
 USING_NS_LEMON_CORE;
 
 struct Explosion
@@ -80,3 +85,225 @@ TEST_CASE_METHOD(EventTestContext, "TestUnsubscription") {
     event.emit<Explosion>(1);
     REQUIRE(explosion_system.damage_received == 1);
 }
+
+struct OrderedSystem
+{
+    OrderedSystem(std::vector<int>& sequence, int id) : sequence(sequence), id(id) {}
+
+    void receive(const Explosion& explosion)
+    {
+        sequence.push_back(id);
+    }
+
+    std::vector<int>& sequence;
+    int id;
+};
+
+TEST_CASE_METHOD(EventTestContext, "TestHandleUnsubscription")
+{
+    std::vector<int> sequence;
+    std::vector<OrderedSystem> systems;
+    for( int i = 0; i < 8; i++ )
+        systems.emplace_back(sequence, i);
+
+    std::vector<Handle> handles;
+    for( auto& system : systems )
+        handles.push_back(event.subscribe<Explosion>(system));
+
+    REQUIRE( event.subscribe<Explosion>(systems[0]) == handles[0] );
+
+    event.emit<Explosion>(1);
+    REQUIRE( sequence == (std::vector<int> { 0, 1, 2, 3, 4, 5, 6, 7 }) );
+
+    // order of the rest receivers are stable after unsubscription and compaction
+    REQUIRE( event.unsubscribe(handles[1]) );
+    REQUIRE( event.unsubscribe(handles[4]) );
+    REQUIRE( !event.unsubscribe(handles[4]) );
+    event.unsubscribe<Explosion>(systems[6]);
+    REQUIRE( !event.unsubscribe(handles[6]) );
+
+    sequence.clear();
+    event.emit<Explosion>(1);
+    REQUIRE( sequence == (std::vector<int> { 0, 2, 3, 5, 7 }) );
+
+    REQUIRE( event.unsubscribe(handles[0]) );
+    REQUIRE( event.unsubscribe(handles[3]) );
+    REQUIRE( event.unsubscribe(handles[7]) );
+
+    sequence.clear();
+    event.emit<Explosion>(1);
+    REQUIRE( sequence == (std::vector<int> { 2, 5 }) );
+
+    handles[1] = event.subscribe<Explosion>(systems[1]);
+    sequence.clear();
+    event.emit<Explosion>(1);
+    REQUIRE( sequence == (std::vector<int> { 2, 5, 1 }) );
+}
+
+struct SelfUnsubscribeSystem
+{
+    SelfUnsubscribeSystem(EventSystem& event) : event(event) {}
+
+    void receive(const Explosion& explosion)
+    {
+        received_count ++;
+        event.unsubscribe(handle);
+    }
+
+    EventSystem& event;
+    Handle handle;
+    int received_count = 0;
+};
+
+TEST_CASE_METHOD(EventTestContext, "TestUnsubscriptionWhileEmitting")
+{
+    ExplosionSystem explosion_system;
+    SelfUnsubscribeSystem self_system(event);
+
+    self_system.handle = event.subscribe<Explosion>(self_system);
+    event.subscribe<Explosion>(explosion_system);
+
+    event.emit<Explosion>(1);
+    event.emit<Explosion>(1);
+    REQUIRE(self_system.received_count == 1);
+    REQUIRE(explosion_system.received_count == 2);
+}
+
+struct BatchExplosionSystem
+{
+    void receive(EventSpan<Explosion> explosions)
+    {
+        batch_count ++;
+        for( auto& explosion : explosions )
+        {
+            damage_received += explosion.damage;
+            received_count ++;
+        }
+    }
+
+    int batch_count = 0;
+    int received_count = 0;
+    int damage_received = 0;
+};
+
+TEST_CASE_METHOD(EventTestContext, "TestQueueDispatch")
+{
+    BatchExplosionSystem batch_system;
+    ExplosionSystem explosion_system;
+
+    event.subscribe_batch<Explosion>(batch_system);
+    event.subscribe<Explosion>(explosion_system);
+
+    event.queue<Explosion>(1);
+    event.queue<Explosion>(2);
+    event.queue<Explosion>(3);
+
+    // queued events are invisible until dispatch, and never emitted to immediate receivers
+    REQUIRE(batch_system.received_count == 0);
+    event.dispatch();
+    REQUIRE(batch_system.batch_count == 1);
+    REQUIRE(batch_system.received_count == 3);
+    REQUIRE(batch_system.damage_received == 6);
+    REQUIRE(explosion_system.received_count == 0);
+
+    // drained after dispatch
+    event.dispatch();
+    REQUIRE(batch_system.batch_count == 1);
+
+    event.unsubscribe_batch<Explosion>(batch_system);
+    event.queue<Explosion>(1);
+    event.dispatch();
+    REQUIRE(batch_system.received_count == 3);
+}
+
+TEST_CASE_METHOD(EventTestContext, "TestQueueFromThreads")
+{
+    const int kThreads = 4;
+    const int kEvents = 1000;
+
+    BatchExplosionSystem batch_system;
+    event.subscribe_batch<Explosion>(batch_system);
+
+    std::vector<std::thread> threads;
+    for( int i = 0; i < kThreads; i++ )
+    {
+        threads.emplace_back([&]()
+        {
+            for( int j = 0; j < kEvents; j++ )
+                event.queue<Explosion>(1);
+        });
+    }
+
+    for( auto& thread : threads )
+        thread.join();
+
+    event.dispatch();
+    REQUIRE(batch_system.received_count == kThreads*kEvents);
+    REQUIRE(batch_system.damage_received == kThreads*kEvents);
+    REQUIRE(batch_system.batch_count <= kThreads);
+}
+
+// the previous implementation of immediate events, which stores receivers with
+// std::function in hash maps, kept here as the baseline of benchmarks.
+struct LegacyEventSystem
+{
+    template<typename E, typename R> void subscribe(R& receiver)
+    {
+        const auto index = TypeInfoGeneric::id<Event, E>();
+        if( _table.size() <= index )
+            _table.resize(index+1);
+
+        const auto id = (size_t)(&receiver);
+        _table[index].insert(std::make_pair(id, [&](const void* event)
+        {
+            receiver.receive(*static_cast<const E*>(event));
+        }));
+    }
+
+    template<typename E, typename ... Args> void emit(Args && ... args)
+    {
+        E event(std::forward<Args>(args)...);
+
+        auto index = TypeInfoGeneric::id<Event, E>();
+        if( _table.size() <= index )
+            return;
+
+        for( auto& pair : _table[index] )
+            pair.second(static_cast<const void*>(&event));
+    }
+
+protected:
+    using closure = std::function<void(const void*)>;
+    using mailbox = std::unordered_map<TypeInfoGeneric::index_t, closure>;
+    std::vector<mailbox> _table;
+};
+
+const static size_t kBenchSubscribers = 1000;
+const static size_t kBenchEmits = 1000;
+const static size_t kBenchIterations = 8;
+
+template<typename T> struct EventBenchContext
+{
+    EventBenchContext() : receivers(kBenchSubscribers)
+    {
+        for( auto& receiver : receivers )
+            event.template subscribe<Explosion>(receiver);
+    }
+
+    T event;
+    std::vector<ExplosionSystem> receivers;
+};
+
+BENCHMARK(EventTest, EmitLegacy1k, kBenchIterations, 1)
+{
+    static EventBenchContext<LegacyEventSystem> context;
+    for( size_t i = 0; i < kBenchEmits; i++ )
+        context.event.emit<Explosion>(1);
+}
+
+BENCHMARK(EventTest, Emit1k, kBenchIterations, 1)
+{
+    static EventBenchContext<EventSystem> context;
+    for( size_t i = 0; i < kBenchEmits; i++ )
+        context.event.emit<Explosion>(1);
+}
@@ -0,0 +1,188 @@
+#include <catch.hpp>
+#include <lemon-toolkit.hpp>
+
+#include <graphics/backend/staging.hpp>
+#include <graphics/backend/uniform.hpp>
+#include <graphics/backend/frame.hpp>
+#include <graphics/backend/backend.hpp>
+
+#include <thread>
+
+USING_NS_LEMON;
+USING_NS_LEMON_GRAPHICS;
+
+TEST_CASE("TestStagingRing")
+{
+    StagingRing ring;
+    size_t offset = 0;
+    REQUIRE( !ring.is_valid() );
+    REQUIRE( !ring.allocate(16, offset) );
+
+    std::vector<uint8_t> memory(256);
+    ring.reset(memory.data(), memory.size());
+    REQUIRE( ring.is_valid() );
+    REQUIRE( !ring.allocate(0, offset) );
+    REQUIRE( !ring.allocate(257, offset) );
+
+    // regions are aligned
+    REQUIRE( ring.allocate(10, offset) );
+    REQUIRE( offset == 0 );
+    REQUIRE( ring.allocate(100, offset) );
+    REQUIRE( offset == 16 );
+    REQUIRE( ring.get_position() == 116 );
+
+    // the remaining bytes are skipped instead of straddling the end
+    REQUIRE( ring.allocate(100, offset) );
+    REQUIRE( offset == 128 );
+    REQUIRE( !ring.allocate(64, offset) );
+
+    // frames released by device are reused
+    auto frame = ring.get_position();
+    ring.release(116);
+    REQUIRE( ring.get_used() == frame - 116 );
+    REQUIRE( ring.allocate(64, offset) );
+    REQUIRE( offset == 0 );
+    REQUIRE( !ring.allocate(64, offset) );
+
+    ring.release(frame);
+    ring.release(116);
+    REQUIRE( ring.get_used() == 64 + (256 - 228) );
+    REQUIRE( ring.allocate(128, offset) );
+    REQUIRE( offset == 64 );
+    REQUIRE( !ring.allocate(128, offset) );
+
+    ring.reset(nullptr, 0);
+    REQUIRE( !ring.allocate(16, offset) );
+}
+
+TEST_CASE("TestUniformArena")
+{
+    std::unique_ptr<UniformArena> arena(new UniformArena());
+    arena->reset(1);
+    REQUIRE( arena->fetch(Handle()) == nullptr );
+
+    // the arena grows beyond the capacity of a chunk
+    std::vector<Handle> handles;
+    for( unsigned i = 0; i < 4096; i++ )
+    {
+        auto handle = arena->allocate(4);
+        REQUIRE( handle.is_valid() );
+        handles.push_back(handle);
+
+        auto block = arena->fetch(handle);
+        REQUIRE( block != nullptr );
+        REQUIRE( block->num == 4 );
+        REQUIRE( block->used == 0 );
+        block->entries()[0].slot = (uint8_t)(i % 255);
+        block->used = 1;
+    }
+    REQUIRE( arena->get_used() > UniformArena::kChunkSize );
+
+    for( unsigned i = 0; i < handles.size(); i++ )
+    {
+        auto block = arena->fetch(handles[i]);
+        REQUIRE( block->used == 1 );
+        REQUIRE( block->entries()[0].slot == (uint8_t)(i % 255) );
+    }
+
+    // handles of previous frames are not alive anymore
+    arena->reset(2);
+    REQUIRE( arena->get_used() == 0 );
+    REQUIRE( arena->fetch(handles[0]) == nullptr );
+    REQUIRE( arena->fetch(Handle(0, 1)) == nullptr );
+
+    auto handle = arena->allocate(2);
+    REQUIRE( handle.get_index() == 0 );
+    REQUIRE( handle.get_version() == 2 );
+
+    // allocations are safe from multiple threads
+    arena->reset(3);
+    std::vector<std::thread> threads;
+    std::vector<Handle> results(4 * 1024);
+    for( unsigned t = 0; t < 4; t++ )
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            for( unsigned i = 0; i < 1024; i++ )
+            {
+                auto h = arena->allocate(1 + i % 8);
+                arena->fetch(h)->used = t * 1024 + i;
+                results[t * 1024 + i] = h;
+            }
+        }));
+    }
+
+    for( auto& thread : threads )
+        thread.join();
+
+    for( unsigned i = 0; i < results.size(); i++ )
+    {
+        REQUIRE( arena->fetch(results[i]) != nullptr );
+        REQUIRE( arena->fetch(results[i])->used == i );
+    }
+}
+
+TEST_CASE("TestRenderFrameStates")
+{
+    std::unique_ptr<RenderFrame> frame(new RenderFrame(16, 1024));
+
+    RenderState state;
+    state.depth.enable = true;
+
+    RenderDrawCall dc;
+    dc.state = Handle(3, 1);
+    REQUIRE( frame->get_state(dc.state) == nullptr );
+
+    // the state is snapshotted when submitted
+    frame->submit(dc, &state);
+    state.depth.enable = false;
+    frame->submit(dc, &state);
+    REQUIRE( frame->get_state(dc.state) != nullptr );
+    REQUIRE( frame->get_state(dc.state)->depth.enable );
+    REQUIRE( frame->get_state(Handle(3, 2)) == nullptr );
+
+    // modified states are applied to the snapshot
+    frame->update_state(dc.state, state);
+    frame->submit(dc, &state);
+    REQUIRE( !frame->get_state(dc.state)->depth.enable );
+    REQUIRE( frame->_drawcalls.size() == 3 );
+
+    // states not submitted yet are not snapshotted by updates
+    frame->update_state(Handle(4, 1), state);
+    REQUIRE( frame->get_state(Handle(4, 1)) == nullptr );
+
+    frame->clear();
+    REQUIRE( frame->get_state(dc.state) == nullptr );
+    REQUIRE( frame->_drawcalls.size() == 0 );
+}
+
+struct FrontendProbe : public RenderFrontend
+{
+    const RenderState* get_submitted_state(Handle handle) const { return _submit->get_state(handle); }
+};
+
+TEST_CASE("TestFrontendUpdateSubmittedState")
+{
+    core::details::initialize();
+
+    FrontendProbe frontend;
+    REQUIRE( frontend.initialize() );
+
+    RenderState state;
+    state.depth.enable = true;
+    auto handle = frontend.create_render_state(state);
+    REQUIRE( handle.is_valid() );
+
+    // the drawcall submitted before updating is drawn with the updated state
+    RenderDrawCall dc;
+    dc.state = handle;
+    frontend.submit(dc);
+
+    state.depth.enable = false;
+    frontend.update_render_state(handle, state);
+    REQUIRE( frontend.get_submitted_state(handle) != nullptr );
+    REQUIRE( !frontend.get_submitted_state(handle)->depth.enable );
+
+    frontend.dispose();
+    core::details::dispose();
+}
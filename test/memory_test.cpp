@@ -6,6 +6,9 @@
 #include <ctime>
 
 #include <codebase/memory_pool.hpp>
+#include <codebase/memory_tracker.hpp>
+#include <codebase/frame_allocator.hpp>
+#include <codebase/debug/log.hpp>
 
 USING_NS_LEMON;
 USING_NS_LEMON_CORE;
@@ -387,3 +390,133 @@ BENCHMARK(MemoryTest, System, max_iterations, 1)
     for( void* ptr : ptrs )
         ::free(ptr);
 }
+
+TEST_CASE("TestMemoryTracker")
+{
+    auto before = get_memory_stats(MemoryTag::GENERAL);
+
+    {
+        auto bytes = allocate_tagged(MemoryTag::GENERAL, 1024);
+        REQUIRE( bytes != nullptr );
+
+        auto shared = allocate_tagged_shared(MemoryTag::GENERAL, 512);
+        auto copy = shared;
+        REQUIRE( shared != nullptr );
+
+        auto stats = get_memory_stats(MemoryTag::GENERAL);
+        REQUIRE( stats.live == before.live + 1536 );
+        REQUIRE( stats.peak >= stats.live );
+        REQUIRE( stats.allocations == before.allocations + 2 );
+        REQUIRE( stats.allocated == before.allocated + 1536 );
+    }
+
+    // the arrays are untracked when released
+    auto stats = get_memory_stats(MemoryTag::GENERAL);
+    REQUIRE( stats.live == before.live );
+    REQUIRE( stats.frees == before.frees + 2 );
+    REQUIRE( stats.peak >= before.live + 1536 );
+
+    // chunks of pools are tracked with the tag of pool
+    auto ecs = get_memory_stats(MemoryTag::ECS);
+    {
+        MemoryPoolT<uint64_t, 32> pool(MemoryTag::ECS);
+        pool.malloc();
+        REQUIRE( get_memory_stats(MemoryTag::ECS).live == ecs.live + 32 * sizeof(uint64_t) );
+    }
+    REQUIRE( get_memory_stats(MemoryTag::ECS).live == ecs.live );
+
+    // budgets
+    set_memory_budget(MemoryTag::GENERAL, before.live + 100);
+    REQUIRE( !is_over_memory_budget(MemoryTag::GENERAL) );
+    set_output_stream(LogLevel::ERROR, &std::cout);
+    {
+        auto bytes = allocate_tagged(MemoryTag::GENERAL, 101);
+        REQUIRE( is_over_memory_budget(MemoryTag::GENERAL) );
+    }
+    set_output_stream(LogLevel::INFORMATION, &std::cout);
+    REQUIRE( !is_over_memory_budget(MemoryTag::GENERAL) );
+    set_memory_budget(MemoryTag::GENERAL, 0);
+
+    REQUIRE( std::string(get_memory_tag_name(MemoryTag::IMAGE)) == "image" );
+}
+
+TEST_CASE("TestFrameAllocator")
+{
+    // starts with fresh buffers of a new frame
+    FrameAllocator::advance();
+    FrameAllocator::advance();
+
+    auto a = static_cast<uint8_t*>(FrameAllocator::allocate(3));
+    auto b = static_cast<uint8_t*>(FrameAllocator::allocate(16, 16));
+    REQUIRE( a != nullptr );
+    REQUIRE( ((uintptr_t)b & 15) == 0 );
+    REQUIRE( b >= a + 3 );
+    REQUIRE( FrameAllocator::get_used() == 19 );
+
+    // memory of previous frame is kept
+    memset(a, 0x5A, 3);
+    FrameAllocator::advance();
+    auto c = static_cast<uint8_t*>(FrameAllocator::allocate(3));
+    REQUIRE( (c < a || c >= b + 16) );
+    REQUIRE( a[0] == 0x5A );
+    REQUIRE( FrameAllocator::get_used() == 3 );
+
+    // and recycled in the frame after next
+    FrameAllocator::advance();
+    REQUIRE( FrameAllocator::allocate(3) == a );
+
+    // buffers grow, and are merged into one chunk when reset
+    frame_vector<uint64_t> values;
+    for( uint64_t i = 0; i < 64 * 1024; i++ )
+        values.push_back(i);
+    for( uint64_t i = 0; i < values.size(); i++ )
+        REQUIRE( values[i] == i );
+
+    auto capacity = FrameAllocator::get_capacity();
+    REQUIRE( capacity > FrameAllocator::kChunkSize );
+
+    FrameAllocator::advance();
+    FrameAllocator::advance();
+    REQUIRE( FrameAllocator::get_capacity() == capacity );
+
+    // steady-state frames perform no heap allocations once both buffers warmed up
+    MemoryStats frame;
+    for( unsigned i = 0; i < 8; i++ )
+    {
+        if( i == 4 )
+            frame = get_memory_stats(MemoryTag::FRAME);
+
+        frame_vector<uint64_t> transient;
+        for( uint64_t j = 0; j < 64 * 1024; j++ )
+            transient.push_back(j);
+        FrameAllocator::advance();
+    }
+    REQUIRE( get_memory_stats(MemoryTag::FRAME).allocations == frame.allocations );
+
+    // failures are thrown by adaptor instead of returning nullptr to containers
+    REQUIRE( FrameAllocator::allocate(std::numeric_limits<size_t>::max()) == nullptr );
+    FrameAllocatorT<uint64_t> allocator;
+    REQUIRE_THROWS_AS( allocator.allocate(std::numeric_limits<size_t>::max() / 4), std::bad_alloc );
+    REQUIRE_THROWS_AS( allocator.allocate(std::numeric_limits<size_t>::max() / 16), std::bad_alloc );
+}
+
+BENCHMARK(MemoryTest, FrameVector, 10, 1)
+{
+    for( unsigned i = 0; i < 100; i++ )
+    {
+        frame_vector<uint64_t> values;
+        for( uint64_t j = 0; j < 1024; j++ )
+            values.push_back(j);
+    }
+    FrameAllocator::advance();
+}
+
+BENCHMARK(MemoryTest, StdVector, 10, 1)
+{
+    for( unsigned i = 0; i < 100; i++ )
+    {
+        std::vector<uint64_t> values;
+        for( uint64_t j = 0; j < 1024; j++ )
+            values.push_back(j);
+    }
+}
@@ -1,7 +1,11 @@
 #include <catch.hpp>
+#include <hayai.hpp>
 #include <lemon-toolkit.hpp>
 #include <codebase/debug/log.hpp>
 #include <cstdio>
+#include <condition_variable>
+#include <regex>
+#include <thread>
 
 USING_NS_LEMON;
 USING_NS_LEMON_CORE;
@@ -101,6 +105,14 @@ TEST_CASE("PathConcatenationAndOthers")
     REQUIRE( Path("resource/img").get_root() == "resource" );
     REQUIRE( Path("resource").get_root() == "resource" );
 
+    REQUIRE( path4.get_relative("/resource") == "img/hero_head.png" );
+    REQUIRE( path4.get_relative("/") == "resource/img/hero_head.png" );
+    REQUIRE( path4.get_relative("/res").is_empty() );
+    REQUIRE( path4.get_relative(path4).is_empty() );
+    REQUIRE( path3.get_relative("./nocompress/") == "pic.png" );
+    REQUIRE( path3.get_relative("") == path3 );
+    REQUIRE( path4.get_relative("").is_empty() );
+
     Path::iterator iterator = path4.begin();
     REQUIRE( *iterator++ == "resource" );
     REQUIRE( *iterator++ == "img" );
@@ -172,13 +184,97 @@ TEST_CASE_METHOD(ArchiveFixture, "TestArchiveCollection")
     file.write("hahaha", 6);
     file.close();
 
+    // the index is authoritative until the changes of tree are applied
+    file = collection->open("resource.txt", FileMode::APPEND);
+    REQUIRE( !file.is_open() );
+
+#ifdef __linux__
+    // changes are watched with inotify
+    collection->update();
     file = collection->open("resource.txt", FileMode::APPEND);
     REQUIRE( file.is_open() );
+#endif
     file.close();
 
     remove("tmp", true);
 }
 
+static void write_file(const Path& path, const char* contents)
+{
+    auto file = open(path, FileMode::WRITE | FileMode::TRUNCATE);
+    file.write(contents, strlen(contents));
+    file.close();
+}
+
+TEST_CASE_METHOD(ArchiveFixture, "TestFilesystemArchiveIndex")
+{
+    remove("tmp", true);
+    REQUIRE( create_directory("tmp") );
+    REQUIRE( create_directory("tmp/sub") );
+    write_file("tmp/a.txt", "a");
+    write_file("tmp/sub/b.txt", "b");
+    write_file("tmp/.hidden", "h");
+
+    for( auto watch : { true, false } )
+    {
+        FilesystemArchive archive(*get_subsystem<ArchiveCollection>(), "tmp", watch);
+        REQUIRE( archive.initialize() );
+        REQUIRE( archive.get_indexed() == 3 );
+
+        REQUIRE( archive.is_exist("a.txt") );
+        REQUIRE( archive.is_exist("./sub/b.txt") );
+        REQUIRE( archive.is_exist("./.hidden") );
+        REQUIRE( !archive.is_exist("sub") );
+        REQUIRE( !archive.is_exist("missing.txt") );
+        REQUIRE( archive.is_exist("../tmp/a.txt") );
+
+        // files created after mounted are visible once the changes applied
+        REQUIRE( create_directory("tmp/new") );
+        write_file("tmp/new/c.txt", "c");
+        write_file("tmp/sub/d.txt", "d");
+        REQUIRE( !archive.is_exist("sub/d.txt") );
+        if( archive.is_watching() )
+            archive.update();
+        else
+            archive.refresh();
+        REQUIRE( archive.is_exist("new/c.txt") );
+        REQUIRE( archive.is_exist("sub/d.txt") );
+        REQUIRE( archive.map("new/c.txt") );
+
+        // files removed or moved after mounted
+        remove("tmp/sub/d.txt");
+        REQUIRE( move("tmp/new", "tmp/moved") );
+        REQUIRE( !archive.map("sub/d.txt") );
+        REQUIRE( !archive.map("new/c.txt") );
+        if( archive.is_watching() )
+            archive.update();
+        else
+            archive.refresh();
+        REQUIRE( archive.is_exist("moved/c.txt") );
+        REQUIRE( !archive.is_exist("missing.txt") );
+        REQUIRE( !archive.is_exist("sub/d.txt") );
+        REQUIRE( !archive.is_exist("new/c.txt") );
+
+        REQUIRE( move("tmp/moved", "tmp/new") );
+        remove("tmp/new", true);
+        archive.refresh();
+        REQUIRE( archive.get_indexed() == 3 );
+    }
+
+    // stale entries are skipped by collection
+    auto collection = get_subsystem<ArchiveCollection>();
+    REQUIRE( create_directory("tmp2") );
+    write_file("tmp2/a.txt", "2");
+    REQUIRE( collection->add_search_path("tmp", false) );
+    REQUIRE( collection->add_search_path("tmp2") );
+    REQUIRE( *collection->map("a.txt").data() == 'a' );
+    remove("tmp/a.txt");
+    REQUIRE( *collection->map("a.txt").data() == '2' );
+
+    remove("tmp", true);
+    remove("tmp2", true);
+}
+
 struct Text : public Resource
 {
     bool read(std::istream& stream) override
@@ -271,4 +367,889 @@ TEST_CASE_METHOD(ResourceCacheFixture, "")
 
     r4 = cache->fetch<Text>("./resource2.txt");
     REQUIRE( cache->get_memory_usage() == 3072 );
-};
\ No newline at end of file
+};
+
+TEST_CASE_METHOD(ResourceCacheFixture, "TestPackageArchive")
+{
+    REQUIRE( create_directory("tmp/sub") );
+    auto file = open("tmp/sub/resource4.txt", FileMode::APPEND);
+    file.write("fa", 2);
+    file.close();
+
+    remove("tmp.lpak");
+    REQUIRE( PackageArchive::build("tmp", "tmp.lpak") );
+    REQUIRE( !PackageArchive::build("missing", "tmp.lpak") );
+
+    auto collection = get_subsystem<ArchiveCollection>();
+    REQUIRE( !collection->add_package("missing.lpak") );
+    REQUIRE( collection->add_package("tmp.lpak") );
+
+    auto view = collection->map("sub/resource4.txt");
+    REQUIRE( view );
+    REQUIRE( view.size() == 2 );
+    REQUIRE( memcmp(view.data(), "fa", 2) == 0 );
+    REQUIRE( !collection->map("sub/missing.txt") );
+    REQUIRE( !collection->open("sub/resource4.txt", FileMode::READ).is_open() );
+
+    // paths with the same hash are told apart by names
+    REQUIRE( math::StringHash("buspbwqg") == math::StringHash("pwppnffj") );
+    file = open("tmp/buspbwqg", FileMode::WRITE);
+    file.write("b", 1);
+    file.close();
+
+    REQUIRE( PackageArchive::build("tmp", "tmp2.lpak") );
+    PackageArchive package(*collection, "tmp2.lpak");
+    REQUIRE( package.initialize() );
+    REQUIRE( package.is_exist("buspbwqg") );
+    REQUIRE( !package.is_exist("pwppnffj") );
+    REQUIRE( !package.map("pwppnffj") );
+    REQUIRE( *package.map("buspbwqg").data() == 'b' );
+    REQUIRE( *package.map("sub/resource4.txt").data() == 'f' );
+
+    file = open("tmp/pwppnffj", FileMode::WRITE);
+    file.write("p", 1);
+    file.close();
+
+    REQUIRE( PackageArchive::build("tmp", "tmp2.lpak") );
+    PackageArchive collided(*collection, "tmp2.lpak");
+    REQUIRE( collided.initialize() );
+    REQUIRE( *collided.map("buspbwqg").data() == 'b' );
+    REQUIRE( *collided.map("pwppnffj").data() == 'p' );
+    remove("tmp2.lpak");
+
+    auto r = get_subsystem<ResourceCache>()->fetch<Text>("./resource2.txt");
+    REQUIRE( r );
+    REQUIRE( r->text == "re" );
+
+    // views keep the mapping alive
+    remove("tmp.lpak");
+    REQUIRE( memcmp(view.data(), "fa", 2) == 0 );
+
+    MemoryStream stream(view.data(), view.size());
+    stream.seekg(0, std::ios::end);
+    REQUIRE( stream.tellg() == 2 );
+    stream.seekg(1);
+    REQUIRE( stream.get() == 'a' );
+
+    // spans are non-owning sub-ranges of mapping
+    auto span = view.span();
+    REQUIRE( span.size() == 2 );
+    REQUIRE( span.subspan(1, 1).size() == 1 );
+    REQUIRE( *span.subspan(1, 1).data() == 'a' );
+    REQUIRE( span.subspan(2, 0).empty() );
+    REQUIRE( span.subspan(1, 2).empty() );
+    REQUIRE( std::string(span.begin(), span.end()) == "fa" );
+
+    Text text;
+    REQUIRE( static_cast<Resource&>(text).read(span) );
+    REQUIRE( text.text == "fa" );
+}
+
+TEST_CASE_METHOD(ResourceCacheFixture, "TestBakedTexture")
+{
+    auto image = Resource::create<Image>(5, 3, 3);
+    REQUIRE( image );
+    image->clear({1.f, 0.f, 0.f, 1.f});
+    image->set_pixel(4, 2, {0.f, 0.f, 1.f, 1.f});
+
+    REQUIRE( image->generate_mipmaps() );
+    REQUIRE( image->get_levels() == 3 );
+    REQUIRE( image->get_memory_usage() == (5*3+2*1+1*1)*3 );
+
+    // levels are stored right after the pixels
+    auto data = static_cast<const uint8_t*>(image->get_data());
+    REQUIRE( data[15*3+3+0] == 255 );
+    REQUIRE( data[15*3+3+2] == 0 );
+    REQUIRE( data[17*3+0] == 255 );
+
+    auto file = open("tmp/view.ltex", FileMode::WRITE | FileMode::BINARY);
+    REQUIRE( image->save_texture(file) );
+    file.close();
+    get_subsystem<ArchiveCollection>()->add_search_path("tmp");
+
+    // mapped and read without decoding
+    auto baked = Resource::read<Image>("view.ltex");
+    REQUIRE( baked );
+    REQUIRE( baked->get_width() == 5 );
+    REQUIRE( baked->get_height() == 3 );
+    REQUIRE( baked->get_components() == 3 );
+    REQUIRE( baked->get_levels() == 3 );
+    REQUIRE( !baked->is_compressed() );
+    REQUIRE( memcmp(baked->get_data(), image->get_data(), baked->get_memory_usage()) == 0 );
+    REQUIRE( baked->get_pixel(4, 2) == (math::Color {0.f, 0.f, 1.f, 1.f}) );
+
+    // writes to read-only mapping are copied, and the stale levels are dropped
+    baked->set_pixel(0, 0, {0.f, 1.f, 0.f, 1.f});
+    REQUIRE( baked->get_levels() == 1 );
+    REQUIRE( baked->get_pixel(0, 0) == (math::Color {0.f, 1.f, 0.f, 1.f}) );
+    REQUIRE( image->get_pixel(0, 0) == (math::Color {1.f, 0.f, 0.f, 1.f}) );
+
+    // cleared into fresh storage, the mapping is left untouched
+    auto cleared = Resource::read<Image>("view.ltex");
+    REQUIRE( cleared );
+    cleared->clear({0.f, 1.f, 0.f, 1.f});
+    REQUIRE( cleared->get_levels() == 1 );
+    REQUIRE( cleared->get_pixel(4, 2) == (math::Color {0.f, 1.f, 0.f, 1.f}) );
+    REQUIRE( Resource::read<Image>("view.ltex")->get_pixel(4, 2) == (math::Color {0.f, 0.f, 1.f, 1.f}) );
+
+    // read through stream too
+    std::stringstream stream;
+    REQUIRE( image->save_texture(stream) );
+    Image streamed;
+    REQUIRE( streamed.read(stream) );
+    REQUIRE( streamed.get_levels() == 3 );
+
+    // read from a span, the levels are copied since span doesn't own the memory
+    auto content = stream.str();
+    auto bytes = content;
+    Image spanned;
+    REQUIRE( spanned.read(ByteSpan((const uint8_t*)bytes.data(), bytes.size())) );
+    REQUIRE( spanned.get_levels() == 3 );
+    REQUIRE( memcmp(spanned.get_data(), image->get_data(), spanned.get_memory_usage()) == 0 );
+    std::fill(bytes.begin(), bytes.end(), 0);
+    REQUIRE( spanned.get_pixel(4, 2) == (math::Color {0.f, 0.f, 1.f, 1.f}) );
+
+    // truncated
+    std::stringstream truncated(content.substr(0, content.size()-1));
+    REQUIRE( !Image().read(truncated) );
+}
+
+TEST_CASE_METHOD(ResourceCacheFixture, "TestShaderCache")
+{
+    const char* vs = "uniform mat4 lm_ModelMatrix;\nvoid main() {}\n";
+    const char* fs = "uniform vec3 ObjectColor;\nvoid main() {}\n";
+
+    REQUIRE( ShaderCache::hash(vs, fs) != ShaderCache::hash(fs, vs) );
+    REQUIRE( ShaderCache::hash("ab", "c") != ShaderCache::hash("a", "bc") );
+
+    auto cache = add_subsystem<ShaderCache>("tmp/shaders.cache");
+    auto shader = Resource::create<Shader>(vs, fs);
+    REQUIRE( shader );
+    REQUIRE( shader->has_uniform_variable("lm_ModelMatrix") );
+    REQUIRE( shader->has_uniform_variable("ObjectColor") );
+
+    auto entry = cache->find(ShaderCache::hash(vs, fs));
+    REQUIRE( entry );
+    REQUIRE( entry->uniforms.size() == 2 );
+    REQUIRE( entry->binary );
+
+    // pretends the driver retrieved the linked program
+    entry->binary->format = 7;
+    entry->binary->data = { 1, 2, 3 };
+
+    // saved when disposed, and loaded at next launch
+    remove_subsystem<ShaderCache>();
+    REQUIRE( is_regular_file("tmp/shaders.cache") );
+    cache = add_subsystem<ShaderCache>("tmp/shaders.cache");
+
+    entry = cache->find(ShaderCache::hash(vs, fs));
+    REQUIRE( entry );
+    REQUIRE( entry->uniforms.size() == 2 );
+    REQUIRE( entry->uniforms[0].name == "lm_ModelMatrix" );
+    REQUIRE( entry->uniforms[0].type == "mat4" );
+    REQUIRE( entry->uniforms[1].name == "ObjectColor" );
+    REQUIRE( entry->binary->format == 7 );
+    REQUIRE( entry->binary->data == (std::vector<uint8_t> { 1, 2, 3 }) );
+
+    // warm starts use the cached uniforms instead of scanning
+    entry->uniforms.push_back(ShaderUniform { "Cached", "float", 1 });
+    shader = Resource::create<Shader>(vs, fs);
+    REQUIRE( shader->has_uniform_variable("Cached") );
+
+    // truncated cache is ignored
+    auto file = open("tmp/shaders.cache", FileMode::WRITE | FileMode::BINARY | FileMode::TRUNCATE);
+    file.write("LSHC", 4);
+    file.close();
+    REQUIRE( !cache->load() );
+    REQUIRE( cache->find(ShaderCache::hash(vs, fs)) );
+
+    // lengths beyond the end of file are rejected before allocating, the magic and
+    // version are taken from a valid cache
+    char header[8];
+    REQUIRE( cache->save() );
+    file = open("tmp/shaders.cache", FileMode::READ | FileMode::BINARY);
+    file.read(header, sizeof(header));
+    file.close();
+
+    for( auto uniforms : { 0u, 1u } )
+    {
+        file = open("tmp/shaders.cache", FileMode::WRITE | FileMode::BINARY | FileMode::TRUNCATE);
+        uint32_t count = 1;
+        uint64_t key = 1;
+        uint32_t fields[] = { uniforms, 0xFFFFFFF0u, 0xFFFFFFF0u };
+        file.write(header, sizeof(header));
+        file.write((const char*)&count, sizeof(count));
+        file.write((const char*)&key, sizeof(key));
+        file.write((const char*)fields, sizeof(fields));
+        file.close();
+        REQUIRE( !cache->load() );
+        REQUIRE( cache->find(ShaderCache::hash(vs, fs)) );
+    }
+}
+
+TEST_CASE_METHOD(ResourceCacheFixture, "TestFetchAsync")
+{
+    add_subsystem<TaskSystem>();
+    auto cache = get_subsystem<ResourceCache>();
+    get_subsystem<ArchiveCollection>()->add_search_path("tmp");
+
+    auto h1 = cache->fetch_async<Text>("./resource.txt");
+    auto h2 = cache->fetch_async<Text>("resource.txt");
+    REQUIRE( h1.is_valid() );
+    REQUIRE( h2.is_valid() );
+
+    // video objects are updated on main thread only
+    REQUIRE( !h1.is_ready() );
+    REQUIRE( !h2.is_ready() );
+
+    auto r = cache->wait(h1);
+    REQUIRE( r );
+    REQUIRE( r->text == "do" );
+    REQUIRE( h2.is_ready() );
+    REQUIRE( h2.get() == r );
+    REQUIRE( cache->find<Text>(Path("resource.txt")) == r );
+    REQUIRE( cache->get_memory_usage() == 1024 );
+
+    auto h3 = cache->fetch_async<Text>("resource.txt");
+    REQUIRE( h3.is_ready() );
+    REQUIRE( h3.get() == r );
+
+    auto h4 = cache->fetch_async<Text>("resource2.txt");
+    auto h5 = cache->fetch_async<Text>("missing.txt");
+    while( !h4.is_ready() || !h5.is_ready() )
+        cache->update_video_objects();
+
+    REQUIRE( h4.get()->text == "re" );
+    REQUIRE( h5.get() == nullptr );
+    REQUIRE( cache->wait(h5) == nullptr );
+
+    // the path being fetched as another type is rejected
+    struct OtherText : public Text {};
+    auto h6 = cache->fetch_async<Text>("resource3.txt");
+    auto h7 = cache->fetch_async<OtherText>("resource3.txt");
+    REQUIRE( h7.is_ready() );
+    REQUIRE( h7.get() == nullptr );
+    REQUIRE( cache->wait(h6)->text == "mi" );
+}
+
+TEST_CASE_METHOD(ResourceCacheFixture, "TestConcurrentFind")
+{
+    const size_t kResources = 256;
+    const size_t kThreads = 4;
+
+    auto cache = get_subsystem<ResourceCache>();
+    cache->set_threshold(-1, -1);
+
+    // the resources looked up are referenced here, so they are never evicted
+    std::vector<math::StringHash> hashes;
+    std::vector<Resource::ptr> pinned;
+    for( size_t i = 0; i < kResources; i++ )
+    {
+        hashes.push_back(math::StringHash(std::to_string(i)));
+        pinned.push_back(std::make_shared<Text>());
+        REQUIRE( cache->add(hashes.back(), pinned.back()) );
+    }
+
+    std::atomic<size_t> misses(0);
+    std::vector<std::thread> threads;
+    for( size_t i = 0; i < kThreads; i++ )
+    {
+        threads.emplace_back([&]()
+        {
+            for( size_t j = 0; j < kResources * 16; j++ )
+                if( !cache->find<Text>(hashes[j % kResources]) )
+                    misses ++;
+        });
+    }
+
+    // inserts and evicts while others are looking up
+    cache->set_threshold(1024 * (kResources+1), -1);
+    for( size_t i = 0; i < kResources; i++ )
+        cache->add(math::StringHash(std::to_string(kResources+i)), std::make_shared<Text>());
+
+    for( auto& thread : threads )
+        thread.join();
+
+    REQUIRE( misses == 0 );
+    REQUIRE( cache->get_memory_usage() <= 1024 * (kResources+1) );
+}
+
+const static size_t kBenchResources = 4096;
+const static size_t kBenchFinds = 100000;
+
+const static size_t kBenchMaxThreads = 4;
+
+// the cache and workers are built once and shared by iterations, so only the lookups
+// are measured. the cache is kept standalone to outlive the core of other tests.
+struct ResourceCacheBenchContext
+{
+    ResourceCacheBenchContext()
+    {
+        core::details::initialize();
+        add_subsystem<ArchiveCollection>();
+        cache.initialize();
+        core::details::dispose();
+
+        cache.set_threshold(-1, -1);
+        for( size_t i = 0; i < kBenchResources; i++ )
+        {
+            hashes.push_back(math::StringHash(std::to_string(i)));
+            cache.add(hashes.back(), std::make_shared<Text>());
+        }
+
+        for( size_t i = 0; i < kBenchMaxThreads; i++ )
+            workers.emplace_back(&ResourceCacheBenchContext::work, this, i);
+    }
+
+    ~ResourceCacheBenchContext()
+    {
+        {
+            std::unique_lock<std::mutex> L(mutex);
+            stop = true;
+        }
+
+        start.notify_all();
+        for( auto& worker : workers )
+            worker.join();
+    }
+
+    // looks up with the first number of workers, blocks until they are finished
+    void find(size_t threads)
+    {
+        std::unique_lock<std::mutex> L(mutex);
+        active = threads;
+        pending = threads;
+        generation ++;
+        start.notify_all();
+        finish.wait(L, [&]() { return pending == 0; });
+    }
+
+    void work(size_t index)
+    {
+        uint64_t seen = 0;
+        for( ;; )
+        {
+            size_t threads;
+            {
+                std::unique_lock<std::mutex> L(mutex);
+                start.wait(L, [&]() { return stop || generation != seen; });
+                if( stop )
+                    return;
+
+                seen = generation;
+                threads = active;
+            }
+
+            if( index >= threads )
+                continue;
+
+            for( size_t j = 0; j < kBenchFinds / threads; j++ )
+                cache.find<Text>(hashes[(j * 7919 + index) % kBenchResources]);
+
+            std::unique_lock<std::mutex> L(mutex);
+            if( --pending == 0 )
+                finish.notify_one();
+        }
+    }
+
+    ResourceCache cache;
+    std::vector<math::StringHash> hashes;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start, finish;
+    uint64_t generation = 0;
+    size_t active = 0;
+    size_t pending = 0;
+    bool stop = false;
+};
+
+BENCHMARK(ResourceTest, CacheFind1Thread, 8, 1)
+{
+    static ResourceCacheBenchContext context;
+    context.find(1);
+}
+
+BENCHMARK(ResourceTest, CacheFind4Threads, 8, 1)
+{
+    static ResourceCacheBenchContext context;
+    context.find(4);
+}
+
+struct ImageBatchFixture
+{
+    ImageBatchFixture()
+    {
+        core::details::initialize();
+        pwd = get_current_directory();
+        set_current_directory("../../test");
+        add_subsystem<TaskSystem>();
+        add_subsystem<ArchiveCollection>()->add_search_path("resource");
+    }
+
+    ~ImageBatchFixture()
+    {
+        set_current_directory(pwd);
+        core::details::dispose();
+    }
+
+    // the existing assets scaled up
+    std::vector<Path> paths(size_t count)
+    {
+        return std::vector<Path>(count, Path("view.jpeg"));
+    }
+
+    Path pwd;
+};
+
+TEST_CASE_METHOD(ImageBatchFixture, "TestImageReadBatch")
+{
+    auto batch = paths(8);
+    batch.insert(batch.begin()+3, Path("missing.jpeg"));
+
+    // a budget smaller than any image decodes one at a time
+    for( size_t budget : { (size_t)1, (size_t)64*1024*1024 } )
+    {
+        auto images = Image::read_batch(batch, budget);
+        REQUIRE( images.size() == batch.size() );
+        for( size_t i = 0; i < images.size(); i++ )
+        {
+            if( i == 3 )
+            {
+                REQUIRE( images[i] == nullptr );
+                continue;
+            }
+
+            REQUIRE( images[i] != nullptr );
+            REQUIRE( images[i]->get_width() > 0 );
+            REQUIRE( images[i]->get_name() == "view.jpeg" );
+        }
+    }
+}
+
+const static size_t kBenchImages = 32;
+
+// the subsystems are set up out of the timed body
+struct ImageBatchBenchmark : public ::hayai::Fixture
+{
+    void SetUp() override
+    {
+        context.reset(new ImageBatchFixture());
+        paths = context->paths(kBenchImages);
+    }
+
+    void TearDown() override
+    {
+        context.reset();
+    }
+
+    std::unique_ptr<ImageBatchFixture> context;
+    std::vector<Path> paths;
+};
+
+BENCHMARK_F(ImageBatchBenchmark, ImageRead32Serial, 4, 4)
+{
+    for( auto& path : paths )
+        Resource::read<Image>(path);
+}
+
+BENCHMARK_F(ImageBatchBenchmark, ImageRead32Batch, 4, 4)
+{
+    Image::read_batch(paths);
+}
+
+// scalar references of pixel kernels
+static uint16_t pack_pixel_reference(const uint8_t* p, ImageElementFormat format)
+{
+    if( format == ImageElementFormat::USHORT_565 )
+        return ((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[2] >> 3);
+    if( format == ImageElementFormat::USHORT_4444 )
+        return ((p[0] >> 4) << 12) | ((p[1] >> 4) << 8) | ((p[2] >> 4) << 4) | (p[3] >> 4);
+    return ((p[0] >> 3) << 11) | ((p[1] >> 3) << 6) | ((p[2] >> 3) << 1) | (p[3] >> 7);
+}
+
+static void premultiply_reference(uint8_t* pixels, size_t count)
+{
+    for( size_t i = 0; i < count; i++ )
+        for( size_t j = 0; j < 3; j++ )
+            pixels[i*4+j] = (pixels[i*4+j] * pixels[i*4+3] + 127) / 255;
+}
+
+static void downsample_reference(const uint8_t* src, unsigned width, unsigned height, unsigned components, uint8_t* dst)
+{
+    auto dw = std::max(width / 2, 1U);
+    auto dh = std::max(height / 2, 1U);
+    for( unsigned y = 0; y < dh; y++ )
+        for( unsigned x = 0; x < dw; x++ )
+            for( unsigned i = 0; i < components; i++ )
+            {
+                unsigned sum = 0;
+                for( unsigned sy : { std::min(y*2, height-1), std::min(y*2+1, height-1) } )
+                    for( unsigned sx : { std::min(x*2, width-1), std::min(x*2+1, width-1) } )
+                        sum += src[(sy*width+sx)*components+i];
+                *dst++ = (sum + 2) / 4;
+            }
+}
+
+static std::vector<uint8_t> random_pixels(size_t size)
+{
+    std::vector<uint8_t> pixels(size);
+    unsigned seed = 17;
+    for( auto& v : pixels )
+    {
+        seed = seed * 1103515245 + 12345;
+        v = (seed >> 16) & 0xFF;
+    }
+    return pixels;
+}
+
+TEST_CASE("TestPixelKernels")
+{
+    // odd counts exercise the scalar tails
+    const size_t kCount = 1031;
+    auto pixels = random_pixels(kCount*4);
+    pixels[0] = pixels[1] = pixels[2] = pixels[3] = 0;
+    pixels[4] = pixels[5] = pixels[6] = pixels[7] = 255;
+
+    for( unsigned components = 1; components <= 4; components++ )
+    {
+        const uint8_t value[] = { 1, 2, 3, 4 };
+        std::vector<uint8_t> filled(kCount*components+1, 0xCD);
+        fill_pixels(filled.data(), kCount, components, value);
+        for( size_t i = 0; i < kCount*components; i++ )
+            REQUIRE( filled[i] == value[i % components] );
+        REQUIRE( filled.back() == 0xCD );
+    }
+
+    for( auto format : { ImageElementFormat::USHORT_565, ImageElementFormat::USHORT_4444, ImageElementFormat::USHORT_5551 } )
+    {
+        std::vector<uint16_t> packed(kCount);
+        pack_pixels(pixels.data(), kCount, format, packed.data());
+        for( size_t i = 0; i < kCount; i++ )
+            REQUIRE( packed[i] == pack_pixel_reference(pixels.data()+i*4, format) );
+
+        std::vector<uint8_t> unpacked(kCount*4);
+        unpack_pixels(packed.data(), kCount, format, unpacked.data());
+        for( size_t i = 0; i < kCount; i++ )
+        {
+            // unpacking is the inverse of packing
+            REQUIRE( pack_pixel_reference(unpacked.data()+i*4, format) == packed[i] );
+            // extremes are kept
+            if( i < 2 )
+                for( size_t j = 0; j < 3; j++ )
+                    REQUIRE( unpacked[i*4+j] == pixels[i*4+j] );
+        }
+    }
+
+    auto premultiplied = pixels;
+    auto reference = pixels;
+    premultiply_pixels(premultiplied.data(), kCount);
+    premultiply_reference(reference.data(), kCount);
+    REQUIRE( premultiplied == reference );
+
+    const unsigned sizes[][2] = { {32, 32}, {13, 7}, {1, 9}, {9, 1}, {2, 2}, {1, 1} };
+    for( unsigned components = 1; components <= 4; components++ )
+    {
+        for( auto& size : sizes )
+        {
+            auto dsize = std::max(size[0]/2, 1U) * std::max(size[1]/2, 1U) * components;
+            std::vector<uint8_t> result(dsize), expected(dsize);
+            downsample_pixels(pixels.data(), size[0], size[1], components, result.data());
+            downsample_reference(pixels.data(), size[0], size[1], components, expected.data());
+            REQUIRE( result == expected );
+        }
+    }
+}
+
+TEST_CASE("TestImageConvert")
+{
+    auto image = Resource::create<Image>(3, 3, 4);
+    REQUIRE( image );
+    image->clear({1.f, 0.f, 1.f, 0.5f});
+    REQUIRE( image->get_pixel(2, 2) == image->get_pixel(0, 0) );
+
+    REQUIRE( image->premultiply_alpha() );
+    auto data = static_cast<const uint8_t*>(image->get_data());
+    REQUIRE( data[0] == (255 * data[3] + 127) / 255 );
+    REQUIRE( data[1] == 0 );
+
+    REQUIRE( image->convert(ImageElementFormat::USHORT_4444) );
+    REQUIRE( image->get_element_format() == ImageElementFormat::USHORT_4444 );
+    REQUIRE( image->get_memory_usage() == 3*3*2 );
+    // packed pixels are not accessible
+    REQUIRE( image->get_pixel(0, 0) == math::Color(0xFF000000) );
+
+    REQUIRE( image->convert(ImageElementFormat::USHORT_565) );
+    REQUIRE( image->get_components() == 3 );
+    REQUIRE( image->convert(ImageElementFormat::USHORT_5551) );
+
+    REQUIRE( image->convert(ImageElementFormat::UBYTE) );
+    REQUIRE( image->get_components() == 4 );
+    REQUIRE( image->get_pixel(1, 1).a == 1.f );
+
+    auto rgb = Resource::create<Image>(3, 3, 3);
+    REQUIRE( !rgb->convert(ImageElementFormat::USHORT_565) );
+}
+
+const static unsigned kBenchPixelSize = 1024;
+
+struct PixelBenchContext
+{
+    PixelBenchContext()
+    : pixels(random_pixels(kBenchPixelSize*kBenchPixelSize*4)),
+      packed(kBenchPixelSize*kBenchPixelSize),
+      downsampled(kBenchPixelSize*kBenchPixelSize)
+    {
+        image = Resource::create<Image>(kBenchPixelSize, kBenchPixelSize, 4);
+    }
+
+    // shared by benchmarks, so that only the kernels are measured
+    static PixelBenchContext& get()
+    {
+        static PixelBenchContext context;
+        return context;
+    }
+
+    size_t count() const { return kBenchPixelSize*kBenchPixelSize; }
+
+    std::vector<uint8_t> pixels;
+    std::vector<uint16_t> packed;
+    std::vector<uint8_t> downsampled;
+    Image::ptr image;
+};
+
+BENCHMARK(PixelTest, ClearPerPixel, 4, 1)
+{
+    auto& context = PixelBenchContext::get();
+    for( unsigned y = 0; y < kBenchPixelSize; y++ )
+        for( unsigned x = 0; x < kBenchPixelSize; x++ )
+            context.image->set_pixel(x, y, math::Color::RED);
+}
+
+BENCHMARK(PixelTest, Clear, 4, 1)
+{
+    auto& context = PixelBenchContext::get();
+    context.image->clear(math::Color::RED);
+}
+
+BENCHMARK(PixelTest, Pack565Scalar, 4, 1)
+{
+    auto& context = PixelBenchContext::get();
+    for( size_t i = 0; i < context.count(); i++ )
+        context.packed[i] = pack_pixel_reference(context.pixels.data()+i*4, ImageElementFormat::USHORT_565);
+}
+
+BENCHMARK(PixelTest, Pack565, 4, 1)
+{
+    auto& context = PixelBenchContext::get();
+    pack_pixels(context.pixels.data(), context.count(), ImageElementFormat::USHORT_565, context.packed.data());
+}
+
+BENCHMARK(PixelTest, PremultiplyScalar, 4, 1)
+{
+    auto& context = PixelBenchContext::get();
+    premultiply_reference(context.pixels.data(), context.count());
+}
+
+BENCHMARK(PixelTest, Premultiply, 4, 1)
+{
+    auto& context = PixelBenchContext::get();
+    premultiply_pixels(context.pixels.data(), context.count());
+}
+
+BENCHMARK(PixelTest, DownsampleScalar, 4, 1)
+{
+    auto& context = PixelBenchContext::get();
+    downsample_reference(context.pixels.data(), kBenchPixelSize, kBenchPixelSize, 4, context.downsampled.data());
+}
+
+BENCHMARK(PixelTest, Downsample, 4, 1)
+{
+    auto& context = PixelBenchContext::get();
+    downsample_pixels(context.pixels.data(), kBenchPixelSize, kBenchPixelSize, 4, context.downsampled.data());
+}
+
+TEST_CASE("TestShaderParse")
+{
+    const char* source =
+        "//-> VERTEX_SHADER {\n"
+        "#version 330 core\n"
+        "#define uniform_count 4\n"
+        "uniform mat4 lm_ModelMatrix;\n"
+        "uniform highp vec3 Position, Normal;\n"
+        "// uniform float Commented;\n"
+        "/* uniform float Block;\n"
+        "   uniform float Comment; */ uniform float AfterComment;\n"
+        "uniform vec4 Lights[8];\n"
+        "uniform\tfloat\r\n"
+        "    Spanned;\n"
+        "uniform vec2 Offset = vec2(0.0, 1.0), Scale;\n"
+        "uniform Material { vec4 diffuse; };\n"
+        "void main() { float my_uniform; }\n"
+        "//-> }\n"
+        "//-> FRAGMENT_SHADER {\r\n"
+        "uniform mat4 lm_ModelMatrix;\n"
+        "uniform lowp sampler2D Diffuse;\n"
+        "//-> }\n";
+
+    Shader shader;
+    std::stringstream stream(source);
+    REQUIRE( shader.read(stream) );
+
+    auto& uniforms = shader.get_uniforms();
+    std::vector<std::string> names;
+    for( auto& uniform : uniforms )
+        names.push_back(uniform.name);
+
+    REQUIRE( names == (std::vector<std::string> {
+        "lm_ModelMatrix", "Position", "Normal", "AfterComment", "Lights", "Spanned", "Offset", "Scale", "Diffuse" }) );
+    REQUIRE( uniforms[1].type == "vec3" );
+    REQUIRE( uniforms[4].type == "vec4" );
+    REQUIRE( uniforms[4].size == 8 );
+    REQUIRE( uniforms[5].type == "float" );
+    REQUIRE( uniforms[7].type == "vec2" );
+    REQUIRE( !uniforms[7].is_sampler() );
+    REQUIRE( uniforms[8].is_sampler() );
+
+    // sections are split by directives
+    REQUIRE( shader.get_vertex_shader().find("#version 330 core\n") == 0 );
+    REQUIRE( shader.get_vertex_shader().find("Diffuse") == std::string::npos );
+    REQUIRE( shader.get_fragment_shader() == "uniform mat4 lm_ModelMatrix;\nuniform lowp sampler2D Diffuse;\n" );
+
+    // parsed from a span directly
+    Shader spanned;
+    REQUIRE( spanned.read(ByteSpan((const uint8_t*)source, strlen(source))) );
+    REQUIRE( spanned.get_uniforms().size() == uniforms.size() );
+    REQUIRE( spanned.get_fragment_shader() == shader.get_fragment_shader() );
+
+    // unbalanced sections are rejected
+    const char* unbalanced = "//-> VERTEX_SHADER {\nvoid main() {}\n";
+    std::stringstream unbalanced_stream(unbalanced);
+    REQUIRE( !Shader().read(unbalanced_stream) );
+}
+
+TEST_CASE("TestMaterialUniformSlots")
+{
+    const char* vs = "uniform mat4 lm_ModelMatrix;\nuniform vec3 Offset;\nvoid main() {}\n";
+    const char* fs = "uniform vec3 Offset;\nuniform sampler2D Diffuse;\nvoid main() {}\n";
+
+    auto shader = Resource::create<Shader>(vs, fs);
+    REQUIRE( shader );
+    REQUIRE( shader->get_uniform_slot("lm_ModelMatrix") == 0 );
+    REQUIRE( shader->get_uniform_slot("Offset") == 1 );
+    REQUIRE( shader->get_uniform_slot("Diffuse") == 2 );
+    REQUIRE( shader->get_uniform_slot("Missing") == graphics::kInvalidUniformSlot );
+
+    auto material = Resource::create<Material>(shader);
+    REQUIRE( material );
+
+    graphics::UniformVariable v;
+    v.set<math::Vector3f>(math::Vector3f {1.f, 2.f, 3.f});
+    REQUIRE( material->set_uniform_variable("Offset", v) );
+    REQUIRE( !material->set_uniform_variable("Missing", v) );
+    REQUIRE( material->get_uniform_variable("lm_ModelMatrix") == nullptr );
+    REQUIRE( material->get_uniform_variable("Offset")->get<math::Vector3f>() == (math::Vector3f {1.f, 2.f, 3.f}) );
+
+    v.set<math::Vector3f>(math::Vector3f {4.f, 5.f, 6.f});
+    REQUIRE( material->set_uniform_variable("Offset", v) );
+    REQUIRE( material->get_uniform_variable("Offset")->get<math::Vector3f>() == (math::Vector3f {4.f, 5.f, 6.f}) );
+
+    // slots are resolved against the new shader
+    REQUIRE( material->initialize(Resource::create<Shader>(fs, vs)) );
+    REQUIRE( material->get_uniform_variable("Offset") == nullptr );
+    REQUIRE( material->set_uniform_variable("lm_ModelMatrix", v) );
+    REQUIRE( material->get_uniform_variable("lm_ModelMatrix") != nullptr );
+}
+
+// the regex based parser replaced by the single-pass scanner, kept for comparison
+static void parse_shader_regex(std::istream& in, std::string& vertex, std::string& fragment, std::vector<std::string>& uniforms)
+{
+    std::regex syntax("//->.*");
+    std::regex tokenize("(\\S+)");
+    std::regex uniform("uniform( +)(\\w+)( +)(\\w+)( *);");
+
+    std::string line;
+    bool fragment_section = false;
+    while( std::getline(in, line) )
+    {
+        if( std::regex_match(line, syntax) )
+        {
+            auto iterator = std::sregex_iterator(line.begin()+4, line.end(), tokenize);
+            for( ; iterator != std::sregex_iterator(); iterator ++ )
+            {
+                if( iterator->str() == "VERTEX_SHADER" ) fragment_section = false;
+                else if( iterator->str() == "FRAGMENT_SHADER" ) fragment_section = true;
+            }
+        }
+        else
+        {
+            auto& section = fragment_section ? fragment : vertex;
+            section.append(line);
+            section.push_back('\n');
+        }
+    }
+
+    for( auto str : { &vertex, &fragment } )
+    {
+        std::smatch match;
+        auto iterator = std::sregex_iterator(str->begin(), str->end(), uniform);
+        for( ; iterator != std::sregex_iterator(); iterator ++ )
+        {
+            std::string line = iterator->str();
+            if( std::regex_search(line, match, uniform) && match.size() >= 4 )
+                uniforms.push_back(match[4].str());
+        }
+    }
+}
+
+struct ShaderBenchContext
+{
+    ShaderBenchContext()
+    {
+        // a corpus of shaders with a few hundreds of lines per stage
+        std::stringstream stream;
+        for( auto section : { "VERTEX_SHADER", "FRAGMENT_SHADER" } )
+        {
+            stream << "//-> " << section << " {\n#version 330 core\n";
+            for( int i = 0; i < 256; i++ )
+            {
+                stream << "uniform vec4 Uniform" << i << ";\n";
+                stream << "// comments of uniform " << i << "\n";
+                stream << "float function" << i << "(float v) { return v * " << i << ".0; }\n";
+            }
+            stream << "void main() {}\n//-> }\n";
+        }
+        corpus = stream.str();
+    }
+
+    static ShaderBenchContext& get()
+    {
+        static ShaderBenchContext context;
+        return context;
+    }
+
+    std::string corpus;
+};
+
+BENCHMARK(ShaderTest, ParseRegex, 4, 1)
+{
+    auto& context = ShaderBenchContext::get();
+    for( int i = 0; i < 8; i++ )
+    {
+        std::string vertex, fragment;
+        std::vector<std::string> uniforms;
+        std::stringstream stream(context.corpus);
+        parse_shader_regex(stream, vertex, fragment, uniforms);
+    }
+}
+
+BENCHMARK(ShaderTest, Parse, 4, 1)
+{
+    auto& context = ShaderBenchContext::get();
+    for( int i = 0; i < 8; i++ )
+    {
+        Shader shader;
+        std::stringstream stream(context.corpus);
+        shader.read(stream);
+    }
+}
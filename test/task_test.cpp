@@ -104,3 +104,94 @@ BENCHMARK(TaskTest, TaskSystemParralleForSequence, 3, 1)
 {
     works(1, idle);
 }
+
+TEST_CASE("TestProfiler")
+{
+    core::details::initialize();
+    auto task = core::add_subsystem<core::TaskSystem>();
+    auto profiler = core::add_subsystem<core::Profiler>(64);
+
+    {
+        PROFILE_SCOPE("outer");
+        {
+            PROFILE_SCOPE("inner \"quoted\"");
+        }
+    }
+
+    unsigned result = 0;
+    auto handle = task->create("profiled");
+    for( unsigned i = 0; i < 8; i++ )
+        task->run(task->create_as_child(handle, "profiled.child", fib, std::ref(result), i));
+    task->run(handle);
+    task->wait(handle);
+
+    std::vector<std::pair<unsigned, core::ProfileZone>> zones;
+    profiler->collect(zones);
+
+    unsigned outer = 0, inner = 0, tasks = 0;
+    for( auto& pair : zones )
+    {
+        auto& zone = pair.second;
+        if( strcmp(zone.name, "outer") == 0 )
+        {
+            REQUIRE( pair.first == 0 );
+            REQUIRE( zone.depth == 0 );
+            outer ++;
+        }
+        else if( strcmp(zone.name, "inner \"quoted\"") == 0 )
+        {
+            REQUIRE( zone.depth == 1 );
+            inner ++;
+        }
+        else if( strncmp(zone.name, "profiled", 8) == 0 )
+            tasks ++;
+    }
+
+    REQUIRE( outer == 1 );
+    REQUIRE( inner == 1 );
+    REQUIRE( tasks == 9 );
+
+    std::stringstream trace;
+    REQUIRE( profiler->save(trace) );
+    REQUIRE( trace.str().find("\"traceEvents\"") != std::string::npos );
+    REQUIRE( trace.str().find("\"inner \\\"quoted\\\"\"") != std::string::npos );
+
+    // the oldest zones are overwritten once ring is full
+    for( unsigned i = 0; i < 100; i++ )
+    {
+        PROFILE_SCOPE("overflow");
+    }
+
+    zones.clear();
+    profiler->collect(zones);
+    unsigned main = 0;
+    for( auto& pair : zones )
+        if( pair.first == 0 ) main ++;
+    REQUIRE( main == 64 );
+
+    // nothing is recorded if disabled
+    profiler->set_enabled(false);
+    {
+        PROFILE_SCOPE("disabled");
+    }
+
+    zones.clear();
+    profiler->collect(zones);
+    for( auto& pair : zones )
+        REQUIRE( strcmp(pair.second.name, "disabled") != 0 );
+
+    core::details::dispose();
+}
+
+BENCHMARK(TaskTest, ProfileScope, 10, 1)
+{
+    core::details::initialize();
+    core::add_subsystem<core::Profiler>(1024);
+
+    for( unsigned i = 0; i < 100000; i++ )
+    {
+        PROFILE_SCOPE("benchmark");
+    }
+
+    core::details::dispose();
+}
@@ -0,0 +1,41 @@
+#include <iostream>
+#include <fstream>
+#include <lemon-toolkit.hpp>
+
+using namespace lemon;
+
+// usage: bake <image> <output>
+// converts an image (png/jpg/...) into a baked texture with full mip chain, which
+// is mapped and uploaded level by level without decoding when read by Image.
+int main(int argc, char* argv[])
+{
+    if( argc != 3 )
+    {
+        std::cerr << "usage: " << argv[0] << " <image> <output>" << std::endl;
+        return 1;
+    }
+
+    auto file = fs::map_file(fs::Path(argv[1]));
+    if( !file )
+    {
+        std::cerr << "failed to open image " << argv[1] << std::endl;
+        return 1;
+    }
+
+    res::Image image;
+    image.set_name(argv[1]);
+    if( !image.read(file) || !image.generate_mipmaps() )
+    {
+        std::cerr << "failed to decode image " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::ofstream output(argv[2], std::ios::out | std::ios::binary | std::ios::trunc);
+    if( !output.is_open() || !image.save_texture(output) )
+    {
+        std::cerr << "failed to save texture " << argv[2] << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include <iostream>
+#include <lemon-toolkit.hpp>
+
+using namespace lemon;
+
+// usage: pack <directory> <output>
+// packs regular files of a directory tree into a package, which could be
+// added to ArchiveCollection with add_package, or "/Resource/Packages" in
+// the arguments of engine.
+int main(int argc, char* argv[])
+{
+    if( argc != 3 )
+    {
+        std::cerr << "usage: " << argv[0] << " <directory> <output>" << std::endl;
+        return 1;
+    }
+
+    if( !res::PackageArchive::build(fs::Path(argv[1]), fs::Path(argv[2])) )
+    {
+        std::cerr << "failed to build package " << argv[2] << " from " << argv[1] << std::endl;
+        return 1;
+    }
+
+    return 0;
+}